@@ -1,14 +1,25 @@
 #version 460 core
 
-layout (location = 0) in uint i_pos;
+layout (location = 0) in uvec2 i_vertex; // x is the position, texture and face, y is the light in front of the face
 out vec2 tex_pos;
+out float brightness;
 uniform mat4 camera;
-uniform mat4 model;
+uniform float daylight; // 0 at midnight to 1 at noon, scales sky light so nights need no remesh
+
+// One chunk offset per indirect draw command, indexed by the command's base instance
+layout (std430, binding = 0) readonly buffer chunk_offsets
+{
+	vec4 offsets[];
+};
 
 void main()
 {
+	uint i_pos = i_vertex.x;
+	float level = max(float(i_vertex.y & 15) * mix(0.25, 1.0, daylight), float((i_vertex.y >> 4) & 15));
+	brightness = pow(0.85, 15.0 - level);
+
 	tex_pos = vec2(((i_pos >> 21) & 255) + ((i_pos >> 19) & 1), (5.0 - ((i_pos >> 29) & 7)) + ((i_pos >> 20) & 1));
 	tex_pos.x /= 10.0; // Block count - 1, update w/ adding new blocks
 	tex_pos.y /= 6.0;
-	gl_Position = camera * (model * vec4(i_pos & 31, ((i_pos >> 10) & 511), (i_pos >> 5) & 31, 1.0));
+	gl_Position = camera * vec4(vec3(i_pos & 31, ((i_pos >> 10) & 511), (i_pos >> 5) & 31) + offsets[gl_BaseInstance].xyz, 1.0);
 }
\ No newline at end of file
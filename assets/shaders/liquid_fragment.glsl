@@ -1,11 +1,13 @@
 #version 460 core
 
 in vec2 tex_pos;
+in float brightness;
 out vec4 color;
 uniform sampler2D sampler;
 
 void main()
 {
 	color = texture(sampler, tex_pos);
+	color.rgb *= brightness;
 	color.a = 0.7F;
 }
\ No newline at end of file
@@ -93,6 +93,11 @@ vector3_t camera_position(void)
 /* There should be caching here too. TO DO */
 
 vector3_t camera_forward(void)
+{
+	return camera_direction(yaw, pitch);
+}
+
+vector3_t camera_direction(float yaw, float pitch)
 {
 	return vector3_normalize((vector3_t) { cosf(yaw) * cosf(pitch), sinf(pitch), sinf(yaw) * cosf(pitch) });
 }
@@ -30,6 +30,8 @@ vector3_t camera_position(void);
 
 /* Returns the forward vector */
 vector3_t camera_forward(void);
+/* Returns the forward vector a camera rotated by yaw and pitch would have, without touching the camera */
+vector3_t camera_direction(float yaw, float pitch);
 /* Returns the right vector (which actually points to the left!!) */
 vector3_t camera_right(void);
 /* Returns the up vector */
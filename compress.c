@@ -0,0 +1,283 @@
+/*
+	compress.c ~ RL
+	Dependency-free codecs for saved data
+*/
+
+#include "compress.h"
+#include "util.h"
+
+#define LZ_MIN_MATCH	4
+#define LZ_MAX_OFFSET	UINT16_MAX
+#define LZ_HASH_BITS	12
+#define LZ_HASH_SIZE	(1 << LZ_HASH_BITS)
+
+#define DELTA_ENTRY_SIZE 3
+
+size_t compress_bound(size_t len)
+{
+	/* Run-length encoding at worst doubles its input, and the LZ stage adds a length byte every 255 literals on top of that */
+	size_t rle = len * 2;
+	return rle + rle / 255 + 16;
+}
+
+static size_t compress_rle_encode(const uint8_t* src, size_t len, uint8_t* dst)
+{
+	size_t out = 0;
+	for (size_t i = 0; i < len;)
+	{
+		uint8_t value = src[i];
+		size_t run = 1;
+		while (i + run < len && run < UINT8_MAX && src[i + run] == value)
+		{
+			run++;
+		}
+		dst[out++] = (uint8_t)run;
+		dst[out++] = value;
+		i += run;
+	}
+	return out;
+}
+
+static size_t compress_rle_decode(const uint8_t* src, size_t len, uint8_t* dst, size_t dst_len)
+{
+	size_t out = 0;
+	for (size_t i = 0; i + 1 < len; i += 2)
+	{
+		size_t run = src[i];
+		if (run == 0 || out + run > dst_len)
+		{
+			return 0;
+		}
+		memset(dst + out, src[i + 1], run);
+		out += run;
+	}
+	return out;
+}
+
+static inline uint32_t compress_lz_hash(const uint8_t* at)
+{
+	uint32_t word;
+	memcpy(&word, at, sizeof word);
+	return (word * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+/* Writes the part of a length that does not fit in its token nibble */
+static inline size_t compress_lz_length(uint8_t* dst, size_t out, size_t len)
+{
+	for (len -= 15; len >= UINT8_MAX; len -= UINT8_MAX)
+	{
+		dst[out++] = UINT8_MAX;
+	}
+	dst[out++] = (uint8_t)len;
+	return out;
+}
+
+/* Each sequence is a token holding the literal count and match length in a nibble each, the literals,
+	then the match's offset back into the output. The last sequence is only literals. */
+static size_t compress_lz_sequence(uint8_t* dst, size_t out, const uint8_t* literals, size_t literal_len, size_t offset, size_t match_len)
+{
+	size_t match_code = match_len ? match_len - LZ_MIN_MATCH : 0;
+	dst[out++] = (uint8_t)(((literal_len < 15 ? literal_len : 15) << 4) | (match_code < 15 ? match_code : 15));
+	if (literal_len >= 15)
+	{
+		out = compress_lz_length(dst, out, literal_len);
+	}
+	memcpy(dst + out, literals, literal_len);
+	out += literal_len;
+
+	if (match_len)
+	{
+		dst[out++] = (uint8_t)(offset & 0xFF);
+		dst[out++] = (uint8_t)(offset >> 8);
+		if (match_code >= 15)
+		{
+			out = compress_lz_length(dst, out, match_code);
+		}
+	}
+	return out;
+}
+
+static size_t compress_lz_encode(const uint8_t* src, size_t len, uint8_t* dst)
+{
+	int table[LZ_HASH_SIZE];
+	memset(table, 0xFF, sizeof table);
+
+	size_t out = 0, anchor = 0, i = 0;
+	while (i + LZ_MIN_MATCH <= len)
+	{
+		uint32_t hash = compress_lz_hash(src + i);
+		int candidate = table[hash];
+		table[hash] = (int)i;
+		if (candidate < 0 || i - candidate > LZ_MAX_OFFSET || memcmp(src + candidate, src + i, LZ_MIN_MATCH) != 0)
+		{
+			i++;
+			continue;
+		}
+
+		size_t match_len = LZ_MIN_MATCH;
+		while (i + match_len < len && src[candidate + match_len] == src[i + match_len])
+		{
+			match_len++;
+		}
+		out = compress_lz_sequence(dst, out, src + anchor, i - anchor, i - candidate, match_len);
+		i += match_len;
+		anchor = i;
+	}
+	return compress_lz_sequence(dst, out, src + anchor, len - anchor, 0, 0);
+}
+
+static inline bool compress_lz_read_length(const uint8_t* src, size_t len, size_t* in, size_t* value)
+{
+	uint8_t next;
+	do
+	{
+		if (*in >= len)
+		{
+			return false;
+		}
+		next = src[(*in)++];
+		*value += next;
+	} while (next == UINT8_MAX);
+	return true;
+}
+
+static size_t compress_lz_decode(const uint8_t* src, size_t len, uint8_t* dst, size_t dst_len)
+{
+	size_t in = 0, out = 0;
+	while (in < len)
+	{
+		uint8_t token = src[in++];
+		size_t literal_len = token >> 4;
+		if (literal_len == 15 && !compress_lz_read_length(src, len, &in, &literal_len))
+		{
+			return 0;
+		}
+		if (in + literal_len > len || out + literal_len > dst_len)
+		{
+			return 0;
+		}
+		memcpy(dst + out, src + in, literal_len);
+		in += literal_len;
+		out += literal_len;
+
+		if (in == len)
+		{
+			break;
+		}
+
+		if (in + 2 > len)
+		{
+			return 0;
+		}
+		size_t offset = src[in] | (src[in + 1] << 8);
+		in += 2;
+		size_t match_len = token & 0xF;
+		if (match_len == 15 && !compress_lz_read_length(src, len, &in, &match_len))
+		{
+			return 0;
+		}
+		match_len += LZ_MIN_MATCH;
+		if (offset == 0 || offset > out || out + match_len > dst_len)
+		{
+			return 0;
+		}
+
+		/* Byte by byte, since a match may overlap what it is writing */
+		for (size_t i = 0; i < match_len; i++, out++)
+		{
+			dst[out] = dst[out - offset];
+		}
+	}
+	return out;
+}
+
+size_t compress_encode(codec_t codec, const uint8_t* src, size_t len, uint8_t* dst, size_t dst_len)
+{
+	switch (codec)
+	{
+	case CODEC_RAW:
+		if (len > dst_len)
+		{
+			return 0;
+		}
+		memcpy(dst, src, len);
+		return len;
+	case CODEC_RLE_LZ:
+	{
+		if (dst_len < compress_bound(len))
+		{
+			return 0;
+		}
+		uint8_t* runs = mc_malloc(len * 2);
+		size_t result = compress_lz_encode(runs, compress_rle_encode(src, len, runs), dst);
+		free(runs);
+		return result;
+	}
+	default:
+		assert(false);
+		return 0;
+	}
+}
+
+size_t compress_decode(codec_t codec, const uint8_t* src, size_t len, uint8_t* dst, size_t dst_len)
+{
+	switch (codec)
+	{
+	case CODEC_RAW:
+		if (len > dst_len)
+		{
+			return 0;
+		}
+		memcpy(dst, src, len);
+		return len;
+	case CODEC_RLE_LZ:
+	{
+		uint8_t* runs = mc_malloc(dst_len * 2);
+		size_t runs_len = compress_lz_decode(src, len, runs, dst_len * 2);
+		size_t result = runs_len ? compress_rle_decode(runs, runs_len, dst, dst_len) : 0;
+		free(runs);
+		return result;
+	}
+	default:
+		return 0;
+	}
+}
+
+size_t compress_delta_encode(const uint8_t* base, const uint8_t* src, size_t len, uint8_t* dst, size_t dst_len)
+{
+	assert(len <= UINT16_MAX + 1);
+	size_t out = 0;
+	for (size_t i = 0; i < len; i++)
+	{
+		if (base[i] == src[i])
+		{
+			continue;
+		}
+		if (out + DELTA_ENTRY_SIZE > dst_len)
+		{
+			return 0;
+		}
+		dst[out++] = (uint8_t)(i & 0xFF);
+		dst[out++] = (uint8_t)(i >> 8);
+		dst[out++] = src[i];
+	}
+	return out;
+}
+
+bool compress_delta_decode(const uint8_t* src, size_t len, uint8_t* dst, size_t dst_len)
+{
+	if (len % DELTA_ENTRY_SIZE != 0)
+	{
+		return false;
+	}
+	for (size_t i = 0; i < len; i += DELTA_ENTRY_SIZE)
+	{
+		size_t index = src[i] | (src[i + 1] << 8);
+		if (index >= dst_len)
+		{
+			return false;
+		}
+		dst[index] = src[i + 2];
+	}
+	return true;
+}
\ No newline at end of file
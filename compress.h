@@ -0,0 +1,32 @@
+/*
+	compress.h ~ RL
+	Dependency-free codecs for saved data
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Tags stored alongside encoded data so readers know how to decode it. Only ever append to this list. */
+typedef enum codec
+{
+	CODEC_RAW,		/* Stored as-is */
+	CODEC_RLE_LZ,	/* Run-length encoded as (run, byte) pairs, then LZ77 compressed */
+	CODEC_DELTA,	/* (uint16 index, byte) pairs listing where the data differs from a base the reader rebuilds itself. See compress_delta_encode. */
+	CODEC_COUNT
+} codec_t;
+
+/* Largest amount of bytes encoding "len" bytes with any codec can produce */
+size_t compress_bound(size_t len);
+/* Encodes src with codec into dst. CODEC_DELTA needs a base, use compress_delta_encode for it. Returns the amount of bytes written, or 0 if dst is too small. */
+size_t compress_encode(codec_t codec, const uint8_t* src, size_t len, uint8_t* dst, size_t dst_len);
+/* Decodes src with codec into dst. Returns the amount of bytes written, or 0 if src is corrupt or does not fit in dst. */
+size_t compress_decode(codec_t codec, const uint8_t* src, size_t len, uint8_t* dst, size_t dst_len);
+
+/*	Lists every byte where src differs from base into dst. Returns the amount of bytes written, or 0 if there are no
+	differences or they do not fit in dst_len, so dst_len doubles as the most a delta may cost before storing in full is better. */
+size_t compress_delta_encode(const uint8_t* base, const uint8_t* src, size_t len, uint8_t* dst, size_t dst_len);
+/* Applies a delta to dst, which must already hold the base it was made against. Returns false if src is corrupt. */
+bool compress_delta_decode(const uint8_t* src, size_t len, uint8_t* dst, size_t dst_len);
\ No newline at end of file
@@ -75,10 +75,16 @@ static vector3_t entity_player_make_move_vector(vector3_t forward, vector3_t rig
 	return vector3_normalize(desired);
 }
 
+/* Gets the right vector to go with forward, which like the camera's points to the left */
+static inline vector3_t entity_right(vector3_t forward)
+{
+	return vector3_normalize(vector3_cross((vector3_t) { 0, 1, 0 }, forward));
+}
+
 static void entity_player_move_standard(entity_t* ent, float delta)
 {
-	vector3_t forward = camera_forward(),
-		right = camera_right();
+	vector3_t forward = entity_forward(ent),
+		right = entity_right(forward);
 	forward.y = 0.0F;
 	forward = vector3_normalize(forward);
 	right.y = 0.0F;
@@ -111,7 +117,8 @@ static void entity_player_move_standard(entity_t* ent, float delta)
 
 static void entity_player_move_noclip(entity_t* ent, float delta)
 {
-	vector3_t desired = entity_player_make_move_vector(camera_forward(), camera_right());
+	vector3_t forward = entity_forward(ent);
+	vector3_t desired = entity_player_make_move_vector(forward, entity_right(forward));
 	float speed = window_input_down(INPUT_SNEAK) ? 30.0F : 15.0F;
 	desired = vector3_mul_scalar(desired, delta * speed);
 	ent->hitbox = aabb_translate(ent->hitbox, desired);
@@ -155,23 +162,28 @@ void entity_player_update(entity_t* ent, float delta)
 
 	if (window_input_clicked(INPUT_BREAK_BLOCK))
 	{
-		world_block_set(world_ray_cast(camera_position(), camera_forward(), 5.0F, RAY_SOLID).block, BLOCK_AIR);
+		world_block_set(world_ray_cast(entity_player_eye(ent), entity_forward(ent), 5.0F, RAY_SOLID).block, BLOCK_AIR);
 	}
 	if (window_input_clicked(INPUT_PLACE_BLOCK))
 	{
-		block_coords_t bc = world_ray_neighbor(world_ray_cast(camera_position(), camera_forward(), 5.0F, RAY_SOLID));
+		block_coords_t bc = world_ray_neighbor(world_ray_cast(entity_player_eye(ent), entity_forward(ent), 5.0F, RAY_SOLID));
 		if (!aabb_collides_aabb(ent->hitbox, (aabb_t) { .min = block_coords_to_vector(bc), .max = vector3_add_scalar(block_coords_to_vector(bc), 1.0F) }))
 		{
 			world_block_set(bc, internal->inventory.items[internal->inventory.active_slot]);
 		}
 	}
 
-	internal->inventory.active_slot += window_mouse_wheel_delta();
-	if (internal->inventory.active_slot < 0)
+	int wheel = window_mouse_wheel_delta();
+	if (wheel != 0)
 	{
-		internal->inventory.active_slot += 9;
+		internal->inventory.active_slot += wheel;
+		if (internal->inventory.active_slot < 0)
+		{
+			internal->inventory.active_slot += 9;
+		}
+		internal->inventory.active_slot %= 9;
+		internal->inventory.version++;
 	}
-	internal->inventory.active_slot %= 9;
 }
 
 bool entity_player_is_noclipping(const entity_t* ent)
@@ -180,6 +192,16 @@ bool entity_player_is_noclipping(const entity_t* ent)
 	return internal->noclip_on;
 }
 
+vector3_t entity_player_eye(const entity_t* ent)
+{
+	return vector3_add(aabb_get_center(ent->hitbox), (vector3_t) { 0.0F, ENTITY_PLAYER_CAMERA_OFFSET - aabb_get_dimensions(ent->hitbox).y / 2.0F, 0.0F });
+}
+
+vector3_t entity_forward(const entity_t* ent)
+{
+	return camera_direction(ent->rotation.x, ent->rotation.y);
+}
+
 void entity_damage(entity_t* ent, int dmg)
 {
 	ent->health -= dmg;
@@ -188,52 +210,31 @@ void entity_damage(entity_t* ent, int dmg)
 	interface_set_current_hearts(ent->health);
 }
 
-#define MOVEMENT_EPSILON	0.01F
-#define MOVEMENT_MAX_LENGTH	0.7F
+#define MOVEMENT_EPSILON	0.01F	/* Gap left between entities and the blocks they run into */
 
-collision_face_t entity_move(entity_t* ent, vector3_t addend)
+collision_face_t entity_move(entity_t* ent, vector3_t addend, vector3_t* impact)
 {
-	if (vector3_magnitude(addend) > MOVEMENT_MAX_LENGTH)
-	{
-		collision_face_t res = 0;
-		int iter_cnt = (int)(vector3_magnitude(addend) / MOVEMENT_MAX_LENGTH + 1.0F);
-		addend = vector3_div_scalar(addend, iter_cnt);
-		for (int i = 0; i < iter_cnt; i++)
-		{
-			res |= entity_move(ent, addend);
-		}
-		return res;
-	}
-
-	aabb_t arr[0x100];
-	int len = world_region_aabb(
-		vector_to_block_coords(vector3_sub_scalar(ent->hitbox.min, 2.0F)),
-		vector_to_block_coords(vector3_add_scalar(ent->hitbox.max, 2.0F)),
-		arr, sizeof arr / sizeof * arr);
-
-	vector3_uarray_t uvelocity = { addend };
+	vector3_uarray_t uvelocity = { addend }, time = { { 1.0F, 1.0F, 1.0F } };
 	collision_face_t res = 0;
 	for (int i = 0; i < 3; i++)
 	{
-		aabb_t moved = aabb_translate_axis(ent->hitbox, i, uvelocity.raw[i]);
-		for (int j = 0; j < len; j++)
+		if (uvelocity.raw[i] == 0.0F)
 		{
-			if (!aabb_collides_aabb(moved, arr[j]))
-			{
-				continue;
-			}
+			continue;
+		}
 
+		sweep_t sweep = world_sweep_aabb(ent->hitbox, i, uvelocity.raw[i], MOVEMENT_EPSILON);
+		if (sweep.hit)
+		{
 			res |= (uvelocity.raw[i] > 0.0F ? 0b01 : 0b10) << (i * 2);
-			float depth = (vector3_uarray_t){ aabb_collision_depth(moved, arr[j]) }.raw[i];
-			uvelocity.raw[i] += (uvelocity.raw[i] > 0.0F ? -1.0F : 1.0F) * (depth + MOVEMENT_EPSILON);
-
-			/* prevent jitter from "zero" movement */
-			uvelocity.raw[i] = fabsf(uvelocity.raw[i]) <= MOVEMENT_EPSILON ? 0.0F : uvelocity.raw[i];
-
-			moved = aabb_translate_axis(ent->hitbox, i, uvelocity.raw[i]);
 		}
-		ent->hitbox = moved;
+		ent->hitbox = aabb_translate_axis(ent->hitbox, i, uvelocity.raw[i] * sweep.time);
+		time.raw[i] = sweep.time;
 	}
 
+	if (impact)
+	{
+		*impact = time.vec;
+	}
 	return res;
 }
\ No newline at end of file
@@ -47,17 +47,22 @@ void entity_player_destroy(entity_t* ent);
 void entity_player_update(entity_t* ent, float delta);
 /* Is the player noclipping? */
 bool entity_player_is_noclipping(const entity_t* ent);
+/* Gets where the player's eyes are, which is where the camera ends up once it has caught up with the last tick */
+vector3_t entity_player_eye(const entity_t* ent);
+/* Gets the direction the entity looks in from its rotation. The simulation uses this rather than the camera, which belongs to the render thread. */
+vector3_t entity_forward(const entity_t* ent);
 
 /* Damages entity */
 void entity_damage(entity_t* ent, int dmg);
 
-/* Moves an entity given an addend, checking for collisions w/ the world */
-collision_face_t entity_move(entity_t* ent, vector3_t addend);
+/*	Moves an entity given an addend, sweeping its hitbox through the world one axis at a time and returning the faces it touched.
+	If impact is not NULL, it is set to the fraction of the addend moved on each axis, 1 on axes where nothing was touched. */
+collision_face_t entity_move(entity_t* ent, vector3_t addend, vector3_t* impact);
 
 /* Does gravity and moves an entity. Does change an entity's grounded state */
 extern inline void entity_gravity_then_move(entity_t* ent, float delta)
 {
-	collision_face_t face = entity_move(ent, vector3_add(vector3_mul_scalar(ent->velocity, delta), (vector3_t) { 0, -delta, 0 }));
+	collision_face_t face = entity_move(ent, vector3_add(vector3_mul_scalar(ent->velocity, delta), (vector3_t) { 0, -delta, 0 }), NULL);
 	ent->grounded = face & FACE_UP;
 	if (!ent->grounded)
 	{
@@ -1,22 +1,142 @@
 /*
 	game.c ~ RL
-	Primary game loop
+	Primary game loop. The simulation ticks on its own thread at a fixed rate, and frames interpolate between the ticks it publishes.
 */
 
 #include "camera.h"
 #include "game.h"
 #include "graphics.h"
 #include "interface.h"
+#include "platform.h"
+#include "profiler.h"
 #include "util.h"
 #include "window.h"
 
-#define TICK_TIME (1.0F / 20)
+#define TICK_TIME		(1.0F / 20)
+#define MAX_CATCH_UP	5	/* Most ticks run back to back after a stall before the simulation drops the time it lost */
+#define PROFILE_PATH	"profile.txt"
+
+/* What a frame needs from the last tick. The simulation thread fills the back buffer and swaps it to the front under snapshot_lock. */
+struct game_snapshot
+{
+	vector3_t prev_eye, eye;	/* Where the player's eyes were before and after the tick */
+	double time;				/* When the tick finished */
+	float daylight;				/* world_daylight as of the tick */
+	bool wireframe;
+	bool lock_mouse;			/* Should the cursor be held in the middle of the window? */
+};
 
 static shader_t block_shader;
 static shader_t liquid_shader;
 static sampler_t atlas;
 
 static debug_buffer_t current_block;
+static bool current_block_visible;
+
+static thread_t sim_thread;
+static mutex_t game_lock;	/* Held by the simulation thread for a whole tick, and by the render thread while it reads game state */
+static bool sim_running;	/* Guarded by game_lock */
+static bool wireframe_on;	/* Only touched by ticks */
+static bool mouse_focused = true;	/* Only touched by ticks */
+
+static mutex_t snapshot_lock;
+static struct game_snapshot snapshots[2];
+static int snapshot_front;	/* Written by the simulation thread under snapshot_lock */
+
+/* Publishes the player as the last tick left it. Called with game_lock held, or before the simulation thread starts. */
+static void game_publish(void)
+{
+	struct game_snapshot* back = &snapshots[!snapshot_front];
+	vector3_t eye = entity_player_eye(&player);
+	back->eye = eye;
+	back->prev_eye = vector3_add(player.prev_position, vector3_sub(eye, aabb_get_center(player.hitbox)));
+	back->time = window_time();
+	back->daylight = world_daylight();
+	back->wireframe = wireframe_on;
+	back->lock_mouse = mouse_focused && !interface_is_inventory_open();
+
+	platform_mutex_lock(snapshot_lock);
+	snapshot_front = !snapshot_front;
+	platform_mutex_unlock(snapshot_lock);
+}
+
+/* Prints the profiler's history to stdout and saves it to PROFILE_PATH */
+static void game_dump_profile(void)
+{
+	profiler_dump(stdout);
+	FILE* file = fopen(PROFILE_PATH, "w");
+	if (file)
+	{
+		profiler_dump(file);
+		fclose(file);
+	}
+}
+
+/* Runs one tick. Returns false once the game is shutting down. */
+static bool game_tick(void)
+{
+	platform_mutex_lock(game_lock);
+	bool running = sim_running;
+	if (running)
+	{
+		PROFILE_BEGIN(TICK);
+		window_input_update();
+		if (window_input_clicked(INPUT_REGENERATE_WORLD))
+		{
+			world_generate((unsigned int)window_time());
+		}
+		if (window_input_clicked(INPUT_DUMP_PROFILE))
+		{
+			game_dump_profile();
+		}
+
+		world_update(TICK_TIME);
+		interface_update();
+		interface_set_underwater_state(world_block_get(vector_to_block_coords(entity_player_eye(&player))) == BLOCK_WATER);
+		float save_progress;
+		interface_set_save_progress(world_file_save_progress(&save_progress) ? save_progress : -1.0F);
+
+		if (window_input_clicked(INPUT_TOGGLE_WIREFRAME))
+		{
+			wireframe_on = !wireframe_on;
+		}
+		if (window_input_clicked(INPUT_TOGGLE_MOUSE_FOCUS))
+		{
+			mouse_focused = !mouse_focused;
+		}
+		PROFILE_END(TICK);
+		game_publish();
+	}
+	platform_mutex_unlock(game_lock);
+	return running;
+}
+
+/* Simulation thread. Ticks on a fixed timestep, running late ticks back to back so slow frames or ticks do not slow the game down. */
+static void game_simulate(void* user)
+{
+	double next = window_time();
+	while (true)
+	{
+		double now = window_time();
+		if (now < next)
+		{
+			platform_sleep((int)((next - now) * 1000.0));
+			continue;
+		}
+
+		for (int i = 0; i < MAX_CATCH_UP && next <= now; i++, next += TICK_TIME)
+		{
+			if (!game_tick())
+			{
+				return;
+			}
+		}
+		if (next <= now)
+		{
+			next = now;
+		}
+	}
+}
 
 void game_init(void)
 {
@@ -30,10 +150,25 @@ void game_init(void)
 	float verts[72];
 	graphics_primitive_cube((vector3_t) { 0 }, (vector3_t) { 1, 1, 1 }, verts);
 	current_block.vertex = graphics_buffer_create(verts, sizeof verts / sizeof * verts / 3, VERTEX_POSITION);
+
+	profiler_init();
+	game_lock = platform_mutex_create();
+	snapshot_lock = platform_mutex_create();
+	game_publish();
+	sim_running = true;
+	sim_thread = platform_thread_create(game_simulate, NULL);
 }
 
 void game_destroy(void)
 {
+	platform_mutex_lock(game_lock);
+	sim_running = false;
+	platform_mutex_unlock(game_lock);
+	platform_thread_join(&sim_thread);
+	platform_mutex_delete(&snapshot_lock);
+	platform_mutex_delete(&game_lock);
+	profiler_destroy();
+
 	graphics_shader_delete(&block_shader);
 	graphics_sampler_delete(&atlas);
 
@@ -44,53 +179,60 @@ void game_destroy(void)
 
 void game_frame(float delta)
 {
-	static float elapsed = 0.0F;
-	elapsed += delta;
-
-	vector3_t curr_pos = aabb_get_center(player.hitbox);
-	vector3_t interp_pos = vector3_add(player.prev_position, vector3_mul_scalar(vector3_sub(curr_pos, player.prev_position), elapsed / TICK_TIME));
-	vector3_t cam_pos = vector3_add(interp_pos, (vector3_t) { 0.0F, ENTITY_PLAYER_CAMERA_OFFSET - aabb_get_dimensions(player.hitbox).y / 2.0F, 0.0F });
-	camera_update(cam_pos);
-
-	if (window_input_clicked(INPUT_REGENERATE_WORLD))
-	{
-		world_generate((unsigned int)window_time());
-	}
-
-	static bool wireframe_on;
-	if (elapsed > TICK_TIME)
+	PROFILE_BEGIN(FRAME);
+	platform_mutex_lock(snapshot_lock);
+	struct game_snapshot snapshot = snapshots[snapshot_front];
+	platform_mutex_unlock(snapshot_lock);
+	window_set_mouse_locked(snapshot.lock_mouse);
+
+	/* The camera trails the last tick by one tick, moving from where it started to where it ended */
+	float t = (float)((window_time() - snapshot.time) / TICK_TIME);
+	t = max(min(t, 1.0F), 0.0F);
+	camera_update(vector3_add(snapshot.prev_eye, vector3_mul_scalar(vector3_sub(snapshot.eye, snapshot.prev_eye), t)));
+
+	/* Game state is only read between ticks. If one is running, the frame draws what was uploaded last rather than wait for it. */
+	if (platform_mutex_try_lock(game_lock))
 	{
-		interface_set_underwater_state(false);
-		if (world_block_get(vector_to_block_coords(cam_pos)) == BLOCK_WATER)
-		{
-			interface_set_underwater_state(true);
-		}
-
-		window_input_update();
+		PROFILE_BEGIN(FRAME_PREPARE);
 		player.rotation = (vector3_t){ camera_yaw(), camera_pitch(), 0.0F };
-		world_update(elapsed);
-		interface_update();
-		elapsed -= TICK_TIME;
+		world_render_prepare();
+		interface_prepare();
 
-		if (window_input_clicked(INPUT_TOGGLE_WIREFRAME))
+		ray_t ray = world_ray_cast(camera_position(), camera_forward(), 5.0F, RAY_SOLID);
+		current_block_visible = !IS_INVALID_BLOCK_COORDS(ray.block);
+		if (current_block_visible)
 		{
-			wireframe_on = !wireframe_on;
+			current_block.position = (vector3_t){ ray.block.x, ray.block.y, ray.block.z };
 		}
+		PROFILE_END(FRAME_PREPARE);
+		platform_mutex_unlock(game_lock);
 	}
 
-	graphics_clear(COLOR_CREATE(0x64, 0x95, 0xED));
+	PROFILE_BEGIN(FRAME_DRAW);
+	float sky = 0.1F + 0.9F * snapshot.daylight;
+	graphics_clear(COLOR_CREATE((int)(0x64 * sky), (int)(0x95 * sky), (int)(0xED * sky)));
 	graphics_sampler_use(atlas);
 
-	graphics_debug_set_wireframe_mode(wireframe_on);
-	world_render(block_shader, liquid_shader, delta);
+	graphics_debug_set_wireframe_mode(snapshot.wireframe);
+	world_render(block_shader, liquid_shader, snapshot.daylight, delta);
 
 	graphics_debug_set_wireframe_mode(false);
 	interface_render();
 
-	ray_t ray = world_ray_cast(camera_position(), camera_forward(), 5.0F, RAY_SOLID);
-	if (!IS_INVALID_BLOCK_COORDS(ray.block))
+	if (current_block_visible)
 	{
-		current_block.position = (vector3_t){ ray.block.x, ray.block.y, ray.block.z };
 		graphics_debug_queue_buffer(current_block);
 	}
+	PROFILE_END(FRAME_DRAW);
+	PROFILE_END(FRAME);
+}
+
+void game_benchmark(FILE* stream)
+{
+	world_render_benchmark(stream);
+	world_region_benchmark(stream);
+	world_tick_benchmark(stream);
+	world_sweep_benchmark(stream);
+	world_light_benchmark(stream);
+	world_ray_benchmark(stream);
 }
\ No newline at end of file
@@ -10,4 +10,6 @@
 
 void game_init(void);
 void game_destroy(void);
-void game_frame(float delta);
\ No newline at end of file
+void game_frame(float delta);
+/* Runs the headless CPU benchmarks and prints their results to stream. Needs no window or OpenGL context. */
+void game_benchmark(FILE* stream);
\ No newline at end of file
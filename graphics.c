@@ -6,6 +6,7 @@
 #include <assert.h>
 #include "camera.h"
 #include "opengl.h"
+#include "platform.h"
 #include <stdio.h>
 #include "util.h"
 #include <varargs.h>
@@ -40,6 +41,19 @@ struct vertex_buffer
 	vertex_type_t type;
 };
 
+struct vertex_arena
+{
+	struct vertex_buffer buffer;	/* size is the end of the furthest allocated range */
+	array_list_t free_blocks;		/* struct arena_block array_list, sorted by first */
+	GLuint command_buffer, storage_buffer;
+	GLsizeiptr command_reserved, storage_reserved;
+};
+
+struct arena_block
+{
+	int first, size;
+};
+
 static shader_t current_shader;
 static vertex_buffer_t current_buffer;
 static sampler_t current_sampler;
@@ -49,13 +63,26 @@ static struct vertex_buffer debug_buffer;
 static vertex_buffer_t axis_buffer;
 static array_list_t user_debug_buffers;
 
+#define DEBUG_PRIMITIVE_LIFETIME 3.5
+
 struct debug_primitive
 {
 	int start, size;
 	double timestamp;
-	hash_t hash;
 };
-static array_list_t primitives;
+static map_t primitives;			/* struct debug_primitive map, keyed by the hash of the primitive's vertices */
+static array_list_t debug_vertices;	/* CPU copy of debug_buffer, three floats per vertex. Uploaded once a frame if it changed. */
+static bool debug_dirty;
+
+/*	Every time a primitive is set, its hash and timestamp are pushed here, so the ring is always sorted by timestamp.
+	An entry whose timestamp no longer matches its primitive's was superseded by a later set and is skipped on expiry. */
+static struct debug_expiry
+{
+	hash_t hash;
+	double timestamp;
+} *expiry_ring;
+static int expiry_head, expiry_count, expiry_reserved;
+static mutex_t debug_lock;	/* Guards the primitives above, which the simulation thread sets and the render thread draws */
 
 void graphics_init(void)
 {
@@ -72,7 +99,11 @@ void graphics_init(void)
 	glGenBuffers(1, &debug_buffer.vbo);
 	debug_buffer.reserved = 64 * 24;
 	debug_buffer.type = VERTEX_POSITION;
-	primitives = mc_list_create(sizeof(struct debug_primitive));
+	primitives = mc_map_create(sizeof(struct debug_primitive));
+	debug_vertices = mc_list_create(sizeof(float) * 3);
+	expiry_reserved = 256;
+	expiry_ring = mc_malloc(sizeof * expiry_ring * expiry_reserved);
+	debug_lock = platform_mutex_create();
 
 	glBindVertexArray(debug_buffer.vao);
 	glBindBuffer(GL_ARRAY_BUFFER, debug_buffer.vbo);
@@ -99,7 +130,11 @@ void graphics_init(void)
 
 void graphics_destroy(void)
 {
-	mc_list_destroy(&primitives);
+	mc_map_destroy(&primitives);
+	mc_list_destroy(&debug_vertices);
+	free(expiry_ring);
+	expiry_ring = NULL;
+	platform_mutex_delete(&debug_lock);
 	mc_list_destroy(&user_debug_buffers);
 	graphics_shader_delete(&line_shader);
 	glDeleteBuffers(1, &debug_buffer.vbo);
@@ -367,6 +402,14 @@ void graphics_shader_int(const char* name, int i)
 	ASSERT_NO_ERROR();
 }
 
+void graphics_shader_float(const char* name, float f)
+{
+	struct uniform_stats* curr = graphics_shader_get_uniform(name);
+	mc_panic_if(!curr || curr->type != GL_FLOAT, "shader missing a uniform float");
+	glUniform1f(curr->location, f);
+	ASSERT_NO_ERROR();
+}
+
 static inline void graphics_buffer_bind(struct vertex_buffer* buf)
 {
 	if (buf == current_buffer)
@@ -379,44 +422,48 @@ static inline void graphics_buffer_bind(struct vertex_buffer* buf)
 	ASSERT_NO_ERROR();
 }
 
-vertex_buffer_t graphics_buffer_create(const void* start, int len, vertex_type_t type)
+static size_t graphics_vertex_size(vertex_type_t type)
 {
-	struct vertex_buffer* result = mc_malloc(sizeof * result);
-	glGenVertexArrays(1, &result->vao);
-	glGenBuffers(1, &result->vbo);
-	result->size = result->reserved = (GLsizei)len;
-	result->type = type;
+	switch (type)
+	{
+	case VERTEX_BLOCK: return sizeof(block_vertex_t);
+	case VERTEX_STANDARD: return sizeof(vertex_t);
+	case VERTEX_POSITION: return sizeof(float) * 3;
+	case VERTEX_DEBUG: return sizeof(debug_vertex_t);
+	case VERTEX_INTERFACE: return sizeof(interface_vertex_t);
 
-	graphics_buffer_bind(result);
+	default:
+		assert(false);
+		return 0;
+	}
+}
 
+/* Points the bound vertex array at the bound array buffer using the layout of "type" */
+static void graphics_vertex_layout(vertex_type_t type)
+{
 	switch (type)
 	{
 	case VERTEX_BLOCK:
-		glBufferData(GL_ARRAY_BUFFER, len * sizeof(block_vertex_t), start, GL_STATIC_DRAW);
 		glEnableVertexAttribArray(0);
-		glVertexAttribIPointer(0, 1, GL_UNSIGNED_INT, sizeof(block_vertex_t), (void*)0);
+		glVertexAttribIPointer(0, 2, GL_UNSIGNED_INT, sizeof(block_vertex_t), (void*)0);
 		break;
 	case VERTEX_STANDARD:
-		glBufferData(GL_ARRAY_BUFFER, len * sizeof(vertex_t), start, GL_STATIC_DRAW);
 		glEnableVertexAttribArray(0);
 		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (void*)0);
 		glEnableVertexAttribArray(1);
 		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (void*)(sizeof(float) * 3));
 		break;
 	case VERTEX_POSITION:
-		glBufferData(GL_ARRAY_BUFFER, len * sizeof(float) * 3, start, GL_STATIC_DRAW);
 		glEnableVertexAttribArray(0);
 		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 3, (void*)0);
 		break;
 	case VERTEX_DEBUG:
-		glBufferData(GL_ARRAY_BUFFER, len * sizeof(debug_vertex_t), start, GL_STATIC_DRAW);
 		glEnableVertexAttribArray(0);
 		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(debug_vertex_t), (void*)0);
 		glEnableVertexAttribArray(1);
 		glVertexAttribIPointer(1, 1, GL_UNSIGNED_INT, sizeof(debug_vertex_t), (void*)(sizeof(float) * 3));
 		break;
 	case VERTEX_INTERFACE:
-		glBufferData(GL_ARRAY_BUFFER, len * sizeof(interface_vertex_t), start, GL_STATIC_DRAW);
 		glEnableVertexAttribArray(0);
 		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(interface_vertex_t), (void*)0);
 		glEnableVertexAttribArray(1);
@@ -428,6 +475,19 @@ vertex_buffer_t graphics_buffer_create(const void* start, int len, vertex_type_t
 	default:
 		assert(false);
 	}
+}
+
+vertex_buffer_t graphics_buffer_create(const void* start, int len, vertex_type_t type)
+{
+	struct vertex_buffer* result = mc_malloc(sizeof * result);
+	glGenVertexArrays(1, &result->vao);
+	glGenBuffers(1, &result->vbo);
+	result->size = result->reserved = (GLsizei)len;
+	result->type = type;
+
+	graphics_buffer_bind(result);
+	glBufferData(GL_ARRAY_BUFFER, len * graphics_vertex_size(type), start, GL_STATIC_DRAW);
+	graphics_vertex_layout(type);
 
 	ASSERT_NO_ERROR();
 	return result;
@@ -435,18 +495,7 @@ vertex_buffer_t graphics_buffer_create(const void* start, int len, vertex_type_t
 
 void graphics_buffer_modify(vertex_buffer_t buffer, const void* buf, int len)
 {
-	size_t element_size;
-	switch (buffer->type)
-	{
-	case VERTEX_BLOCK: element_size = sizeof(block_vertex_t); break;
-	case VERTEX_STANDARD: element_size = sizeof(vertex_t); break;
-	case VERTEX_POSITION: element_size = sizeof(float) * 3; break;
-	case VERTEX_DEBUG: element_size = sizeof(debug_vertex_t); break;
-	case VERTEX_INTERFACE: element_size = sizeof(interface_vertex_t); break;
-
-	default:
-		assert(false);
-	}
+	size_t element_size = graphics_vertex_size(buffer->type);
 
 	graphics_buffer_bind(buffer);
 	if (len > buffer->reserved)
@@ -487,6 +536,233 @@ void graphics_buffer_draw(vertex_buffer_t buffer)
 	ASSERT_NO_ERROR();
 }
 
+vertex_arena_t graphics_arena_create(int reserved, vertex_type_t type)
+{
+	struct vertex_arena* result = mc_malloc(sizeof * result);
+	memset(result, 0, sizeof * result);
+	glGenVertexArrays(1, &result->buffer.vao);
+	glGenBuffers(1, &result->buffer.vbo);
+	glGenBuffers(1, &result->command_buffer);
+	glGenBuffers(1, &result->storage_buffer);
+	result->buffer.reserved = (GLsizei)reserved;
+	result->buffer.type = type;
+	result->free_blocks = mc_list_create(sizeof(struct arena_block));
+
+	graphics_buffer_bind(&result->buffer);
+	glBufferData(GL_ARRAY_BUFFER, reserved * graphics_vertex_size(type), NULL, GL_STATIC_DRAW);
+	graphics_vertex_layout(type);
+
+	ASSERT_NO_ERROR();
+	return result;
+}
+
+void graphics_arena_delete(vertex_arena_t* arena)
+{
+	if (*arena == NULL)
+	{
+		return;
+	}
+
+	if (&(*arena)->buffer == current_buffer)
+	{
+		current_buffer = NULL;
+	}
+
+	GLuint buffers[] = { (*arena)->buffer.vbo, (*arena)->command_buffer, (*arena)->storage_buffer };
+	glDeleteBuffers(sizeof buffers / sizeof * buffers, buffers);
+	glDeleteVertexArrays(1, &(*arena)->buffer.vao);
+	mc_list_destroy(&(*arena)->free_blocks);
+	free(*arena);
+	*arena = NULL;
+	ASSERT_NO_ERROR();
+}
+
+/* Doubles the arena's capacity until "size" vertices fit. The old contents are copied GPU-side, nothing is read back. */
+/* Moves buffer into a new vertex buffer object with room for at least "size" elements, keeping its first "keep" elements */
+static void graphics_buffer_grow(struct vertex_buffer* buffer, int size, int keep)
+{
+	GLsizei new_reserved = max(buffer->reserved, 64);
+	while (new_reserved < size)
+	{
+		new_reserved *= 2;
+	}
+
+	size_t element_size = graphics_vertex_size(buffer->type);
+	GLuint next;
+	glGenBuffers(1, &next);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, next);
+	glBufferData(GL_COPY_WRITE_BUFFER, new_reserved * element_size, NULL, GL_STATIC_DRAW);
+	if (keep > 0)
+	{
+		glBindBuffer(GL_COPY_READ_BUFFER, buffer->vbo);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, keep * element_size);
+	}
+	glDeleteBuffers(1, &buffer->vbo);
+
+	buffer->vbo = next;
+	buffer->reserved = new_reserved;
+
+	/* The vertex array still points at the old buffer */
+	if (current_buffer == buffer)
+	{
+		current_buffer = NULL;
+	}
+	graphics_buffer_bind(buffer);
+	graphics_vertex_layout(buffer->type);
+	ASSERT_NO_ERROR();
+}
+
+static void graphics_arena_grow(vertex_arena_t arena, int size)
+{
+	graphics_buffer_grow(&arena->buffer, size, arena->buffer.size);
+}
+
+void graphics_buffer_modify_range(vertex_buffer_t buffer, int first, const void* buf, int len)
+{
+	assert(first >= 0 && first <= buffer->size);
+	if (first + len > buffer->reserved)
+	{
+		graphics_buffer_grow(buffer, first + len, first);
+	}
+
+	graphics_buffer_bind(buffer);
+	glBufferSubData(GL_ARRAY_BUFFER, first * graphics_vertex_size(buffer->type), len * graphics_vertex_size(buffer->type), buf);
+	buffer->size = (GLsizei)(first + len);
+	ASSERT_NO_ERROR();
+}
+
+void graphics_buffer_draw_range(vertex_buffer_t buffer, int first, int count)
+{
+	if (count <= 0)
+	{
+		return;
+	}
+	graphics_buffer_bind(buffer);
+	glDrawArrays(GL_TRIANGLES, first, count);
+	ASSERT_NO_ERROR();
+}
+
+/* Returns the first vertex of a block of "size" vertices, first-fit from the free list, otherwise from the end of the arena */
+static int graphics_arena_alloc(vertex_arena_t arena, int size)
+{
+	struct arena_block* blocks = mc_list_array(arena->free_blocks);
+	for (int i = 0; i < mc_list_count(arena->free_blocks); i++)
+	{
+		if (blocks[i].size < size)
+		{
+			continue;
+		}
+
+		int first = blocks[i].first;
+		blocks[i].first += size;
+		blocks[i].size -= size;
+		if (blocks[i].size == 0)
+		{
+			mc_list_remove(arena->free_blocks, i, NULL, sizeof * blocks);
+		}
+		return first;
+	}
+
+	if (arena->buffer.size + size > arena->buffer.reserved)
+	{
+		graphics_arena_grow(arena, arena->buffer.size + size);
+	}
+	int first = arena->buffer.size;
+	arena->buffer.size += size;
+	return first;
+}
+
+void graphics_arena_free(vertex_arena_t arena, arena_range_t* range)
+{
+	if (range->reserved <= 0)
+	{
+		*range = (arena_range_t){ 0 };
+		return;
+	}
+
+	struct arena_block next = { range->first, range->reserved };
+	*range = (arena_range_t){ 0 };
+
+	struct arena_block* blocks = mc_list_array(arena->free_blocks);
+	int i;
+	for (i = 0; i < mc_list_count(arena->free_blocks) && blocks[i].first < next.first; i++);
+
+	/* Coalesce with the neighboring free blocks */
+	if (i < mc_list_count(arena->free_blocks) && next.first + next.size == blocks[i].first)
+	{
+		next.size += blocks[i].size;
+		mc_list_remove(arena->free_blocks, i, NULL, sizeof next);
+	}
+	if (i > 0 && blocks[i - 1].first + blocks[i - 1].size == next.first)
+	{
+		next.first = blocks[i - 1].first;
+		next.size += blocks[i - 1].size;
+		mc_list_remove(arena->free_blocks, --i, NULL, sizeof next);
+	}
+
+	if (next.first + next.size == arena->buffer.size)
+	{
+		arena->buffer.size = next.first;
+		return;
+	}
+	mc_list_add(arena->free_blocks, i, &next, sizeof next);
+}
+
+void graphics_arena_modify(vertex_arena_t arena, arena_range_t* range, const void* buf, int len)
+{
+	if (len > range->reserved)
+	{
+		graphics_arena_free(arena, range);
+		/* Leave headroom so a mesh that grows by a few faces stays put */
+		range->reserved = len + len / 4;
+		range->first = graphics_arena_alloc(arena, range->reserved);
+	}
+
+	range->count = len;
+	if (len > 0)
+	{
+		size_t element_size = graphics_vertex_size(arena->buffer.type);
+		graphics_buffer_bind(&arena->buffer);
+		glBufferSubData(GL_ARRAY_BUFFER, range->first * element_size, len * element_size, buf);
+		ASSERT_NO_ERROR();
+	}
+}
+
+/* Orphans and refills "buffer" so the upload never waits on last frame's draws */
+static void graphics_arena_stream(GLenum target, GLuint buffer, GLsizeiptr* reserved, const void* data, GLsizeiptr size)
+{
+	*reserved = max(*reserved, size);
+	glBindBuffer(target, buffer);
+	glBufferData(target, *reserved, NULL, GL_STREAM_DRAW);
+	glBufferSubData(target, 0, size, data);
+}
+
+void graphics_arena_commands(vertex_arena_t arena, const draw_command_t* commands, int count, const void* per_draw, size_t per_draw_size)
+{
+	if (count <= 0)
+	{
+		return;
+	}
+
+	graphics_arena_stream(GL_DRAW_INDIRECT_BUFFER, arena->command_buffer, &arena->command_reserved, commands, count * sizeof * commands);
+	graphics_arena_stream(GL_SHADER_STORAGE_BUFFER, arena->storage_buffer, &arena->storage_reserved, per_draw, count * per_draw_size);
+	ASSERT_NO_ERROR();
+}
+
+void graphics_arena_draw(vertex_arena_t arena, int first, int count)
+{
+	if (count <= 0)
+	{
+		return;
+	}
+
+	graphics_buffer_bind(&arena->buffer);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, arena->command_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, arena->storage_buffer);
+	glMultiDrawArraysIndirect(GL_TRIANGLES, (const void*)(first * sizeof(draw_command_t)), count, 0);
+	ASSERT_NO_ERROR();
+}
+
 static bool wireframe_on;
 
 void graphics_debug_set_wireframe_mode(bool mode)
@@ -514,60 +790,67 @@ bool graphics_debug_get_wireframe_mode(void)
 
 void graphics_debug_clear(void)
 {
-	mc_list_splice(primitives, 0, mc_list_count(primitives));
+	platform_mutex_lock(debug_lock);
+	mc_map_clear(primitives);
+	mc_list_splice(debug_vertices, 0, mc_list_count(debug_vertices));
+	expiry_head = expiry_count = 0;
+	debug_dirty = true;
+	platform_mutex_unlock(debug_lock);
 }
 
-static inline int graphics_debug_add_primitive(int length, hash_t hash)
+static void graphics_debug_push_expiry(hash_t hash, double timestamp)
 {
-	for (int i = 0; i < mc_list_count(primitives); i++)
+	if (expiry_count >= expiry_reserved)
 	{
-		struct debug_primitive* curr = MC_LIST_CAST_GET(primitives, i, struct debug_primitive);
-		if (curr->hash == hash)
+		/* Unwrap the ring into a buffer twice as big */
+		struct debug_expiry* next = mc_malloc(sizeof * next * expiry_reserved * 2);
+		for (int i = 0; i < expiry_count; i++)
 		{
-			curr->timestamp = window_time();
-			return curr->start;
+			next[i] = expiry_ring[(expiry_head + i) % expiry_reserved];
 		}
+		free(expiry_ring);
+		expiry_ring = next;
+		expiry_head = 0;
+		expiry_reserved *= 2;
 	}
 
-	int final_end = 0;
-	if (mc_list_count(primitives) > 0)
+	expiry_ring[(expiry_head + expiry_count) % expiry_reserved] = (struct debug_expiry){ hash, timestamp };
+	expiry_count++;
+}
+
+/* Adds primitive made of "length" vertices to the shadow buffer, or refreshes its timestamp if an identical one exists */
+static void graphics_debug_add_primitive(const float* pts, int length)
+{
+	hash_t hash = mc_hash(pts, length * sizeof(float) * 3);
+	double now = window_time();
+
+	platform_mutex_lock(debug_lock);
+	struct debug_primitive* curr = mc_map_get(primitives, hash, NULL, sizeof * curr);
+	if (curr)
 	{
-		struct debug_primitive* final = MC_LIST_CAST_GET(primitives, mc_list_count(primitives) - 1, struct debug_primitive);
-		final_end = final->start + final->size;
+		curr->timestamp = now;
 	}
-	struct debug_primitive next =
-	{
-		.start = final_end,
-		.size = length,
-		.timestamp = window_time(),
-		.hash = hash
-	};
-	mc_list_add(primitives, mc_list_count(primitives), &next, sizeof next);
-
-	if (final_end + length >= debug_buffer.reserved)
+	else
 	{
-		graphics_buffer_bind(&debug_buffer);
-		int old_reserved = debug_buffer.reserved * sizeof(float) * 3;
-		float* data = mc_malloc(old_reserved);
-		glGetBufferSubData(GL_ARRAY_BUFFER, 0, old_reserved, data);
-
-		debug_buffer.reserved *= 2;
-		glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 3 * debug_buffer.reserved, NULL, GL_STATIC_DRAW);
-		glBufferSubData(GL_ARRAY_BUFFER, 0, old_reserved, data);
-		ASSERT_NO_ERROR();
-
-		free(data);
+		struct debug_primitive next =
+		{
+			.start = mc_list_count(debug_vertices),
+			.size = length,
+			.timestamp = now
+		};
+		mc_list_array_add(debug_vertices, next.start, (void*)pts, sizeof(float) * 3, length);
+		mc_map_add(primitives, hash, &next, sizeof next);
+		debug_dirty = true;
 	}
-	return next.start;
+
+	graphics_debug_push_expiry(hash, now);
+	platform_mutex_unlock(debug_lock);
 }
 
 void graphics_debug_set_line(vector3_t begin, vector3_t end)
 {
 	float pts[] = { begin.x, begin.y, begin.z, end.x, end.y, end.z };
-	int buffer_pos = graphics_debug_add_primitive(2, mc_hash(pts, sizeof pts));
-	graphics_buffer_bind(&debug_buffer);
-	glBufferSubData(GL_ARRAY_BUFFER, buffer_pos * sizeof(float) * 3, sizeof pts, pts);
-	ASSERT_NO_ERROR();
+	graphics_debug_add_primitive(pts, 2);
 }
 
 void graphics_primitive_cube(vector3_t pos, vector3_t dim, float out[72])
@@ -607,9 +890,66 @@ void graphics_debug_set_cube(vector3_t pos, vector3_t dim)
 {
 	float pts[72];
 	graphics_primitive_cube(pos, dim, pts);
-	int buffer_pos = graphics_debug_add_primitive(24, mc_hash(pts, sizeof pts));
+	graphics_debug_add_primitive(pts, 24);
+}
+
+static bool graphics_debug_compact_callback(const map_t map, hash_t key, void* value, void* user)
+{
+	struct debug_primitive* curr = value;
+	array_list_t compacted = user;
+	int start = mc_list_count(compacted);
+	mc_list_array_add(compacted, start, (float*)mc_list_array(debug_vertices) + curr->start * 3, sizeof(float) * 3, curr->size);
+	curr->start = start;
+	return true;
+}
+
+/* Drops primitives that were not set within their lifetime, then packs the survivors' vertices together */
+static void graphics_debug_expire(void)
+{
+	double now = window_time();
+	bool removed = false;
+	while (expiry_count > 0 && now - expiry_ring[expiry_head].timestamp > DEBUG_PRIMITIVE_LIFETIME)
+	{
+		struct debug_expiry entry = expiry_ring[expiry_head];
+		expiry_head = (expiry_head + 1) % expiry_reserved;
+		expiry_count--;
+
+		struct debug_primitive* curr = mc_map_get(primitives, entry.hash, NULL, sizeof * curr);
+		if (curr && curr->timestamp == entry.timestamp)
+		{
+			mc_map_remove(primitives, entry.hash, NULL, sizeof * curr);
+			removed = true;
+		}
+	}
+
+	if (removed)
+	{
+		array_list_t compacted = mc_list_create(sizeof(float) * 3);
+		mc_map_iterate(primitives, graphics_debug_compact_callback, compacted);
+		mc_list_destroy(&debug_vertices);
+		debug_vertices = compacted;
+		debug_dirty = true;
+	}
+}
+
+/* Sends the shadow buffer to the GPU in one upload */
+static void graphics_debug_upload(void)
+{
+	if (!debug_dirty)
+	{
+		return;
+	}
+
 	graphics_buffer_bind(&debug_buffer);
-	glBufferSubData(GL_ARRAY_BUFFER, buffer_pos * sizeof(float) * 3, sizeof pts, pts);
+	int count = mc_list_count(debug_vertices);
+	if (count > debug_buffer.reserved)
+	{
+		debug_buffer.reserved = max(count, debug_buffer.reserved * 2);
+		glBufferData(GL_ARRAY_BUFFER, debug_buffer.reserved * sizeof(float) * 3, NULL, GL_STATIC_DRAW);
+	}
+	glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(float) * 3, mc_list_array(debug_vertices));
+	debug_buffer.size = count;
+	debug_dirty = false;
 	ASSERT_NO_ERROR();
 }
 
@@ -647,13 +987,14 @@ void graphics_debug_draw(void)
 	graphics_shader_matrix("camera", view_projection);
 	graphics_shader_matrix("model", transform);
 
-	if (mc_list_count(primitives) > 0)
+	platform_mutex_lock(debug_lock);
+	graphics_debug_expire();
+	graphics_debug_upload();
+	platform_mutex_unlock(debug_lock);
+	if (debug_buffer.size > 0)
 	{
 		graphics_buffer_bind(&debug_buffer);
-		struct debug_primitive* first = MC_LIST_CAST_GET(primitives, 0, struct debug_primitive),
-			* last = MC_LIST_CAST_GET(primitives, mc_list_count(primitives) - 1, struct debug_primitive);
-		int start = first->start, count = last->start + last->size - first->start;
-		glDrawArrays(GL_LINES, start, count);
+		glDrawArrays(GL_LINES, 0, debug_buffer.size);
 		ASSERT_NO_ERROR();
 	}
 	
@@ -671,14 +1012,6 @@ void graphics_debug_draw(void)
 		glDrawArrays(GL_LINES, 0, curr->vertex->size);
 	}
 	mc_list_splice(user_debug_buffers, 0, mc_list_count(user_debug_buffers));
-
-	for (int i = mc_list_count(primitives) - 1; i >= 0; i--)
-	{
-		if (window_time() - MC_LIST_CAST_GET(primitives, i, struct debug_primitive)->timestamp > 3.5F)
-		{
-			mc_list_remove(primitives, i, NULL, 0);
-		}
-	}
 }
 
 void graphics_debug_queue_buffer(debug_buffer_t buffer)
@@ -21,8 +21,9 @@ typedef struct shader* shader_t;
 
 typedef struct vertex_buffer* vertex_buffer_t;
 /* Raw block/chunk vertex data, sent straight to the GPU. First 10 bits are 5-bit position (XZ), Y is next at 9-bit,
-	next 2 bits are X and Y for texture coordinates and the next 8 bits designate which texture ID to use. */
-typedef uint32_t block_vertex_t;
+	next 2 bits are X and Y for texture coordinates, the next 8 bits designate which texture ID to use and the 3 after are the face.
+	The upper 32 bits hold the light in front of the face, 4-bit sky light then 4-bit block light. */
+typedef uint64_t block_vertex_t;
 
 typedef struct vertex
 {
@@ -53,7 +54,8 @@ typedef enum vertex_type
 } vertex_type_t;
 
 #define CREATE_BLOCK_VERTEX_POS(x, y, z)			((x) | ((z) << 5) | ((y) << 10))
-#define SET_BLOCK_VERTEX_TEXTURE(v, tx, ty, tid, i)	((v) | ((tx) << 19) | ((ty) << 20) | ((tid) << 21) | ((i) << 29))
+#define SET_BLOCK_VERTEX_TEXTURE(v, tx, ty, tid, i)	((v) | ((uint32_t)(tx) << 19) | ((uint32_t)(ty) << 20) | ((uint32_t)(tid) << 21) | ((uint32_t)(i) << 29))
+#define SET_BLOCK_VERTEX_LIGHT(v, light)			((v) | ((uint64_t)(light) << 32))
 
 /* Initializes graphics objects and state */
 void graphics_init(void);
@@ -87,6 +89,8 @@ void graphics_shader_use(shader_t shader);
 void graphics_shader_matrix(const char* name, const matrix_t mat4);
 /* Sets a shader's int uniform */
 void graphics_shader_int(const char* name, int i);
+/* Sets a shader's float uniform */
+void graphics_shader_float(const char* name, float f);
 
 /*	Creates vertex buffer. Start and len can both be 0, but if 
 	they aren't they specify the starting values for the buffer.
@@ -94,10 +98,43 @@ void graphics_shader_int(const char* name, int i);
 vertex_buffer_t graphics_buffer_create(const void* start, int len, vertex_type_t type);
 /* Modifies existing vertex buffer. */
 void graphics_buffer_modify(vertex_buffer_t buffer, const void* buf, int len);
+/* Replaces everything from element "first" onward with buf, keeping the elements before it. Grows the buffer if needed. */
+void graphics_buffer_modify_range(vertex_buffer_t buffer, int first, const void* buf, int len);
 /* Deletes the vertex buffer and sets the pointer to NULL */
 void graphics_buffer_delete(vertex_buffer_t* buffer);
 /* Draws vertex buffer w/ GL_TRIANGLES with current shader. */
 void graphics_buffer_draw(vertex_buffer_t buffer);
+/* Draws "count" elements of vertex buffer starting at "first" w/ GL_TRIANGLES with current shader. */
+void graphics_buffer_draw_range(vertex_buffer_t buffer, int first, int count);
+
+/* A vertex arena is one vertex buffer that many meshes are sub-allocated out of, so all of them can be drawn with a single indirect call. */
+typedef struct vertex_arena* vertex_arena_t;
+
+/* A mesh's slice of a vertex arena. Zeroed ranges are empty and own nothing. */
+typedef struct arena_range
+{
+	int first, count, reserved;
+} arena_range_t;
+
+/* Layout glMultiDrawArraysIndirect expects for each command */
+typedef struct draw_command
+{
+	uint32_t count, instance_count, first, base_instance;
+} draw_command_t;
+
+/* Creates a vertex arena with room for "reserved" vertices of type "type." The arena grows on its own when it runs out. */
+vertex_arena_t graphics_arena_create(int reserved, vertex_type_t type);
+/* Deletes the vertex arena and sets the pointer to NULL */
+void graphics_arena_delete(vertex_arena_t* arena);
+/* Replaces the vertices in range with buf. len refers to the count of elements. Moves range elsewhere in the arena if it does not fit. */
+void graphics_arena_modify(vertex_arena_t arena, arena_range_t* range, const void* buf, int len);
+/* Gives range's vertices back to the arena and zeroes range */
+void graphics_arena_free(vertex_arena_t arena, arena_range_t* range);
+/*	Uploads this frame's draw commands and the per-draw data that goes with them. Per-draw data is bound to shader storage buffer 0,
+	and a command's base instance is the index of its element in it. Call once a frame, then draw ranges of the commands w/ graphics_arena_draw. */
+void graphics_arena_commands(vertex_arena_t arena, const draw_command_t* commands, int count, const void* per_draw, size_t per_draw_size);
+/* Draws "count" of the uploaded commands starting at "first" w/ GL_TRIANGLES using one glMultiDrawArraysIndirect. */
+void graphics_arena_draw(vertex_arena_t arena, int first, int count);
 
 #define GRAPHICS_DEBUG_SET_BLOCK(coords) graphics_debug_set_cube(block_coords_to_vector(coords), (vector3_t) { 1.0F, 1.0F, 1.0F })
 #define GRAPHICS_DEBUG_SET_AABB(aabb) graphics_debug_set_cube((aabb).min, aabb_get_dimensions(aabb))
@@ -113,7 +150,7 @@ void graphics_debug_set_wireframe_mode(bool mode);
 /* Gets if wireframe mode is on */
 bool graphics_debug_get_wireframe_mode(void);
 
-/* Clears debug buffer */
+/* Clears debug buffer. Primitives may be cleared and set from any thread, everything else here is the render thread's. */
 void graphics_debug_clear(void);
 /* Sets line to draw from "begin" to "end" */
 void graphics_debug_set_line(vector3_t begin, vector3_t end);
@@ -11,45 +11,86 @@ static shader_t shader;
 static sampler_t atlas;
 static int atlas_width, atlas_height;
 
-static vertex_buffer_t buffer;
-static bool invalidate;
-
 static int width, height;
 
 static int max_hearts;
 static int hearts;
 
-static vertex_buffer_t hotbar_items;
 static bool show_inventory;
 static inventory_t* inventory;
-static hash_t inventory_previous;
+static unsigned int inventory_version;
 
 static rectanglei_t armor_inventory, main_inventory, hotbar_inventory;
+static vector3_t inventory_origin;
 
 static sampler_t items;
 static int items_width, items_height;
 
-static vertex_buffer_t dynamic, dynamic_item;
 static int grabbed_item_index = -1;
 static vector3_t grabbed_item_offset;
+static vector3_t hover_position;
+static pointi_t grabbed_mouse_position;
 
 static bool underwater;
+static int save_progress = -1; /* Percent of the background save written, -1 when none is running */
+
+/* Every widget keeps its vertices around and only rebuilds them when its version moves. Widgets are
+	packed into one buffer in this order, so each run of widgets sharing a sampler is one draw. */
+typedef enum widget_type
+{
+	WIDGET_HOTBAR_ITEMS,	/* Item atlas */
+	WIDGET_INVENTORY_ITEMS,
+	WIDGET_UNDERWATER,
+	WIDGET_HEARTS,			/* Interface atlas */
+	WIDGET_HOTBAR,
+	WIDGET_INVENTORY,
+	WIDGET_HOVER,
+	WIDGET_SAVING,
+	WIDGET_GRABBED,			/* Item atlas, on top of everything */
+	WIDGET_COUNT
+} widget_type_t;
+
+#define WIDGET_BIT(widget) (1U << (widget))
+#define WIDGET_ALL ((1U << WIDGET_COUNT) - 1)
+#define WIDGET_INVENTORY_DEPENDENTS (WIDGET_BIT(WIDGET_HOTBAR_ITEMS) | WIDGET_BIT(WIDGET_INVENTORY_ITEMS) | WIDGET_BIT(WIDGET_HOTBAR) | WIDGET_BIT(WIDGET_GRABBED))
+#define WIDGET_INVENTORY_SCREEN (WIDGET_BIT(WIDGET_INVENTORY_ITEMS) | WIDGET_BIT(WIDGET_INVENTORY) | WIDGET_BIT(WIDGET_HOVER) | WIDGET_BIT(WIDGET_GRABBED))
+
+static struct widget
+{
+	array_list_t vertices;
+	unsigned int version, built_version;
+	int first;	/* Index of the widget's first vertex in batch */
+} widgets[WIDGET_COUNT];
+
+static vertex_buffer_t batch;
+
+static void interface_invalidate(unsigned int mask)
+{
+	for (int i = 0; i < WIDGET_COUNT; i++)
+	{
+		if (mask & WIDGET_BIT(i))
+		{
+			widgets[i].version++;
+		}
+	}
+}
 
 void interface_init(sampler_t item_atlas)
 {
 	shader = graphics_shader_load("assets/shaders/interface_vertex.glsl", "assets/shaders/interface_fragment.glsl");
 	atlas = graphics_sampler_load("assets/interface.bmp");
 
-	buffer = graphics_buffer_create(0, 0, VERTEX_INTERFACE);
-	hotbar_items = graphics_buffer_create(0, 0, VERTEX_INTERFACE);
-	dynamic = graphics_buffer_create(0, 0, VERTEX_INTERFACE);
-	dynamic_item = graphics_buffer_create(0, 0, VERTEX_INTERFACE);
+	batch = graphics_buffer_create(0, 0, VERTEX_INTERFACE);
+	for (int i = 0; i < WIDGET_COUNT; i++)
+	{
+		widgets[i].vertices = mc_list_create(sizeof(interface_vertex_t));
+	}
 
 	atlas_width = graphics_sampler_width(atlas);
 	atlas_height = graphics_sampler_height(atlas);
 
 	max_hearts = PLAYER_HEART_COUNT;
-	invalidate = true;
+	interface_invalidate(WIDGET_ALL);
 
 	items = item_atlas;
 	items_width = graphics_sampler_width(items);
@@ -61,10 +102,11 @@ void interface_destroy(void)
 	graphics_shader_delete(&shader);
 	graphics_sampler_delete(&atlas);
 
-	graphics_buffer_delete(&dynamic_item);
-	graphics_buffer_delete(&dynamic);
-	graphics_buffer_delete(&hotbar_items);
-	graphics_buffer_delete(&buffer);
+	for (int i = 0; i < WIDGET_COUNT; i++)
+	{
+		mc_list_destroy(&widgets[i].vertices);
+	}
+	graphics_buffer_delete(&batch);
 }
 
 static void interface_push_square(array_list_t vertices, int atlas_wx, int atlas_wy, vector3_t pos, color_t color, float wx, float wy, float up, float vp, float ud, float vd)
@@ -171,7 +213,7 @@ static vector3_t interface_create_panel(array_list_t vertices, vector3_t pos, fl
 	return vector3_add(pos, (vector3_t) { UI_SCALE * 4, UI_SCALE * 4 });
 }
 
-static void interface_invalidate_hearts(array_list_t vertices)
+static void interface_build_hearts(array_list_t vertices)
 {
 	int y = height - BAR_HEIGHT - HEART_SIZE - UI_SCALE;
 	int max_hearts_2 = (max_hearts + 1) / 2,
@@ -194,7 +236,7 @@ static void interface_invalidate_hearts(array_list_t vertices)
 	}
 }
 
-static void interface_invalidate_hotbar(array_list_t vertices, array_list_t hotbar_items)
+static void interface_build_hotbar(array_list_t vertices)
 {
 	if (!inventory)
 	{
@@ -204,80 +246,101 @@ static void interface_invalidate_hotbar(array_list_t vertices, array_list_t hotb
 	interface_push_ui_square(vertices, (vector3_t) { width / 2 - BAR_WIDTH / 2, height - BAR_HEIGHT, 0.9F }, BAR_WIDTH, BAR_HEIGHT, 0, 9, REAL_BAR_WIDTH, REAL_BAR_HEIGHT);
 	interface_push_ui_square(vertices, (vector3_t) { width / 2 - BAR_WIDTH / 2 + inventory->active_slot * (BAR_WIDTH / 9) - UI_SCALE, height - BAR_HEIGHT - UI_SCALE, 0.8F },
 		CURRENT_WIDTH, CURRENT_HEIGHT, 182, 0, REAL_CURRENT_WIDTH, REAL_CURRENT_HEIGHT);
-	
+}
+
+static void interface_build_hotbar_items(array_list_t vertices)
+{
+	if (!inventory)
+	{
+		return;
+	}
+
 	for (int i = 0; i < 9; i++)
 	{
 		block_type_t type = inventory->items[i];
 		if (type != BLOCK_AIR)
 		{
 			type--; /* because of BLOCK_AIR not being in atlas */
-			interface_push_item_square(hotbar_items, (vector3_t) { width / 2 - BAR_WIDTH / 2 + 3 * UI_SCALE + i * (20 * UI_SCALE), height - BAR_HEIGHT + 3 * UI_SCALE, 0.7F },
+			interface_push_item_square(vertices, (vector3_t) { width / 2 - BAR_WIDTH / 2 + 3 * UI_SCALE + i * (20 * UI_SCALE), height - BAR_HEIGHT + 3 * UI_SCALE, 0.7F },
 				16 * UI_SCALE, 16 * UI_SCALE, type * 16, 0, 16, 16);
 		}
 	}
+}
 
-	if (show_inventory)
-	{
-		/* background color */
-		interface_push_ui_square(vertices, (vector3_t) { 0, 0, 0.0F }, width, height, 0, 44, 1, 1);
-		
-		vector3_t origin = interface_create_panel(vertices, (vector3_t) { width / 2 - INVENTORY_WIDTH / 2, height / 2 - INVENTORY_HEIGHT / 2, -0.1F }, INVENTORY_WIDTH, INVENTORY_HEIGHT);
-		vector3_t armor = (vector3_t){ origin.x + UI_SCALE * 3, origin.y + UI_SCALE * 3, -0.2F };
-
-		armor_inventory.x = armor.x;
-		armor_inventory.y = armor.y;
-		armor_inventory.wx = SLOT_WIDTH;
-		armor_inventory.wy = SLOT_HEIGHT * 4;
+/* Places the inventory panel and its slot regions for the current window size */
+static void interface_layout_inventory(void)
+{
+	inventory_origin = (vector3_t){ width / 2 - INVENTORY_WIDTH / 2 + UI_SCALE * 4, height / 2 - INVENTORY_HEIGHT / 2 + UI_SCALE * 4 };
+
+	armor_inventory.x = inventory_origin.x + UI_SCALE * 3;
+	armor_inventory.y = inventory_origin.y + UI_SCALE * 3;
+	armor_inventory.wx = SLOT_WIDTH;
+	armor_inventory.wy = SLOT_HEIGHT * 4;
+
+	main_inventory.x = inventory_origin.x + UI_SCALE * 3;
+	main_inventory.y = inventory_origin.y + UI_SCALE * 78;
+	main_inventory.wx = SLOT_WIDTH * 9;
+	main_inventory.wy = SLOT_HEIGHT * 3;
+
+	hotbar_inventory.x = main_inventory.x;
+	hotbar_inventory.y = main_inventory.y + main_inventory.wy + UI_SCALE * 3;
+	hotbar_inventory.wx = SLOT_WIDTH * 9;
+	hotbar_inventory.wy = SLOT_HEIGHT;
+}
 
-		for (int i = 0; i < 4; i++)
-		{
-			interface_push_ui_square(vertices, armor, SLOT_WIDTH, SLOT_HEIGHT, 188, 23, REAL_SLOT_WIDTH, REAL_SLOT_HEIGHT);
-			interface_push_ui_square(vertices, vector3_add(armor, (vector3_t) { UI_SCALE, UI_SCALE, -0.1F }), 16 * UI_SCALE, 16 * UI_SCALE, 16 + 16 * i, 31, 16, 16);
-			armor.y += SLOT_HEIGHT;
-		}
+static void interface_build_inventory(array_list_t vertices)
+{
+	if (!inventory || !show_inventory)
+	{
+		return;
+	}
 
-		vector3_t inv = (vector3_t){ origin.x + UI_SCALE * 3, origin.y + UI_SCALE * 78, -0.2F };
+	/* background color */
+	interface_push_ui_square(vertices, (vector3_t) { 0, 0, 0.0F }, width, height, 0, 44, 1, 1);
+	interface_create_panel(vertices, (vector3_t) { width / 2 - INVENTORY_WIDTH / 2, height / 2 - INVENTORY_HEIGHT / 2, -0.1F }, INVENTORY_WIDTH, INVENTORY_HEIGHT);
 
-		main_inventory.x = inv.x;
-		main_inventory.y = inv.y;
-		main_inventory.wx = SLOT_WIDTH * 9;
-		main_inventory.wy = SLOT_HEIGHT * 3;
+	vector3_t armor = (vector3_t){ armor_inventory.x, armor_inventory.y, -0.2F };
+	for (int i = 0; i < 4; i++)
+	{
+		interface_push_ui_square(vertices, armor, SLOT_WIDTH, SLOT_HEIGHT, 188, 23, REAL_SLOT_WIDTH, REAL_SLOT_HEIGHT);
+		interface_push_ui_square(vertices, vector3_add(armor, (vector3_t) { UI_SCALE, UI_SCALE, -0.1F }), 16 * UI_SCALE, 16 * UI_SCALE, 16 + 16 * i, 31, 16, 16);
+		armor.y += SLOT_HEIGHT;
+	}
 
-		for (int i = 0; i < 3; i++)
+	for (int i = 0; i < 4; i++)
+	{
+		rectanglei_t region = i < 3 ? main_inventory : hotbar_inventory;
+		vector3_t slot = { region.x, i < 3 ? region.y + i * SLOT_HEIGHT : region.y, -0.2F };
+		for (int j = 0; j < 9; j++)
 		{
-			for (int j = 0; j < 9; j++)
-			{
-				block_type_t item = inventory->items[(i + 1) * 9 + j];
-				if (item != BLOCK_AIR && 9 + i * 9 + j != grabbed_item_index)
-				{
-					item--;
-					interface_push_item_square(hotbar_items, vector3_add(inv, (vector3_t) { UI_SCALE, UI_SCALE, -0.2F }), 16 * UI_SCALE, 16 * UI_SCALE, item * 16, 0, 16, 16);
-				}
-				interface_push_ui_square(vertices, inv, SLOT_WIDTH, SLOT_HEIGHT, 188, 23, REAL_SLOT_WIDTH, REAL_SLOT_HEIGHT);
-				inv.x += SLOT_WIDTH;
-			}
-			inv.x = (float)main_inventory.x;
-			inv.y += SLOT_HEIGHT;
+			interface_push_ui_square(vertices, slot, SLOT_WIDTH, SLOT_HEIGHT, 188, 23, REAL_SLOT_WIDTH, REAL_SLOT_HEIGHT);
+			slot.x += SLOT_WIDTH;
 		}
+	}
+}
 
-		inv.x = origin.x + UI_SCALE * 3;
-		inv.y += UI_SCALE * 3;
-
-		hotbar_inventory.x = inv.x;
-		hotbar_inventory.y = inv.y;
-		hotbar_inventory.wx = SLOT_WIDTH * 9;
-		hotbar_inventory.wy = SLOT_HEIGHT;
+static void interface_build_inventory_items(array_list_t vertices)
+{
+	if (!inventory || !show_inventory)
+	{
+		return;
+	}
 
-		for (int i = 0; i < 9; i++)
+	/* Rows 0 to 2 are the main inventory, row 3 is the hotbar */
+	for (int i = 0; i < 4; i++)
+	{
+		rectanglei_t region = i < 3 ? main_inventory : hotbar_inventory;
+		vector3_t slot = { region.x + UI_SCALE, (i < 3 ? region.y + i * SLOT_HEIGHT : region.y) + UI_SCALE, -0.4F };
+		for (int j = 0; j < 9; j++)
 		{
-			block_type_t item = inventory->items[i];
-			if (item != BLOCK_AIR && i != grabbed_item_index)
+			int index = i < 3 ? (i + 1) * 9 + j : j;
+			block_type_t item = inventory->items[index];
+			if (item != BLOCK_AIR && index != grabbed_item_index)
 			{
 				item--;
-				interface_push_item_square(hotbar_items, vector3_add(inv, (vector3_t) { UI_SCALE, UI_SCALE, -0.2F }), 16 * UI_SCALE, 16 * UI_SCALE, item * 16, 0, 16, 16);
+				interface_push_item_square(vertices, slot, 16 * UI_SCALE, 16 * UI_SCALE, item * 16, 0, 16, 16);
 			}
-			interface_push_ui_square(vertices, inv, SLOT_WIDTH, SLOT_HEIGHT, 188, 23, REAL_SLOT_WIDTH, REAL_SLOT_HEIGHT);
-			inv.x += SLOT_WIDTH;
+			slot.x += SLOT_WIDTH;
 		}
 	}
 }
@@ -298,95 +361,173 @@ static inline vector3_t interface_inventory_check_region(rectanglei_t region, po
 	return pos;
 }
 
-static void interface_inventory_do_dynamic(array_list_t vertices, array_list_t items_vertices)
+static void interface_build_hover(array_list_t vertices)
 {
-	pointi_t mouse_pos = window_mouse_position();
-	vector3_t pos = { 0 };
-
-	pos = vector3_add(pos, interface_inventory_check_region(main_inventory, mouse_pos));
-	pos = vector3_add(pos, interface_inventory_check_region(hotbar_inventory, mouse_pos));
-	pos = vector3_add(pos, interface_inventory_check_region(armor_inventory, mouse_pos));
-
-	if (pos.z != 0.0F)
+	if (show_inventory && hover_position.z != 0.0F)
 	{
-		interface_push_ui_square(vertices, pos, SLOT_WIDTH, SLOT_HEIGHT, 1, 44, 1, 1);
+		interface_push_ui_square(vertices, hover_position, SLOT_WIDTH, SLOT_HEIGHT, 1, 44, 1, 1);
 	}
+}
 
-	if (grabbed_item_index != -1)
+static void interface_build_grabbed(array_list_t vertices)
+{
+	if (show_inventory && grabbed_item_index != -1 && inventory->items[grabbed_item_index] != BLOCK_AIR)
 	{
 		block_type_t item = inventory->items[grabbed_item_index] - 1;
-		vector3_t mouse_pos_v3 = { mouse_pos.x, mouse_pos.y, -0.95F };
-		interface_push_item_square(items_vertices, vector3_sub(mouse_pos_v3, grabbed_item_offset), 16 * UI_SCALE, 16 * UI_SCALE, item * 16, 0, 16, 16);
+		vector3_t mouse_pos_v3 = { grabbed_mouse_position.x, grabbed_mouse_position.y, -0.95F };
+		interface_push_item_square(vertices, vector3_sub(mouse_pos_v3, grabbed_item_offset), 16 * UI_SCALE, 16 * UI_SCALE, item * 16, 0, 16, 16);
 	}
 }
 
-void interface_render(void)
+static void interface_build_underwater(array_list_t vertices)
 {
-	graphics_clear_depth();
+	if (underwater)
+	{
+		interface_push_item_square_color(vertices, (vector3_t) { 0, 0, 0.95F }, COLORA_CREATE(255, 255, 255, 100), width, height, BLOCK_WATER * 16 - 16, 0, 16, 16);
+	}
+}
 
-	graphics_shader_use(shader);
+#define SAVE_BAR_WIDTH	(60 * UI_SCALE)
+#define SAVE_BAR_HEIGHT	(2 * UI_SCALE)
 
-	pointi_t dimensions = window_get_dimensions();
-	if (width != dimensions.x)
+static void interface_build_saving(array_list_t vertices)
+{
+	if (save_progress < 0)
 	{
-		width = dimensions.x;
-		graphics_shader_int("width", width);
-		invalidate = true;
+		return;
 	}
-	if (height != dimensions.y)
+
+	vector3_t pos = { width - SAVE_BAR_WIDTH - UI_SCALE * 4, UI_SCALE * 4, 0.6F };
+	interface_push_ui_square(vertices, pos, SAVE_BAR_WIDTH, SAVE_BAR_HEIGHT, 0, 44, 1, 1);
+	interface_push_ui_square(vertices, vector3_add(pos, (vector3_t) { 0, 0, -0.1F }), (float)(SAVE_BAR_WIDTH * save_progress / 100), SAVE_BAR_HEIGHT, 1, 44, 1, 1);
+}
+
+static void interface_build_widget(widget_type_t widget, array_list_t vertices)
+{
+	switch (widget)
 	{
-		height = dimensions.y;
-		graphics_shader_int("height", height);
-		invalidate = true;
+	case WIDGET_HOTBAR_ITEMS:		interface_build_hotbar_items(vertices); break;
+	case WIDGET_INVENTORY_ITEMS:	interface_build_inventory_items(vertices); break;
+	case WIDGET_UNDERWATER:			interface_build_underwater(vertices); break;
+	case WIDGET_HEARTS:				interface_build_hearts(vertices); break;
+	case WIDGET_HOTBAR:				interface_build_hotbar(vertices); break;
+	case WIDGET_INVENTORY:			interface_build_inventory(vertices); break;
+	case WIDGET_HOVER:				interface_build_hover(vertices); break;
+	case WIDGET_SAVING:				interface_build_saving(vertices); break;
+	case WIDGET_GRABBED:			interface_build_grabbed(vertices); break;
+	default:
+		assert(false);
 	}
+}
 
-	hash_t inventory_hash = mc_hash(inventory, sizeof * inventory);
-	invalidate |= inventory_hash != inventory_previous;
-	inventory_hash = inventory_previous;
+/* Picks up state the interface is not told about directly: the inventory's contents and the mouse */
+static void interface_poll(void)
+{
+	if (inventory && inventory->version != inventory_version)
+	{
+		inventory_version = inventory->version;
+		interface_invalidate(WIDGET_INVENTORY_DEPENDENTS);
+	}
 
-	if (invalidate)
+	if (!show_inventory)
 	{
-		array_list_t vertices = mc_list_create(sizeof(interface_vertex_t));
-		array_list_t hotbar_items_vertices = mc_list_create(sizeof(interface_vertex_t));
+		return;
+	}
 
-		interface_invalidate_hearts(vertices);
-		interface_invalidate_hotbar(vertices, hotbar_items_vertices);
-		if (underwater)
+	pointi_t mouse_pos = window_mouse_position();
+	vector3_t hover = { 0 };
+	hover = vector3_add(hover, interface_inventory_check_region(main_inventory, mouse_pos));
+	hover = vector3_add(hover, interface_inventory_check_region(hotbar_inventory, mouse_pos));
+	hover = vector3_add(hover, interface_inventory_check_region(armor_inventory, mouse_pos));
+	if (hover.x != hover_position.x || hover.y != hover_position.y || hover.z != hover_position.z)
+	{
+		hover_position = hover;
+		interface_invalidate(WIDGET_BIT(WIDGET_HOVER));
+	}
+
+	if (mouse_pos.x != grabbed_mouse_position.x || mouse_pos.y != grabbed_mouse_position.y)
+	{
+		grabbed_mouse_position = mouse_pos;
+		if (grabbed_item_index != -1)
 		{
-			interface_push_item_square_color(hotbar_items_vertices, (vector3_t) { 0, 0, 0.95F }, COLORA_CREATE(255, 255, 255, 100), width, height, BLOCK_WATER * 16 - 16, 0, 16, 16);
+			interface_invalidate(WIDGET_BIT(WIDGET_GRABBED));
 		}
+	}
+}
 
-		graphics_buffer_modify(buffer, mc_list_array(vertices), mc_list_count(vertices));
-		graphics_buffer_modify(hotbar_items, mc_list_array(hotbar_items_vertices), mc_list_count(hotbar_items_vertices));
+static inline int interface_widget_count(widget_type_t widget)
+{
+	return mc_list_count(widgets[widget].vertices);
+}
 
-		mc_list_destroy(&vertices);
-		mc_list_destroy(&hotbar_items_vertices);
-		invalidate = false;
+/* Draws widgets "first" to "last" inclusive, which are next to each other in batch */
+static inline void interface_draw_widgets(widget_type_t first, widget_type_t last)
+{
+	int count = widgets[last].first + interface_widget_count(last) - widgets[first].first;
+	graphics_buffer_draw_range(batch, widgets[first].first, count);
+}
+
+void interface_prepare(void)
+{
+	graphics_shader_use(shader);
+
+	pointi_t dimensions = window_get_dimensions();
+	if (width != dimensions.x || height != dimensions.y)
+	{
+		if (width != dimensions.x)
+		{
+			width = dimensions.x;
+			graphics_shader_int("width", width);
+		}
+		if (height != dimensions.y)
+		{
+			height = dimensions.y;
+			graphics_shader_int("height", height);
+		}
+		interface_layout_inventory();
+		interface_invalidate(WIDGET_ALL);
 	}
 
-	graphics_sampler_use(items);
-	graphics_buffer_draw(hotbar_items);
+	interface_poll();
 
-	graphics_sampler_use(atlas);
-	graphics_buffer_draw(buffer);
+	/* Everything before the first rebuilt widget is already in place, so only the tail is uploaded */
+	int first_dirty = WIDGET_COUNT;
+	for (int i = 0; i < WIDGET_COUNT; i++)
+	{
+		struct widget* curr = &widgets[i];
+		if (curr->version == curr->built_version)
+		{
+			continue;
+		}
+		mc_list_splice(curr->vertices, 0, mc_list_count(curr->vertices));
+		interface_build_widget(i, curr->vertices);
+		curr->built_version = curr->version;
+		first_dirty = min(first_dirty, i);
+	}
 
-	if (show_inventory)
+	for (int i = first_dirty; i < WIDGET_COUNT; i++)
 	{
-		array_list_t vertices = mc_list_create(sizeof(interface_vertex_t));
-		array_list_t items_vertices = mc_list_create(sizeof(interface_vertex_t));
+		widgets[i].first = i > 0 ? widgets[i - 1].first + interface_widget_count(i - 1) : 0;
+		if (interface_widget_count(i) > 0)
+		{
+			graphics_buffer_modify_range(batch, widgets[i].first, mc_list_array(widgets[i].vertices), interface_widget_count(i));
+		}
+	}
+}
 
-		interface_inventory_do_dynamic(vertices, items_vertices);
+void interface_render(void)
+{
+	graphics_clear_depth();
 
-		graphics_buffer_modify(dynamic, mc_list_array(vertices), mc_list_count(vertices));
-		graphics_buffer_modify(dynamic_item, mc_list_array(items_vertices), mc_list_count(items_vertices));
+	graphics_shader_use(shader);
+	graphics_sampler_use(items);
+	interface_draw_widgets(WIDGET_HOTBAR_ITEMS, WIDGET_UNDERWATER);
 
-		mc_list_destroy(&vertices);
-		mc_list_destroy(&items_vertices);
+	graphics_sampler_use(atlas);
+	interface_draw_widgets(WIDGET_HEARTS, WIDGET_SAVING);
 
-		graphics_buffer_draw(dynamic);
-		graphics_sampler_use(items);
-		graphics_buffer_draw(dynamic_item);
-	}
+	graphics_sampler_use(items);
+	interface_draw_widgets(WIDGET_GRABBED, WIDGET_GRABBED);
 }
 
 void interface_update(void)
@@ -431,11 +572,13 @@ void interface_update(void)
 			
 			if (slot != -1)
 			{
+				interface_invalidate(WIDGET_BIT(WIDGET_INVENTORY_ITEMS) | WIDGET_BIT(WIDGET_GRABBED));
 				block_type_t item = inventory->items[slot];
 				if (item == BLOCK_AIR && grabbed_item_index != -1)
 				{
 					inventory->items[slot] = inventory->items[grabbed_item_index];
 					inventory->items[grabbed_item_index] = BLOCK_AIR;
+					inventory->version++;
 					grabbed_item_index = -1;
 				}
 				else if (item != BLOCK_AIR)
@@ -450,6 +593,7 @@ void interface_update(void)
 						block_type_t temp = inventory->items[grabbed_item_index];
 						inventory->items[grabbed_item_index] = item;
 						inventory->items[slot] = temp;
+						inventory->version++;
 						grabbed_item_offset = offset;
 						return;
 					}
@@ -477,7 +621,7 @@ void interface_set_max_hearts(int hearts)
 		return;
 	}
 	max_hearts = hearts;
-	invalidate = true;
+	interface_invalidate(WIDGET_BIT(WIDGET_HEARTS));
 }
 
 void interface_set_current_hearts(int _hearts)
@@ -487,7 +631,7 @@ void interface_set_current_hearts(int _hearts)
 		return;
 	}
 	hearts = _hearts;
-	invalidate = true;
+	interface_invalidate(WIDGET_BIT(WIDGET_HEARTS));
 }
 
 bool interface_is_inventory_open(void)
@@ -503,7 +647,7 @@ void interface_set_inventory_state(bool state)
 	}
 	grabbed_item_index = -1;
 	show_inventory = state;
-	invalidate = true;
+	interface_invalidate(WIDGET_INVENTORY_SCREEN);
 }
 
 void interface_set_inventory(inventory_t* _inventory)
@@ -514,7 +658,8 @@ void interface_set_inventory(inventory_t* _inventory)
 	}
 	grabbed_item_index = -1;
 	inventory = _inventory;
-	invalidate = true;
+	inventory_version = inventory ? inventory->version : 0;
+	interface_invalidate(WIDGET_INVENTORY_DEPENDENTS | WIDGET_INVENTORY_SCREEN);
 }
 
 bool interface_is_underwater(void)
@@ -529,5 +674,16 @@ void interface_set_underwater_state(bool state)
 		return;
 	}
 	underwater = state;
-	invalidate = true;
+	interface_invalidate(WIDGET_BIT(WIDGET_UNDERWATER));
+}
+
+void interface_set_save_progress(float progress)
+{
+	int percent = progress < 0.0F ? -1 : (int)(min(progress, 1.0F) * 100.0F);
+	if (save_progress == percent)
+	{
+		return;
+	}
+	save_progress = percent;
+	interface_invalidate(WIDGET_BIT(WIDGET_SAVING));
 }
\ No newline at end of file
@@ -24,6 +24,8 @@ void interface_init(sampler_t item_atlas);
 /* Destroys objects used by user interface */
 void interface_destroy(void);
 
+/* Rebuilds and uploads widgets that changed. Reads game state, so call it while the simulation is not ticking. interface_render draws what it uploaded. */
+void interface_prepare(void);
 void interface_render(void);
 void interface_update(void);
 
@@ -46,4 +48,7 @@ void interface_set_inventory(inventory_t* inventory);
 /* Gets if the interface is currently rendering an underwater overlay */
 bool interface_is_underwater(void);
 /* Sets underwater overlay visiblity state, true for being underwater, false for no overlay */
-void interface_set_underwater_state(bool state);
\ No newline at end of file
+void interface_set_underwater_state(bool state);
+
+/* Sets how far along the background save is, from 0 to 1. Negative hides the save bar. */
+void interface_set_save_progress(float progress);
\ No newline at end of file
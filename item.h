@@ -33,5 +33,6 @@ typedef uint8_t block_type_t;
 typedef struct inventory
 {
 	int active_slot;
+	unsigned int version;	/* Bumped whenever active_slot or items change, so anything showing the inventory knows to rebuild */
 	block_type_t items[45]; /* First 9 elements are hotbar, then the next 27 are from top to bottom the inventory. Next 4 are for armor, last 5 are for crafting grid */
 } inventory_t;
\ No newline at end of file
@@ -0,0 +1,455 @@
+/*
+	platform.c ~ RL
+	Thin wrappers over the operating system's threading primitives
+*/
+
+#include "platform.h"
+#include "util.h"
+
+struct file_map
+{
+	const uint8_t* data;
+	size_t size;
+};
+
+const uint8_t* platform_file_map_data(file_map_t map)
+{
+	return map->data;
+}
+
+size_t platform_file_map_size(file_map_t map)
+{
+	return map->size;
+}
+
+static bool platform_has_extension(const char* name, const char* extension)
+{
+	size_t name_length = strlen(name), extension_length = strlen(extension);
+	return name_length >= extension_length && strcmp(name + name_length - extension_length, extension) == 0;
+}
+
+#ifdef _WIN32
+
+#include <io.h>
+#include <Windows.h>
+
+struct thread
+{
+	HANDLE handle;
+	thread_func_t func;
+	void* user;
+};
+
+struct mutex
+{
+	CRITICAL_SECTION section;
+};
+
+struct cond
+{
+	CONDITION_VARIABLE variable;
+};
+
+static DWORD WINAPI platform_thread_entry(void* param)
+{
+	struct thread* thread = param;
+	thread->func(thread->user);
+	return 0;
+}
+
+thread_t platform_thread_create(thread_func_t func, void* user)
+{
+	struct thread* result = mc_malloc(sizeof * result);
+	result->func = func;
+	result->user = user;
+	result->handle = CreateThread(NULL, 0, platform_thread_entry, result, 0, NULL);
+	mc_panic_if(!result->handle, "Failed to create thread");
+	return result;
+}
+
+void platform_thread_join(thread_t* thread)
+{
+	if (!*thread)
+	{
+		return;
+	}
+	WaitForSingleObject((*thread)->handle, INFINITE);
+	CloseHandle((*thread)->handle);
+	free(*thread);
+	*thread = NULL;
+}
+
+mutex_t platform_mutex_create(void)
+{
+	struct mutex* result = mc_malloc(sizeof * result);
+	InitializeCriticalSection(&result->section);
+	return result;
+}
+
+void platform_mutex_delete(mutex_t* mutex)
+{
+	if (!*mutex)
+	{
+		return;
+	}
+	DeleteCriticalSection(&(*mutex)->section);
+	free(*mutex);
+	*mutex = NULL;
+}
+
+void platform_mutex_lock(mutex_t mutex)
+{
+	EnterCriticalSection(&mutex->section);
+}
+
+bool platform_mutex_try_lock(mutex_t mutex)
+{
+	return TryEnterCriticalSection(&mutex->section);
+}
+
+void platform_mutex_unlock(mutex_t mutex)
+{
+	LeaveCriticalSection(&mutex->section);
+}
+
+cond_t platform_cond_create(void)
+{
+	struct cond* result = mc_malloc(sizeof * result);
+	InitializeConditionVariable(&result->variable);
+	return result;
+}
+
+void platform_cond_delete(cond_t* cond)
+{
+	/* Win32 condition variables own no resources */
+	free(*cond);
+	*cond = NULL;
+}
+
+void platform_cond_wait(cond_t cond, mutex_t mutex)
+{
+	SleepConditionVariableCS(&cond->variable, &mutex->section, INFINITE);
+}
+
+void platform_cond_signal(cond_t cond)
+{
+	WakeConditionVariable(&cond->variable);
+}
+
+void platform_cond_broadcast(cond_t cond)
+{
+	WakeAllConditionVariable(&cond->variable);
+}
+
+file_map_t platform_file_map(const char* path)
+{
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return NULL;
+	}
+
+	LARGE_INTEGER size;
+	HANDLE mapping = NULL;
+	const uint8_t* data = NULL;
+	if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+	{
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	}
+	if (mapping)
+	{
+		data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		/* The view keeps the mapping alive */
+		CloseHandle(mapping);
+	}
+	CloseHandle(file);
+	if (!data)
+	{
+		return NULL;
+	}
+
+	struct file_map* result = mc_malloc(sizeof * result);
+	result->data = data;
+	result->size = (size_t)size.QuadPart;
+	return result;
+}
+
+void platform_file_unmap(file_map_t* map)
+{
+	if (!*map)
+	{
+		return;
+	}
+	UnmapViewOfFile((*map)->data);
+	free(*map);
+	*map = NULL;
+}
+
+void platform_file_sync(FILE* file)
+{
+	fflush(file);
+	_commit(_fileno(file));
+}
+
+bool platform_file_replace(const char* from, const char* to)
+{
+	return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+}
+
+bool platform_directory_create(const char* path)
+{
+	return CreateDirectoryA(path, NULL) || GetLastError() == ERROR_ALREADY_EXISTS;
+}
+
+void platform_directory_list(const char* directory, const char* extension, file_list_func_t func, void* user)
+{
+	char pattern[MAX_PATH];
+	if (snprintf(pattern, sizeof pattern, "%s/*%s", directory, extension) >= (int)sizeof pattern)
+	{
+		return;
+	}
+
+	WIN32_FIND_DATAA found;
+	HANDLE search = FindFirstFileA(pattern, &found);
+	if (search == INVALID_HANDLE_VALUE)
+	{
+		return;
+	}
+	do
+	{
+		/* Wildcards also match short 8.3 names, so longer extensions can slip through */
+		if (!(found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && platform_has_extension(found.cFileName, extension))
+		{
+			func(found.cFileName, user);
+		}
+	} while (FindNextFileA(search, &found));
+	FindClose(search);
+}
+
+bool platform_file_delete(const char* path)
+{
+	return DeleteFileA(path) || GetLastError() == ERROR_FILE_NOT_FOUND;
+}
+
+void platform_sleep(int milliseconds)
+{
+	Sleep(milliseconds);
+}
+
+int platform_cpu_count(void)
+{
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return max((int)info.dwNumberOfProcessors, 1);
+}
+
+#else
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+struct thread
+{
+	pthread_t handle;
+	thread_func_t func;
+	void* user;
+};
+
+struct mutex
+{
+	pthread_mutex_t handle;
+};
+
+struct cond
+{
+	pthread_cond_t handle;
+};
+
+static void* platform_thread_entry(void* param)
+{
+	struct thread* thread = param;
+	thread->func(thread->user);
+	return NULL;
+}
+
+thread_t platform_thread_create(thread_func_t func, void* user)
+{
+	struct thread* result = mc_malloc(sizeof * result);
+	result->func = func;
+	result->user = user;
+	mc_panic_if(pthread_create(&result->handle, NULL, platform_thread_entry, result) != 0, "Failed to create thread");
+	return result;
+}
+
+void platform_thread_join(thread_t* thread)
+{
+	if (!*thread)
+	{
+		return;
+	}
+	pthread_join((*thread)->handle, NULL);
+	free(*thread);
+	*thread = NULL;
+}
+
+mutex_t platform_mutex_create(void)
+{
+	struct mutex* result = mc_malloc(sizeof * result);
+	pthread_mutex_init(&result->handle, NULL);
+	return result;
+}
+
+void platform_mutex_delete(mutex_t* mutex)
+{
+	if (!*mutex)
+	{
+		return;
+	}
+	pthread_mutex_destroy(&(*mutex)->handle);
+	free(*mutex);
+	*mutex = NULL;
+}
+
+void platform_mutex_lock(mutex_t mutex)
+{
+	pthread_mutex_lock(&mutex->handle);
+}
+
+bool platform_mutex_try_lock(mutex_t mutex)
+{
+	return pthread_mutex_trylock(&mutex->handle) == 0;
+}
+
+void platform_mutex_unlock(mutex_t mutex)
+{
+	pthread_mutex_unlock(&mutex->handle);
+}
+
+cond_t platform_cond_create(void)
+{
+	struct cond* result = mc_malloc(sizeof * result);
+	pthread_cond_init(&result->handle, NULL);
+	return result;
+}
+
+void platform_cond_delete(cond_t* cond)
+{
+	if (!*cond)
+	{
+		return;
+	}
+	pthread_cond_destroy(&(*cond)->handle);
+	free(*cond);
+	*cond = NULL;
+}
+
+void platform_cond_wait(cond_t cond, mutex_t mutex)
+{
+	pthread_cond_wait(&cond->handle, &mutex->handle);
+}
+
+void platform_cond_signal(cond_t cond)
+{
+	pthread_cond_signal(&cond->handle);
+}
+
+void platform_cond_broadcast(cond_t cond)
+{
+	pthread_cond_broadcast(&cond->handle);
+}
+
+file_map_t platform_file_map(const char* path)
+{
+	int file = open(path, O_RDONLY);
+	if (file < 0)
+	{
+		return NULL;
+	}
+
+	struct stat info;
+	void* data = MAP_FAILED;
+	if (fstat(file, &info) == 0 && info.st_size > 0)
+	{
+		data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED, file, 0);
+	}
+	/* The mapping keeps the file alive */
+	close(file);
+	if (data == MAP_FAILED)
+	{
+		return NULL;
+	}
+
+	struct file_map* result = mc_malloc(sizeof * result);
+	result->data = data;
+	result->size = (size_t)info.st_size;
+	return result;
+}
+
+void platform_file_unmap(file_map_t* map)
+{
+	if (!*map)
+	{
+		return;
+	}
+	munmap((void*)(*map)->data, (*map)->size);
+	free(*map);
+	*map = NULL;
+}
+
+void platform_file_sync(FILE* file)
+{
+	fflush(file);
+	fsync(fileno(file));
+}
+
+bool platform_file_replace(const char* from, const char* to)
+{
+	return rename(from, to) == 0;
+}
+
+bool platform_directory_create(const char* path)
+{
+	return mkdir(path, 0755) == 0 || errno == EEXIST;
+}
+
+void platform_directory_list(const char* directory, const char* extension, file_list_func_t func, void* user)
+{
+	DIR* search = opendir(directory);
+	if (!search)
+	{
+		return;
+	}
+	for (struct dirent* found = readdir(search); found; found = readdir(search))
+	{
+		if (platform_has_extension(found->d_name, extension))
+		{
+			func(found->d_name, user);
+		}
+	}
+	closedir(search);
+}
+
+bool platform_file_delete(const char* path)
+{
+	return unlink(path) == 0 || errno == ENOENT;
+}
+
+void platform_sleep(int milliseconds)
+{
+	struct timespec duration = { milliseconds / 1000, (milliseconds % 1000) * 1000000L };
+	nanosleep(&duration, NULL);
+}
+
+int platform_cpu_count(void)
+{
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (int)count : 1;
+}
+
+#endif
\ No newline at end of file
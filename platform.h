@@ -0,0 +1,73 @@
+/*
+	platform.h ~ RL
+	Thin wrappers over the operating system's threading primitives
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+typedef struct thread* thread_t;
+typedef struct mutex* mutex_t;
+typedef struct cond* cond_t;
+typedef struct file_map* file_map_t;
+
+typedef void (*thread_func_t)(void* user);
+
+/* Starts a thread running func(user) */
+thread_t platform_thread_create(thread_func_t func, void* user);
+/* Waits for the thread to return, frees it and sets the pointer to NULL */
+void platform_thread_join(thread_t* thread);
+
+/* Creates a mutex. Mutexes are not recursive. */
+mutex_t platform_mutex_create(void);
+/* Deletes the mutex and sets the pointer to NULL */
+void platform_mutex_delete(mutex_t* mutex);
+/* Locks mutex, waiting until it is free */
+void platform_mutex_lock(mutex_t mutex);
+/* Locks mutex if it is free and returns true, otherwise returns false right away */
+bool platform_mutex_try_lock(mutex_t mutex);
+/* Unlocks mutex */
+void platform_mutex_unlock(mutex_t mutex);
+
+/* Creates a condition variable */
+cond_t platform_cond_create(void);
+/* Deletes the condition variable and sets the pointer to NULL */
+void platform_cond_delete(cond_t* cond);
+/* Unlocks mutex and sleeps until cond is signalled, then locks mutex again. Wakeups can be spurious, so always wait in a loop. */
+void platform_cond_wait(cond_t cond, mutex_t mutex);
+/* Wakes one thread waiting on cond */
+void platform_cond_signal(cond_t cond);
+/* Wakes every thread waiting on cond */
+void platform_cond_broadcast(cond_t cond);
+
+/* Maps the file at path into memory read-only. Returns NULL if it cannot be opened or is empty. The mapping does not grow with the file, map it again to see appended bytes. */
+file_map_t platform_file_map(const char* path);
+/* Unmaps the file and sets the pointer to NULL */
+void platform_file_unmap(file_map_t* map);
+/* Gets the mapped bytes */
+const uint8_t* platform_file_map_data(file_map_t map);
+/* Gets the size of the mapping in bytes, as the file was when it was mapped */
+size_t platform_file_map_size(file_map_t map);
+
+/* Flushes file and waits until the operating system has written it to disk */
+void platform_file_sync(FILE* file);
+/* Moves the file at "from" over the file at "to" in one step, so "to" is always either the old file or the new one. Neither may be open. Returns false on failure. */
+bool platform_file_replace(const char* from, const char* to);
+
+typedef void (*file_list_func_t)(const char* name, void* user);
+
+/* Creates the directory at path. Returns true if it was made or already exists. */
+bool platform_directory_create(const char* path);
+/* Calls func with the name, without the directory, of every file in directory whose name ends in "extension," such as ".rgn" */
+void platform_directory_list(const char* directory, const char* extension, file_list_func_t func, void* user);
+/* Deletes the file at path. Returns false on failure, a file that does not exist counts as deleted. */
+bool platform_file_delete(const char* path);
+
+/* Sleeps the calling thread for at least "milliseconds" */
+void platform_sleep(int milliseconds);
+/* Gets how many logical processors the machine has, at least 1 */
+int platform_cpu_count(void);
\ No newline at end of file
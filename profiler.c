@@ -0,0 +1,126 @@
+/*
+	profiler.c ~ RL
+	Times the phases of each tick and frame into rings of recent samples. Compiled out unless MC_PROFILE is defined.
+*/
+
+#include "profiler.h"
+#include "platform.h"
+#include "util.h"
+#include "window.h"
+
+#ifdef MC_PROFILE
+
+struct phase_history
+{
+	float samples[PROFILE_HISTORY];	/* Milliseconds */
+	int head, count;
+	long long recorded;				/* Samples ever recorded, including those overwritten */
+};
+
+static const char* phase_names[PROFILE_COUNT] =
+{
+#define DEFINE_PHASE(name) #name,
+	PROFILE_PHASE_LIST
+#undef DEFINE_PHASE
+};
+
+static struct phase_history history[PROFILE_COUNT];
+static mutex_t lock;	/* Ticks and frames record from different threads */
+
+void profiler_init(void)
+{
+	memset(history, 0, sizeof history);
+	lock = platform_mutex_create();
+}
+
+void profiler_destroy(void)
+{
+	platform_mutex_delete(&lock);
+}
+
+double profiler_now(void)
+{
+	return window_time();
+}
+
+void profiler_record(profile_phase_t phase, double seconds)
+{
+	if (!lock)
+	{
+		return;
+	}
+
+	platform_mutex_lock(lock);
+	struct phase_history* curr = &history[phase];
+	curr->samples[curr->head] = (float)(seconds * 1000.0);
+	curr->head = (curr->head + 1) % PROFILE_HISTORY;
+	curr->count = min(curr->count + 1, PROFILE_HISTORY);
+	curr->recorded++;
+	platform_mutex_unlock(lock);
+}
+
+static int profiler_compare_samples(const void* a, const void* b)
+{
+	float left = *(const float*)a, right = *(const float*)b;
+	return left < right ? -1 : left > right;
+}
+
+void profiler_dump(FILE* stream)
+{
+	if (!lock)
+	{
+		return;
+	}
+
+	fprintf(stream, "%-16s %10s %9s %9s %9s %9s  (ms, last %i samples)\n", "phase", "samples", "min", "avg", "p99", "max", PROFILE_HISTORY);
+	for (int i = 0; i < PROFILE_COUNT; i++)
+	{
+		/* Copied out so sorting does not hold up whoever is recording */
+		platform_mutex_lock(lock);
+		struct phase_history curr = history[i];
+		platform_mutex_unlock(lock);
+
+		if (curr.count == 0)
+		{
+			fprintf(stream, "%-16s %10i\n", phase_names[i], 0);
+			continue;
+		}
+
+		qsort(curr.samples, curr.count, sizeof * curr.samples, profiler_compare_samples);
+		double total = 0.0;
+		for (int j = 0; j < curr.count; j++)
+		{
+			total += curr.samples[j];
+		}
+		int p99 = (curr.count * 99 + 99) / 100 - 1;
+		fprintf(stream, "%-16s %10lli %9.3f %9.3f %9.3f %9.3f\n", phase_names[i], curr.recorded,
+			curr.samples[0], total / curr.count, curr.samples[p99], curr.samples[curr.count - 1]);
+	}
+	fflush(stream);
+}
+
+#else
+
+void profiler_init(void)
+{
+}
+
+void profiler_destroy(void)
+{
+}
+
+double profiler_now(void)
+{
+	return window_time();
+}
+
+void profiler_record(profile_phase_t phase, double seconds)
+{
+}
+
+void profiler_dump(FILE* stream)
+{
+	fprintf(stream, "Profiler is compiled out, build with MC_PROFILE defined to time ticks and frames\n");
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,53 @@
+/*
+	profiler.h ~ RL
+	Times the phases of each tick and frame into rings of recent samples. Compiled out unless MC_PROFILE is defined.
+*/
+
+#pragma once
+
+#include <stdio.h>
+
+#define PROFILE_HISTORY	256	/* Samples kept per phase, the oldest is overwritten first */
+
+typedef enum profile_phase
+{
+#define DEFINE_PHASE(name) PROFILE_ ## name,
+#define PROFILE_PHASE_LIST \
+	DEFINE_PHASE(TICK) \
+	DEFINE_PHASE(BLOCK_TICKS) \
+	DEFINE_PHASE(RANDOM_TICKS) \
+	DEFINE_PHASE(WATER) \
+	DEFINE_PHASE(PLAYER) \
+	DEFINE_PHASE(CHUNKS) \
+	DEFINE_PHASE(LIGHT) \
+	DEFINE_PHASE(JOURNAL) \
+	DEFINE_PHASE(AUTOSAVE) \
+	DEFINE_PHASE(FRAME) \
+	DEFINE_PHASE(FRAME_PREPARE) \
+	DEFINE_PHASE(FRAME_DRAW) \
+
+	PROFILE_PHASE_LIST
+	PROFILE_COUNT
+#undef DEFINE_PHASE
+} profile_phase_t;
+
+#ifdef MC_PROFILE
+/* Starts timing phase. Pair with PROFILE_END(phase) in the same scope. */
+#define PROFILE_BEGIN(phase)	double profile_start_ ## phase = profiler_now()
+/* Records the time since PROFILE_BEGIN(phase) */
+#define PROFILE_END(phase)		profiler_record(PROFILE_ ## phase, profiler_now() - profile_start_ ## phase)
+#else
+#define PROFILE_BEGIN(phase)
+#define PROFILE_END(phase)
+#endif
+
+/* Sets up the profiler. Call before anything is timed. */
+void profiler_init(void);
+/* Frees the profiler */
+void profiler_destroy(void);
+/* Gets a timestamp in seconds to time phases with */
+double profiler_now(void);
+/* Adds a sample of "seconds" to phase's ring. Safe to call from any thread. */
+void profiler_record(profile_phase_t phase, double seconds);
+/* Prints the min, average, 99th percentile and max of every phase's ring to stream */
+void profiler_dump(FILE* stream);
\ No newline at end of file
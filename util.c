@@ -80,14 +80,14 @@ int mc_list_remove(array_list_t list, int index, void* out, size_t element_size)
 		return -1;
 	}
 
-	index = max(min(list->count, index), 0);
+	index = max(min(list->count - 1, index), 0);
 	if (out)
 	{
 		assert(element_size == list->element_size);
 		memcpy(out, list->array + element_size * index, element_size);
 	}
 	element_size = list->element_size;
-	memmove(list->array + element_size * index, list->array + element_size * (index + 1), element_size);
+	memmove(list->array + element_size * index, list->array + element_size * (index + 1), element_size * (list->count - index - 1));
 	list->count--;
 	return index;
 }
@@ -283,7 +283,7 @@ void* mc_map_get(const map_t map, hash_t key, void* out, size_t element_size)
 void mc_map_clear(map_t map)
 {
 	map->count = 0;
-	memset(map->data, 0, map->element_size * map->reserved);
+	memset(map->data, 0, (sizeof(struct map_pair) + map->element_size) * map->reserved);
 }
 
 void mc_set_iterate(const hash_set_t set, set_iterate_func_t callback, void* user)
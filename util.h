@@ -175,6 +175,35 @@ extern inline uint8_t* mc_read_file_binary(const char* path, long* size)
 	return src;
 }
 
+/* Small, fast pseudo-random generator (splitmix64). Unlike rand, each random_t is its own sequence, so what it returns never depends on who else drew numbers first. */
+typedef struct random
+{
+	uint64_t state;
+} random_t;
+
+/* Returns next 32 random bits */
+extern inline uint32_t mc_random_next(random_t* random)
+{
+	uint64_t z = (random->state += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return (uint32_t)((z ^ (z >> 31)) >> 32);
+}
+
+/* Creates a generator whose sequence only depends on seed and (x, z) */
+extern inline random_t mc_random_create(uint32_t seed, int x, int z)
+{
+	random_t result = { ((uint64_t)seed << 32) ^ ((uint64_t)(uint32_t)x * 0x632BE59BD9B4E019ULL) ^ ((uint64_t)(uint32_t)z * 0x85157AF5ULL) };
+	mc_random_next(&result);
+	return result;
+}
+
+/* Returns a random integer in [0, bound) */
+extern inline int mc_random_range(random_t* random, int bound)
+{
+	return (int)(mc_random_next(random) % (uint32_t)bound);
+}
+
 /* MATH SECTION */
 
 #include <float.h>
@@ -9,7 +9,7 @@
 #include "camera.h"
 #include "game.h"
 #include "graphics.h"
-#include "interface.h"
+#include "platform.h"
 #include <stdbool.h>
 #include <stdio.h>
 #include "util.h"
@@ -120,6 +120,8 @@ static bool gl_load(void)
 }
 
 static pointi_t dims;
+/* Guards what the render thread leaves for the next tick to read: mouse_wheel and mouse_latest */
+static mutex_t mouse_lock;
 /* Current position of wheel */
 static int mouse_wheel;
 
@@ -128,7 +130,9 @@ static LRESULT window_proc(HWND hwnd, UINT msg, WPARAM wparam, LPARAM lparam)
 	switch (msg)
 	{
 	case WM_MOUSEWHEEL:
+		platform_mutex_lock(mouse_lock);
 		mouse_wheel += GET_WHEEL_DELTA_WPARAM(wparam) / WHEEL_DELTA;
+		platform_mutex_unlock(mouse_lock);
 		return 0;
 
 	case WM_SIZE:
@@ -207,7 +211,9 @@ static bool window_init(void)
 	return true;
 }
 
-static pointi_t delta;
+/* Render thread's cursor, and the position it last left for ticks under mouse_lock */
+static pointi_t delta, cursor, mouse_latest;
+/* Current tick's position of mouse */
 static pointi_t curr;
 static bool lock_mouse = true;
 
@@ -217,23 +223,22 @@ static void window_mouse_update(void)
 	GetCursorPos(&cursor_pos);
 	ScreenToClient(window_handle, &cursor_pos);
 	pointi_t next = { cursor_pos.x, cursor_pos.y };
-	delta = (pointi_t){ next.x - curr.x, next.y - curr.y };
-	curr = next;
+	delta = (pointi_t){ next.x - cursor.x, next.y - cursor.y };
+	cursor = next;
 
-	if (window_input_clicked(INPUT_TOGGLE_MOUSE_FOCUS))
-	{
-		lock_mouse = !lock_mouse;
-	}
-
-	if (lock_mouse && !interface_is_inventory_open())
+	if (lock_mouse)
 	{
 		RECT dims;
 		GetWindowRect(window_handle, &dims);
 		POINT pt = { (dims.right - dims.left) / 2, (dims.bottom - dims.top) / 2 };
-		curr = (pointi_t){ pt.x, pt.y };
+		cursor = (pointi_t){ pt.x, pt.y };
 		ClientToScreen(window_handle, &pt);
 		SetCursorPos(pt.x, pt.y);
 	}
+
+	platform_mutex_lock(mouse_lock);
+	mouse_latest = cursor;
+	platform_mutex_unlock(mouse_lock);
 }
 
 pointi_t window_mouse_delta(void)
@@ -246,6 +251,11 @@ pointi_t window_mouse_position(void)
 	return curr;
 }
 
+void window_set_mouse_locked(bool locked)
+{
+	lock_mouse = locked;
+}
+
 /* Current tick's position of wheel */
 static int prev_wheel, curr_wheel;
 
@@ -293,6 +303,7 @@ void window_input_update(void)
 	state[INPUT_UPDATE_BLOCK] =			holding_ctrl && GetAsyncKeyState(VK_MBUTTON);
 	state[INPUT_QUEUE_BLOCK_INFO] =		!holding_ctrl && GetAsyncKeyState(VK_MBUTTON);
 	state[INPUT_REGENERATE_WORLD] =		holding_ctrl && GetAsyncKeyState('R');
+	state[INPUT_DUMP_PROFILE] =			holding_ctrl && GetAsyncKeyState('P');
 
 	state[INPUT_TOGGLE_NOCLIP] =		holding_ctrl && GetAsyncKeyState('N');
 	state[INPUT_TOGGLE_MOUSE_FOCUS] =	GetAsyncKeyState(VK_ESCAPE);
@@ -300,8 +311,12 @@ void window_input_update(void)
 	state[INPUT_TOGGLE_CHUNK_BORDERS] = holding_ctrl && GetAsyncKeyState('C');
 	state[INPUT_TOGGLE_VISUALIZE_AXIS] = holding_ctrl && GetAsyncKeyState('A');
 
+	/* Ticks only ever read their own copy of the mouse, never what the render thread is writing */
 	prev_wheel = curr_wheel;
+	platform_mutex_lock(mouse_lock);
+	curr = mouse_latest;
 	curr_wheel = mouse_wheel;
+	platform_mutex_unlock(mouse_lock);
 }
 
 bool window_input_down(input_t input)
@@ -322,13 +337,20 @@ double window_time(void)
 	return (double)curr.QuadPart / frequency.QuadPart;
 }
 
-int main()
+int main(int argc, char** argv)
 {
+	QueryPerformanceFrequency(&frequency);
+
+	if (argc > 1 && strcmp(argv[1], "-benchmark") == 0)
+	{
+		game_benchmark(stdout);
+		return 0;
+	}
+
+	mouse_lock = platform_mutex_create();
 	DEBUG_PLATFORM_CALL_GUARD(gl_load(), 1);
 	DEBUG_PLATFORM_CALL_GUARD(window_init(), 4);
 
-	QueryPerformanceFrequency(&frequency);
-
 	graphics_init();
 	game_init();
 
@@ -376,6 +398,7 @@ int main()
 
 	game_destroy();
 	graphics_destroy();
+	platform_mutex_delete(&mouse_lock);
 
 	return 0;
 }
\ No newline at end of file
@@ -18,10 +18,12 @@ double window_time(void);
 /* Returns the dimensions of the window. */
 pointi_t window_get_dimensions(void);
 
-/* Returns the difference between last frame's mouse position and this frame's mouse position */
+/* Returns the difference between last frame's mouse position and this frame's mouse position. Call from the render thread. */
 pointi_t window_mouse_delta(void);
-/* Returns current mouse position */
+/* Returns current tick's mouse position, as window_input_update last copied it from the render thread */
 pointi_t window_mouse_position(void);
+/* Sets whether the cursor is held in the middle of the window for looking around. Call from the render thread, which is the one that moves it. */
+void window_set_mouse_locked(bool locked);
 /* Returns current tick's mouse wheel position (- for down, + for up) */
 int window_mouse_wheel_position(void);
 /* Returns the difference between last tick's wheel position and this current tick's wheel position */
@@ -47,6 +49,7 @@ typedef enum input
 	INPUT_UPDATE_BLOCK,
 	INPUT_QUEUE_BLOCK_INFO,
 	INPUT_REGENERATE_WORLD,
+	INPUT_DUMP_PROFILE,
 
 	INPUT_TOGGLE_NOCLIP,
 	INPUT_TOGGLE_MOUSE_FOCUS,
@@ -57,7 +60,7 @@ typedef enum input
 	INPUT_COUNT
 } input_t;
 
-/* Updates input state */
+/* Updates input state. The simulation thread calls this at the start of every tick, so input changes once a tick. */
 void window_input_update(void);
 /* Is the key currently pressed? */
 bool window_input_down(input_t input);
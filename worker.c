@@ -0,0 +1,136 @@
+/*
+	worker.c ~ RL
+	Pool of threads that split the items of a loop between them
+*/
+
+#include "worker.h"
+#include "platform.h"
+#include "util.h"
+
+static thread_t* threads;	/* Everyone but the calling thread */
+static int thread_count;
+static mutex_t lock;
+static cond_t wake, done;
+static bool quit;
+
+/* The loop being run, everything guarded by lock */
+static worker_func_t job_func;
+static void* job_user;
+static int job_count, job_next, job_running;
+static unsigned int job_generation;	/* Bumped per loop, so sleeping workers can tell a new one started */
+
+/* Runs items of the current loop until there are none left to take. Called and returns with lock held. */
+static void worker_drain(int worker)
+{
+	while (job_next < job_count)
+	{
+		int item = job_next++;
+		worker_func_t func = job_func;
+		void* user = job_user;
+		job_running++;
+		platform_mutex_unlock(lock);
+		func(item, worker, user);
+		platform_mutex_lock(lock);
+		job_running--;
+	}
+	if (job_running == 0)
+	{
+		platform_cond_broadcast(done);
+	}
+}
+
+static void worker_thread(void* user)
+{
+	int worker = (int)(intptr_t)user;
+	platform_mutex_lock(lock);
+	unsigned int seen = job_generation;
+	while (true)
+	{
+		while (!quit && seen == job_generation)
+		{
+			platform_cond_wait(wake, lock);
+		}
+		if (quit)
+		{
+			break;
+		}
+		seen = job_generation;
+		worker_drain(worker);
+	}
+	platform_mutex_unlock(lock);
+}
+
+void worker_init(int count)
+{
+	worker_destroy();
+	int total = count > 0 ? count : platform_cpu_count();
+	if (total <= 1)
+	{
+		return;
+	}
+
+	lock = platform_mutex_create();
+	wake = platform_cond_create();
+	done = platform_cond_create();
+	quit = false;
+	thread_count = total - 1;
+	threads = mc_malloc(thread_count * sizeof * threads);
+	for (int i = 0; i < thread_count; i++)
+	{
+		threads[i] = platform_thread_create(worker_thread, (void*)(intptr_t)(i + 1));
+	}
+}
+
+void worker_destroy(void)
+{
+	if (!threads)
+	{
+		return;
+	}
+
+	platform_mutex_lock(lock);
+	quit = true;
+	platform_cond_broadcast(wake);
+	platform_mutex_unlock(lock);
+	for (int i = 0; i < thread_count; i++)
+	{
+		platform_thread_join(&threads[i]);
+	}
+	free(threads);
+	threads = NULL;
+	thread_count = 0;
+	platform_cond_delete(&done);
+	platform_cond_delete(&wake);
+	platform_mutex_delete(&lock);
+}
+
+int worker_count(void)
+{
+	return thread_count + 1;
+}
+
+void worker_for(int count, worker_func_t func, void* user)
+{
+	if (!threads || count <= 1)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			func(i, 0, user);
+		}
+		return;
+	}
+
+	platform_mutex_lock(lock);
+	job_func = func;
+	job_user = user;
+	job_count = count;
+	job_next = 0;
+	job_generation++;
+	platform_cond_broadcast(wake);
+	worker_drain(0);
+	while (job_next < job_count || job_running > 0)
+	{
+		platform_cond_wait(done, lock);
+	}
+	platform_mutex_unlock(lock);
+}
\ No newline at end of file
@@ -0,0 +1,19 @@
+/*
+	worker.h ~ RL
+	Pool of threads that split the items of a loop between them
+*/
+
+#pragma once
+
+/* Runs item "item" of a loop on worker "worker," 0 being the calling thread */
+typedef void (*worker_func_t)(int item, int worker, void* user);
+
+/* Starts "count" workers, counting the calling thread, or one per logical processor if 0. Restarts the pool if it is already running. */
+void worker_init(int count);
+/* Stops every worker. worker_for runs everything on the calling thread afterwards. */
+void worker_destroy(void);
+/* Gets how many workers there are, counting the calling thread */
+int worker_count(void);
+/*	Calls func for every item in [0, count) and returns once all of them are done. Items run in no particular order and on any worker,
+	so anything order-dependent has to be written per item and combined after. */
+void worker_for(int count, worker_func_t func, void* user);
\ No newline at end of file
@@ -8,17 +8,19 @@
 #include "camera.h"
 #include "entity.h"
 #include "graphics.h"
+#include "profiler.h"
 #include "window.h"
+#include "worker.h"
+
+#define DAY_TICKS (20 * 60 * 20) /* A day lasts 20 minutes, starting at noon */
 
-static hash_set_t update_list, old_update_list;
 static int ticks;
 
 entity_t player;
 
 void world_init(void)
 {
-	update_list = mc_set_create(sizeof(block_coords_t));
-	old_update_list = mc_set_create(sizeof(block_coords_t));
+	worker_init(0);
 	world_file_load_world((unsigned int)window_time());
 	world_render_init();
 
@@ -28,16 +30,20 @@ void world_init(void)
 void world_destroy(void)
 {
 	world_file_save_current();
+	world_file_close();
 	world_chunk_destroy();
 	world_render_destroy();
-	mc_set_destroy(&update_list);
-	mc_set_destroy(&old_update_list);
+	world_tick_destroy();
+	world_water_destroy();
+	world_light_destroy();
+	worker_destroy();
 }
 
 void world_generate(unsigned int seed)
 {
-	world_chunk_destroy();
+	/* Stops the writer thread first, it may still be regenerating chunks to compare against */
 	world_file_delete();
+	world_chunk_destroy();
 	world_chunk_init(seed);
 	world_file_save_current();
 }
@@ -47,6 +53,13 @@ int world_ticks(void)
 	return ticks;
 }
 
+float world_daylight(void)
+{
+	/* Full daylight and full darkness each last a third of the day, with dusk and dawn in between */
+	float angle = (float)(ticks % DAY_TICKS) / DAY_TICKS * 2.0F * (float)M_PI;
+	return min(max(0.5F + cosf(angle), 0.0F), 1.0F);
+}
+
 struct ray_state
 {
 	ray_t curr;
@@ -55,10 +68,9 @@ struct ray_state
 	ray_settings_t settings;
 };
 
-void world_raycast_loop(block_coords_t i, void* user)
+/* Keeps block i as the ray's hit if it is what settings asks for, the ray passes through it and it is the closest so far */
+static void world_ray_test(struct ray_state* state, block_coords_t i, block_type_t type)
 {
-	struct ray_state* state = (struct ray_state*)user;
-	block_type_t type = world_block_get(i);
 	if (!(state->settings & RAY_SOLID && IS_SOLID(type))
 		&& !(state->settings & RAY_AIR && type == BLOCK_AIR)
 		&& !(state->settings & RAY_LIQUID && type == BLOCK_WATER))
@@ -106,10 +118,80 @@ ray_t world_ray_cast(vector3_t start, vector3_t direction, float len, ray_settin
 		.settings = settings
 	};
 	direction = vector3_mul_scalar(direction, 10.0F); /* Band-aid? its really just a rounding issue TO DO */
-	world_region_loop(vector_to_block_coords(vector3_sub(start, direction)), vector_to_block_coords(vector3_add(state.curr.max, direction)), world_raycast_loop, &state);
+	block_iterator_t it = world_region_iterate(vector_to_block_coords(vector3_sub(start, direction)), vector_to_block_coords(vector3_add(state.curr.max, direction)));
+	block_span_t span;
+	while (world_region_next(&it, &span))
+	{
+		for (int i = 0; i < span.count; i++)
+		{
+			world_ray_test(&state, (block_coords_t) { span.start.x + i, span.start.y, span.start.z }, span.blocks ? span.blocks[i] : BLOCK_AIR);
+		}
+	}
 	return state.curr;
 }
 
+#define SWEEP_EPSILON 0.0001F /* Boxes within this of a block's face are flush with it rather than inside it */
+
+sweep_t world_sweep_aabb(aabb_t box, axis_t axis, float distance, float gap)
+{
+	sweep_t result = { 1.0F, false };
+	if (distance == 0.0F)
+	{
+		return result;
+	}
+
+	/* Blocks the box covers across the axis */
+	vector3_uarray_t low = { box.min }, high = { box.max };
+	int across_a = (axis + 1) % 3, across_b = (axis + 2) % 3;
+	int a0 = (int)floorf(low.raw[across_a] + SWEEP_EPSILON), a1 = (int)ceilf(high.raw[across_a] - SWEEP_EPSILON) - 1;
+	int b0 = (int)floorf(low.raw[across_b] + SWEEP_EPSILON), b1 = (int)ceilf(high.raw[across_b] - SWEEP_EPSILON) - 1;
+
+	/* Layers of blocks in front of the leading face, out to gap past where the move ends */
+	float lead;
+	int first, last, step;
+	if (distance > 0.0F)
+	{
+		lead = high.raw[axis];
+		first = (int)ceilf(lead - SWEEP_EPSILON);
+		last = (int)ceilf(lead + distance + gap) - 1;
+		step = 1;
+	}
+	else
+	{
+		lead = low.raw[axis];
+		first = (int)floorf(lead + SWEEP_EPSILON) - 1;
+		last = (int)floorf(lead + distance - gap);
+		step = -1;
+	}
+
+	int cell[3];
+	cell[axis] = first;
+	cell[across_a] = a0;
+	cell[across_b] = b0;
+	block_cursor_t cursor = world_cursor_create((block_coords_t) { cell[0], cell[1], cell[2] });
+	for (int layer = first; layer * step <= last * step; layer += step)
+	{
+		cell[axis] = layer;
+		for (cell[across_a] = a0; cell[across_a] <= a1; cell[across_a]++)
+		{
+			for (cell[across_b] = b0; cell[across_b] <= b1; cell[across_b]++)
+			{
+				world_cursor_move(&cursor, (block_coords_t) { cell[0], cell[1], cell[2] });
+				if (!IS_SOLID(world_cursor_get(&cursor, 0, 0, 0)))
+				{
+					continue;
+				}
+
+				float face = step > 0 ? (float)layer : (float)(layer + 1);
+				result.time = min(max((face - lead - gap * step) / distance, 0.0F), 1.0F);
+				result.hit = true;
+				return result;
+			}
+		}
+	}
+	return result;
+}
+
 block_coords_t world_ray_neighbor(ray_t ray)
 {
 	block_coords_t res = ray.block;
@@ -136,49 +218,94 @@ block_coords_t world_ray_neighbor(ray_t ray)
 	return res;
 }
 
-void world_region_loop(block_coords_t _min, block_coords_t _max, world_loop_callback_t callback, void* user)
+/* Moves iterator onto the chunk at its chunk_x and chunk_z, clipping the box to it */
+static void world_region_enter(block_iterator_t* it)
+{
+	const struct chunk* chunk = world_chunk_get(it->chunk_x, it->chunk_z);
+	it->blocks = chunk ? chunk->arr : NULL;
+	it->x0 = max(it->min.x, it->chunk_x), it->x1 = min(it->max.x, it->chunk_x + CHUNK_WX - 1);
+	it->z0 = max(it->min.z, it->chunk_z), it->z1 = min(it->max.z, it->chunk_z + CHUNK_WZ - 1);
+	it->y = it->min.y;
+	it->z = it->z0;
+}
+
+block_iterator_t world_region_iterate(block_coords_t a, block_coords_t b)
 {
-	vector3_t v_min = block_coords_to_vector(_min),
-		v_max = block_coords_to_vector(_max);
-	_min = vector_to_block_coords(vector3_min(v_min, v_max));
-	_max = vector_to_block_coords(vector3_max(v_min, v_max));
+	block_iterator_t it =
+	{
+		.min = { min(a.x, b.x), min(a.y, b.y), min(a.z, b.z) },
+		.max = { max(a.x, b.x), max(a.y, b.y), max(a.z, b.z) },
+	};
+	it.chunk_x = ROUND_DOWN(it.min.x, CHUNK_WX);
+	it.chunk_z = ROUND_DOWN(it.min.z, CHUNK_WZ);
+	world_region_enter(&it);
+	return it;
+}
 
-	block_coords_t curr;
-	for (curr.z = _min.z; curr.z <= _max.z; curr.z++)
+bool world_region_next(block_iterator_t* it, block_span_t* span)
+{
+	if (it->z > it->z1)
+	{
+		it->z = it->z0;
+		it->y++;
+	}
+	if (it->y > it->max.y)
 	{
-		for (curr.y = _min.y; curr.y <= _max.y; curr.y++)
+		/* Done with this chunk, on to the next one along x and then along z */
+		it->chunk_x += CHUNK_WX;
+		if (it->chunk_x > it->max.x)
 		{
-			for (curr.x = _min.x; curr.x <= _max.x; curr.x++)
+			it->chunk_x = ROUND_DOWN(it->min.x, CHUNK_WX);
+			it->chunk_z += CHUNK_WZ;
+			if (it->chunk_z > it->max.z)
 			{
-				callback(curr, user);
+				return false;
 			}
 		}
+		world_region_enter(it);
 	}
+
+	span->start = (block_coords_t){ it->x0, it->y, it->z };
+	span->count = it->x1 - it->x0 + 1;
+	span->blocks = it->blocks && it->y >= 0 && it->y < CHUNK_WY ? &CHUNK_AT(it->blocks, it->x0 - it->chunk_x, it->y, it->z - it->chunk_z) : NULL;
+	it->z++;
+	return true;
 }
 
-int world_region_aabb(block_coords_t _min, block_coords_t _max, aabb_t* arr, int arr_len)
+void world_region_loop(block_coords_t _min, block_coords_t _max, world_loop_callback_t callback, void* user)
 {
-	vector3_t v_min = block_coords_to_vector(_min),
-		v_max = block_coords_to_vector(_max);
-	_min = vector_to_block_coords(vector3_min(v_min, v_max));
-	_max = vector_to_block_coords(vector3_max(v_min, v_max));
+	block_iterator_t it = world_region_iterate(_min, _max);
+	block_span_t span;
+	while (world_region_next(&it, &span))
+	{
+		for (int i = 0; i < span.count; i++)
+		{
+			callback((block_coords_t) { span.start.x + i, span.start.y, span.start.z }, user);
+		}
+	}
+}
 
-	block_coords_t curr;
+int world_region_aabb(block_coords_t _min, block_coords_t _max, aabb_t* arr, int arr_len)
+{
+	block_iterator_t it = world_region_iterate(_min, _max);
+	block_span_t span;
 	int curr_i = 0;
-	for (curr.z = _min.z; curr.z <= _max.z; curr.z++)
+	while (curr_i < arr_len && world_region_next(&it, &span))
 	{
-		for (curr.y = _min.y; curr.y <= _max.y; curr.y++)
+		/* Unloaded chunks and rows outside the world are air */
+		if (!span.blocks)
+		{
+			continue;
+		}
+		for (int i = 0; i < span.count && curr_i < arr_len; i++)
 		{
-			for (curr.x = _min.x; curr.x <= _max.x; curr.x++)
+			if (!IS_SOLID(span.blocks[i]))
 			{
-				if (curr_i >= arr_len || !IS_SOLID(world_block_get(curr)))
-				{
-					continue;
-				}
-				aabb_t aabb = { .min = block_coords_to_vector(curr) };
-				aabb.max = vector3_add_scalar(aabb.min, 1.0F);
-				arr[curr_i++] = aabb;
+				continue;
 			}
+			aabb_t aabb = { .min = { (float)(span.start.x + i), (float)span.start.y, (float)span.start.z } };
+			aabb.max = vector3_add_scalar(aabb.min, 1.0F);
+			arr[curr_i++] = aabb;
 		}
 	}
 	return curr_i;
@@ -186,12 +313,7 @@ int world_region_aabb(block_coords_t _min, block_coords_t _max, aabb_t* arr, int
 
 void world_block_update(block_coords_t coords)
 {
-	if (IS_INVALID_BLOCK_COORDS(coords) || !world_chunk_get(coords.x, coords.z))
-	{
-		return;
-	}
-
-	mc_set_add(update_list, &coords, sizeof coords);
+	world_tick_block(coords);
 }
 
 const char* world_block_stringify(block_type_t type)
@@ -206,56 +328,71 @@ const char* world_block_stringify(block_type_t type)
 	return name;
 }
 
-static inline void world_block_try_set(block_coords_t coords, block_type_t type)
+block_type_t world_block_get(block_coords_t coords)
 {
-	if (world_block_get(coords) == BLOCK_AIR)
+	struct chunk* chunk = world_chunk_get(coords.x, coords.z);
+	if (IS_INVALID_BLOCK_COORDS(coords) || !chunk)
 	{
-		world_block_set(coords, type);
+		return BLOCK_AIR;
 	}
+
+	coords.x -= chunk->x;
+	coords.z -= chunk->z;
+	return CHUNK_AT(chunk->arr, coords.x, coords.y, coords.z);
 }
 
-static bool world_block_tick_callback(const hash_set_t set, void* value, void* user)
+block_cursor_t world_cursor_create(block_coords_t coords)
 {
-	block_coords_t coords = *(block_coords_t*)value;
-	if (world_block_get(coords) == BLOCK_WATER)
+	/* Starts out in a chunk other than the one at coords, so moving looks it up */
+	block_cursor_t cursor = { .chunk_x = ROUND_DOWN(coords.x, CHUNK_WX) + CHUNK_WX };
+	world_cursor_move(&cursor, coords);
+	return cursor;
+}
+
+void world_cursor_move(block_cursor_t* cursor, block_coords_t coords)
+{
+	cursor->coords = coords;
+	int chunk_x = ROUND_DOWN(coords.x, CHUNK_WX), chunk_z = ROUND_DOWN(coords.z, CHUNK_WZ);
+	if (chunk_x != cursor->chunk_x || chunk_z != cursor->chunk_z)
 	{
-		world_block_try_set((block_coords_t) { coords.x + 1, coords.y, coords.z }, BLOCK_WATER);
-		world_block_try_set((block_coords_t) { coords.x - 1, coords.y, coords.z }, BLOCK_WATER);
-		world_block_try_set((block_coords_t) { coords.x, coords.y, coords.z + 1 }, BLOCK_WATER);
-		world_block_try_set((block_coords_t) { coords.x, coords.y, coords.z - 1 }, BLOCK_WATER);
-		world_block_try_set((block_coords_t) { coords.x, coords.y - 1, coords.z }, BLOCK_WATER);
+		const struct chunk* chunk = world_chunk_get(chunk_x, chunk_z);
+		cursor->chunk_x = chunk_x;
+		cursor->chunk_z = chunk_z;
+		cursor->blocks = chunk ? chunk->arr : NULL;
 	}
-	return true;
 }
 
-static void world_block_tick(void)
+block_type_t world_cursor_get(const block_cursor_t* cursor, int dx, int dy, int dz)
 {
-	if (ticks % 5 != 0) /* only water is updated RN */
+	block_coords_t coords = { cursor->coords.x + dx, cursor->coords.y + dy, cursor->coords.z + dz };
+	int x = coords.x - cursor->chunk_x, z = coords.z - cursor->chunk_z;
+	if (x < 0 || x >= CHUNK_WX || z < 0 || z >= CHUNK_WZ)
 	{
-		return;
+		return world_block_get(coords);
 	}
-
-	hash_set_t temp = old_update_list;
-	old_update_list = update_list;
-	update_list = temp;
-	mc_set_iterate(old_update_list, world_block_tick_callback, NULL);
-	mc_set_clear(old_update_list);
+	if (IS_INVALID_BLOCK_COORDS(coords) || !cursor->blocks)
+	{
+		return BLOCK_AIR;
+	}
+	return CHUNK_AT(cursor->blocks, x, coords.y, z);
 }
 
-block_type_t world_block_get(block_coords_t coords)
+int world_block_meta(block_coords_t coords)
 {
 	struct chunk* chunk = world_chunk_get(coords.x, coords.z);
 	if (IS_INVALID_BLOCK_COORDS(coords) || !chunk)
 	{
-		return BLOCK_AIR;
+		return 0;
 	}
-
-	coords.x -= chunk->x;
-	coords.z -= chunk->z;
-	return CHUNK_AT(chunk->arr, coords.x, coords.y, coords.z);
+	return world_chunk_meta(chunk, CHUNK_INDEX_OF(coords.x - chunk->x, coords.y, coords.z - chunk->z));
 }
 
 void world_block_set(block_coords_t coords, block_type_t type)
+{
+	world_block_set_meta(coords, type, 0);
+}
+
+void world_block_set_meta(block_coords_t coords, block_type_t type, int meta)
 {
 	if (IS_INVALID_BLOCK_COORDS(coords))
 	{
@@ -268,6 +405,26 @@ void world_block_set(block_coords_t coords, block_type_t type)
 		chunk = world_chunk_create(coords.x, coords.z);
 	}
 
+	int index = CHUNK_INDEX_OF(coords.x - chunk->x, coords.y, coords.z - chunk->z);
+	block_type_t old = chunk->arr[index];
+	int old_meta = world_chunk_meta(chunk, index);
+	chunk->arr[index] = type;
+	world_chunk_set_meta(chunk, index, meta);
+	world_block_changed(chunk, coords, old, old_meta, type, meta);
+	world_light_propagate();
+}
+
+void world_block_changed(struct chunk* chunk, block_coords_t coords, block_type_t old, int old_meta, block_type_t type, int meta)
+{
+	if (old != type || old_meta != meta)
+	{
+		world_journal_record(coords, old, type, meta);
+	}
+	world_tick_replace(chunk, CHUNK_INDEX_OF(coords.x - chunk->x, coords.y, coords.z - chunk->z), old, type);
+	world_light_edit(chunk, coords, old, type);
+	chunk->version++;
+
+	/* After the write, so the block itself is scheduled by its new type */
 	world_block_update((block_coords_t) { coords.x, coords.y, coords.z });
 	world_block_update((block_coords_t) { coords.x - 1, coords.y, coords.z });
 	world_block_update((block_coords_t) { coords.x + 1, coords.y, coords.z });
@@ -276,7 +433,6 @@ void world_block_set(block_coords_t coords, block_type_t type)
 	world_block_update((block_coords_t) { coords.x, coords.y, coords.z - 1 });
 	world_block_update((block_coords_t) { coords.x, coords.y, coords.z + 1 });
 
-	chunk->arr[CHUNK_INDEX_OF(coords.x - chunk->x, coords.y, coords.z - chunk->z)] = type;
 	int bit = type == BLOCK_WATER ? LIQUID_BIT : OPAQUE_BIT;
 	chunk->dirty_mask |= bit;
 
@@ -341,25 +497,121 @@ void world_update(float delta)
 {
 	if (window_input_clicked(INPUT_QUEUE_BLOCK_INFO))
 	{
-		block_coords_t bc = world_ray_cast(camera_position(), camera_forward(), 16.0F, RAY_SOLID | RAY_LIQUID).block;
+		block_coords_t bc = world_ray_cast(entity_player_eye(&player), entity_forward(&player), 16.0F, RAY_SOLID | RAY_LIQUID).block;
 		GRAPHICS_DEBUG_SET_BLOCK(bc);
 		world_block_debug(bc, stderr);
+		world_prefetch_debug(stderr);
+		world_cache_debug(stderr);
 	}
 	if (window_input_clicked(INPUT_UPDATE_BLOCK))
 	{
-		block_coords_t bc = world_ray_cast(camera_position(), camera_forward(), 16.0F, RAY_SOLID | RAY_LIQUID).block;
+		block_coords_t bc = world_ray_cast(entity_player_eye(&player), entity_forward(&player), 16.0F, RAY_SOLID | RAY_LIQUID).block;
 		GRAPHICS_DEBUG_SET_BLOCK(bc);
 		world_block_update(bc);
 	}
 
-	world_block_tick();
+	PROFILE_BEGIN(BLOCK_TICKS);
+	world_tick_run(ticks);
+	PROFILE_END(BLOCK_TICKS);
+	PROFILE_BEGIN(RANDOM_TICKS);
+	world_tick_random();
+	PROFILE_END(RANDOM_TICKS);
+	PROFILE_BEGIN(WATER);
+	world_water_run(ticks);
+	PROFILE_END(WATER);
+	PROFILE_BEGIN(PLAYER);
 	entity_player_update(&player, delta);
+	PROFILE_END(PLAYER);
+	PROFILE_BEGIN(CHUNKS);
 	world_chunk_update();
+	PROFILE_END(CHUNKS);
+	PROFILE_BEGIN(LIGHT);
+	world_light_update();
+	PROFILE_END(LIGHT);
+
+	PROFILE_BEGIN(JOURNAL);
+	world_journal_commit();
+	PROFILE_END(JOURNAL);
+
+	world_file_update();
 
 	/* so it doesn't save first tick */
 	ticks++;
 	if (ticks % (20 * 60 * 5) == 0)
 	{
-		world_file_save_current();
+		PROFILE_BEGIN(AUTOSAVE);
+		world_file_save_async();
+		PROFILE_END(AUTOSAVE);
+	}
+}
+
+#define BENCHMARK_RADIUS	4
+#define BENCHMARK_MOBS		500
+#define BENCHMARK_TICKS		200
+#define BENCHMARK_DELTA		(1.0F / 20)
+
+void world_sweep_benchmark(FILE* stream)
+{
+	world_chunk_init(1);
+	for (int i = -BENCHMARK_RADIUS; i < BENCHMARK_RADIUS; i++)
+	{
+		for (int j = -BENCHMARK_RADIUS; j < BENCHMARK_RADIUS; j++)
+		{
+			world_chunk_create(i * CHUNK_WX, j * CHUNK_WZ);
+		}
+	}
+
+	/* Mob-sized boxes dropped onto the ground around the square, wandering and hopping, and turned back before they walk off of it */
+	const int reach = (BENCHMARK_RADIUS - 1) * CHUNK_WX;
+	random_t random = mc_random_create(1, 0, 0);
+	entity_t* mobs = mc_malloc(sizeof * mobs * BENCHMARK_MOBS);
+	for (int i = 0; i < BENCHMARK_MOBS; i++)
+	{
+		block_coords_t ground = { mc_random_range(&random, reach * 2) - reach, CHUNK_WY - 1, mc_random_range(&random, reach * 2) - reach };
+		block_cursor_t cursor = world_cursor_create(ground);
+		for (; ground.y > 0 && !IS_SOLID(world_cursor_get(&cursor, 0, 0, 0)); world_cursor_move(&cursor, ground))
+		{
+			ground.y--;
+		}
+		mobs[i] = (entity_t){ .hitbox = { block_coords_to_vector(ground), vector3_add(block_coords_to_vector(ground), (vector3_t) { 0.6F, 1.8F, 0.6F }) } };
+		mobs[i].hitbox = aabb_translate_axis(mobs[i].hitbox, AXIS_Y, 1.0F);
 	}
+
+	int grounded = 0;
+	double start = window_time();
+	for (int tick = 0; tick < BENCHMARK_TICKS; tick++)
+	{
+		for (int i = 0; i < BENCHMARK_MOBS; i++)
+		{
+			entity_t* mob = &mobs[i];
+			vector3_t center = aabb_get_center(mob->hitbox);
+			if ((tick + i) % 20 == 0)
+			{
+				mob->velocity.x = (float)mc_random_range(&random, 9) - 4.0F;
+				mob->velocity.z = (float)mc_random_range(&random, 9) - 4.0F;
+			}
+			if (fabsf(center.x) > reach)
+			{
+				mob->velocity.x = center.x > 0.0F ? -4.0F : 4.0F;
+			}
+			if (fabsf(center.z) > reach)
+			{
+				mob->velocity.z = center.z > 0.0F ? -4.0F : 4.0F;
+			}
+			if (mob->grounded && mc_random_range(&random, 10) == 0)
+			{
+				mob->velocity.y = 6.0F;
+			}
+			entity_gravity_then_move(mob, BENCHMARK_DELTA);
+			grounded += mob->grounded;
+		}
+	}
+	double elapsed = window_time() - start;
+
+	fprintf(stream, "world_sweep: %i mobs for %i ticks, %.3f us per move, %.2f ms per tick, %.0f%% of moves ended on the ground\n", BENCHMARK_MOBS,
+		BENCHMARK_TICKS, elapsed / (BENCHMARK_MOBS * BENCHMARK_TICKS) * 1.0e6, elapsed / BENCHMARK_TICKS * 1000.0, 100.0 * grounded / (BENCHMARK_MOBS * BENCHMARK_TICKS));
+
+	free(mobs);
+	world_chunk_destroy();
+	world_tick_destroy();
 }
\ No newline at end of file
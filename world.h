@@ -14,6 +14,10 @@
 #define CHUNK_WZ 16
 #define CHUNK_FLOOR_BLOCK_COUNT	(CHUNK_WX * CHUNK_WZ)
 #define CHUNK_BLOCK_COUNT		(CHUNK_WX * CHUNK_WY * CHUNK_WZ)
+#define SECTION_HEIGHT			16	/* Chunks are split into cubic sections this tall, for bookkeeping that would be wasted on a whole column */
+#define SECTION_COUNT			(CHUNK_WY / SECTION_HEIGHT)
+#define SECTION_BLOCK_COUNT		(CHUNK_FLOOR_BLOCK_COUNT * SECTION_HEIGHT)
+#define CHUNK_META_SIZE			(CHUNK_BLOCK_COUNT / 2)	/* Bytes of a chunk's metadata, a nibble per block */
 
 #define WATER_STRENGTH 7
 
@@ -35,6 +39,32 @@ extern entity_t player;
 
 typedef void (*world_loop_callback_t)(block_coords_t, void*);
 
+/* A row of blocks along x inside one chunk, read straight out of the chunk's storage */
+typedef struct block_span
+{
+	block_coords_t start;		/* Coordinates of the first block */
+	int count;					/* Blocks in the row, at most a chunk's width */
+	const block_type_t* blocks;	/* The row's blocks. NULL if its chunk is not loaded or it is outside the world, where everything is air. */
+} block_span_t;
+
+/* Walks a box a chunk at a time, clipping the box to each chunk once. Rows come out in the order chunks store them. */
+typedef struct block_iterator
+{
+	block_coords_t min, max;		/* The box, both inclusive */
+	int chunk_x, chunk_z;			/* Chunk being walked */
+	int x0, x1, z0, z1;				/* The box clipped to that chunk, inclusive */
+	int y, z;						/* Next row */
+	const block_type_t* blocks;		/* That chunk's blocks, NULL if it is not loaded */
+} block_iterator_t;
+
+/* Reads blocks around one spot, keeping the chunk it is in so reading neighbors rarely has to look chunks up */
+typedef struct block_cursor
+{
+	block_coords_t coords;			/* Where the cursor is */
+	int chunk_x, chunk_z;			/* Chunk the cursor is in */
+	const block_type_t* blocks;		/* That chunk's blocks, NULL if it is not loaded */
+} block_cursor_t;
+
 extern inline block_coords_t vector_to_block_coords(vector3_t vec)
 {
 	return (block_coords_t) { (int)vec.x, (int)vec.y, (int)vec.z };
@@ -56,6 +86,10 @@ void world_generate(unsigned int seed);
 
 /* fetch game tick count */
 int world_ticks(void);
+/* How bright the sky is at the current time of day, from 0 at midnight to 1 at noon */
+float world_daylight(void);
+/* Returns whether a background save is running, and writes how far along it is, from 0 to 1, to progress if not NULL */
+bool world_file_save_progress(float* progress);
 
 typedef enum ray_settings
 {
@@ -69,15 +103,63 @@ ray_t world_ray_cast(vector3_t start, vector3_t direction, float len, ray_settin
 /* Returns the block coords of the neighbor of a ray */
 block_coords_t world_ray_neighbor(ray_t ray);
 
+/* Many rays laid out as one array per component, so they can be loaded into vector registers together */
+typedef struct ray_batch
+{
+	int count;
+	const float* origin_x, * origin_y, * origin_z;
+	const float* direction_x, * direction_y, * direction_z;	/* Do not need to be normalized */
+	const float* length;
+} ray_batch_t;
+
+/*	Casts every ray in batch and writes ray i's result to results[i], which must have room for batch->count rays. Rays are stepped
+	block by block four at a time, starting with those that begin in the same chunk, and stop at the first block that fits in "settings."
+	Only reads the world, so it is safe to call from any thread while chunks are not being added or removed. */
+void world_ray_cast_batch(const ray_batch_t* batch, ray_settings_t settings, ray_t* results);
+
+/* Where a box moving along one axis first touches a solid block */
+typedef struct sweep
+{
+	float time;	/* Fraction of the distance the box can move, 1 if nothing is in the way */
+	bool hit;	/* Did the box touch a solid block? */
+} sweep_t;
+
+/*	Sweeps box "distance" along axis, stopping "gap" short of the first solid block it would touch. Only the blocks the box's leading face
+	passes through are read, one layer at a time, so the cost grows with the distance and the box's cross section rather than its surroundings. */
+sweep_t world_sweep_aabb(aabb_t box, axis_t axis, float distance, float gap);
+
 /* Loops through region and calls "callback" on each block */
 void world_region_loop(block_coords_t min, block_coords_t max, world_loop_callback_t callback, void* user);
+/*	Starts walking the box with corners a and b, both inclusive, in any order. The iterator and the spans it gives out
+	point into chunks, so they are only good until a chunk is added or removed. */
+block_iterator_t world_region_iterate(block_coords_t a, block_coords_t b);
+/* Gets the next row of the box into span. Returns false once the whole box has been walked. */
+bool world_region_next(block_iterator_t* iterator, block_span_t* span);
 /* Sets contents of arr to a region's blocks -> AABBs. Returns the amount of blocks in the region. Writes to arr until arr no longer has space. */
 int world_region_aabb(block_coords_t min, block_coords_t max, aabb_t* arr, int arr_len);
+/*	Sets every block in the box with corners first and last, both inclusive, to type. Chunks are looked up once and blocks are updated and meshes
+	marked once for the whole box, rather than per block like world_block_set. Returns how many blocks changed. */
+int world_region_fill(block_coords_t first, block_coords_t last, block_type_t type);
+/* Sets every block in the box with corners first and last, both inclusive, that is "from" to "to." Returns how many blocks changed. */
+int world_region_replace(block_coords_t first, block_coords_t last, block_type_t from, block_type_t to);
+/*	Copies a box of "size" blocks into the world with its lowest corner at origin. blocks is laid out like a chunk: x first, then z, then y.
+	Air in blocks leaves the world as it is if skip_air is set. Returns how many blocks changed. */
+int world_region_paste(block_coords_t origin, block_coords_t size, const block_type_t* blocks, bool skip_air);
 
 /* Gets block at coordinates */
 block_type_t world_block_get(block_coords_t coords);
 /* Sets block at coords to type */
 void world_block_set(block_coords_t coords, block_type_t type);
+/* Gets the metadata nibble of the block at coords. For water, it is how many blocks it is from its source, 0 being a source. */
+int world_block_meta(block_coords_t coords);
+/* Sets block at coords to type with the metadata nibble "meta" */
+void world_block_set_meta(block_coords_t coords, block_type_t type, int meta);
+/* Creates a cursor at coords. Like an iterator, it is only good until a chunk is added or removed. */
+block_cursor_t world_cursor_create(block_coords_t coords);
+/* Moves cursor to coords, only looking up its chunk again if coords is in another one */
+void world_cursor_move(block_cursor_t* cursor, block_coords_t coords);
+/* Gets the block at an offset from cursor without moving it. Offsets that stay in the cursor's chunk need no lookup. */
+block_type_t world_cursor_get(const block_cursor_t* cursor, int dx, int dy, int dz);
 /* Debugs info about a block to stream */
 void world_block_debug(block_coords_t coords, FILE* stream);
 /* Updates block */
@@ -87,26 +169,53 @@ const char* world_block_stringify(block_type_t type);
 
 /* Updates world */
 void world_update(float delta);
-/* Renders world to screen */
-void world_render(const shader_t solid, const shader_t liquid, float delta);
+/* Rebuilds the meshes of changed chunks and uploads this frame's draw commands. Reads chunks, so call it while the simulation is not ticking. */
+void world_render_prepare(void);
+/*	Renders world to screen with the draw commands world_render_prepare last uploaded. Does not read chunks, so it is safe while the simulation ticks.
+	daylight scales sky light in the shaders, so the time of day never needs a remesh. */
+void world_render(const shader_t solid, const shader_t liquid, float daylight, float delta);
+/* Times building the renderer's indirect draw commands for a synthetic scene, without needing a window. Prints results to stream. */
+void world_render_benchmark(FILE* stream);
+/* Times filling, replacing and pasting a little over 100k blocks, without needing a window. Prints results to stream. */
+void world_region_benchmark(FILE* stream);
+/* Times random ticks over freshly generated chunks on one worker and on all of them, checking both leave the same world. Prints results to stream. */
+void world_tick_benchmark(FILE* stream);
+/* Times moving a crowd of mob-sized boxes around freshly generated chunks with entity_move, without needing a window. Prints results to stream. */
+void world_sweep_benchmark(FILE* stream);
+/* Times lighting freshly generated chunks and relighting after single edits, checking edits leave the same light as lighting from scratch. Prints results to stream. */
+void world_light_benchmark(FILE* stream);
+/* Times casting rays across generated chunks in batches against casting them one at a time, and checks both hit the same blocks. Prints results to stream. */
+void world_ray_benchmark(FILE* stream);
 
 /* Gets world seed */
 unsigned int world_seed(void);
 
 #ifdef WORLD_INTERNAL
 
+#include "compress.h"
 #include "graphics.h"
 
 #define OPAQUE_BIT	1
 #define LIQUID_BIT	2
 
+#define LIGHT_MAX	15
+
 struct chunk
 {
 	int x, z; /* The x and z coordinates in block space. As in, these numbers are multiples of 16 (chunk width and depth.) */
 	int dirty_mask;
-	vertex_buffer_t opaque_buffer, liquid_buffer;
+	unsigned int version, saved_version; /* version is bumped on every edit. The chunk needs saving when it is ahead of saved_version. */
+	unsigned int saving_version; /* Version a save still being written copied, which becomes saved_version once the writer is done. Only valid while saving is true. */
+	bool saving;
+	arena_range_t opaque_range, liquid_range; /* Mesh ranges inside world_render's chunk arena */
+	struct tick_queue* ticks; /* Scheduled block ticks, NULL if there are none. See world_tick.c */
+	uint8_t* meta; /* CHUNK_META_SIZE bytes, a metadata nibble per block with even indices in the low nibble. NULL while every nibble is 0. */
+	unsigned int water_active; /* Bit per section with water that has not settled yet. See world_water.c */
+	bool random_counted; /* Are random_tickable and random_state set up yet? Done the first time the chunk gets random ticks. */
+	uint16_t random_tickable[SECTION_COUNT]; /* Blocks with a random tick in each section. Sections with none are skipped. */
+	uint32_t random_state[SECTION_COUNT]; /* xorshift32 state of each section */
+	struct chunk_light* light; /* Sky and block light, NULL until world_light_update gets to the chunk. See world_light.c */
 	block_type_t arr[CHUNK_BLOCK_COUNT];
-	bool generating; /* Is the chunk currently being generated? */
 };
 
 extern array_list_t chunk_list;		/* struct chunk array_list */
@@ -133,26 +242,175 @@ void world_chunk_destroy(void);
 /* Updates chunk manager */
 void world_chunk_update(void);
 
+/*	Fills arr with the chunk at (x, z) as generated from the world seed. The result only depends on the seed and coordinates,
+	never on which chunks were generated before, and nothing but the terrain noise is shared, so any thread may call it. */
+void world_chunk_generate(int x, int z, block_type_t arr[CHUNK_BLOCK_COUNT]);
 /* Creates chunk at (x, z). Rounds down to a multiple to 16 (ex. 14 -> 0, -5 -> -16) */
 struct chunk* world_chunk_create(int x_o, int z_o);
-/* Adds chunk to list */
+/* Adds chunk to list. If chunk is NULL, the new chunk's blocks are left for the caller to fill in. If (x, z) is already loaded, returns that chunk untouched. */
 struct chunk* world_chunk_add(int x, int z, block_type_t chunk[CHUNK_BLOCK_COUNT]);
+/* Gets the metadata nibble of the block at index in chunk */
+extern inline int world_chunk_meta(const struct chunk* chunk, int index)
+{
+	return chunk->meta ? (chunk->meta[index / 2] >> (index % 2 * 4)) & 0xF : 0;
+}
+/* Sets the metadata nibble of the block at index in chunk, allocating the chunk's metadata if it has none yet */
+void world_chunk_set_meta(struct chunk* chunk, int index, int meta);
+/* Replaces chunk's metadata with a copy of meta, or drops it if meta is NULL or all 0. Wakes the water in sections with any metadata. */
+void world_chunk_adopt_meta(struct chunk* chunk, const uint8_t* meta);
 /* Removes chunk at position */
 void world_chunk_remove(int x, int z);
 /* Gets chunk containing block at (x, z). Returns NULL if it does not exist. */
 struct chunk* world_chunk_get(int x, int z);
 /* Cleans chunk's mesh */
 void world_chunk_clean_mesh(struct chunk* chunk);
+/* Frees chunk's mesh ranges */
+void world_chunk_free_mesh(struct chunk* chunk);
+
+/* One chunk's mesh range for one render pass, the input to world_render_build_commands */
+struct chunk_draw
+{
+	int x, z;
+	arena_range_t range;
+};
+
+/*	Builds an indirect draw command and a chunk offset for each non-empty draw. Command i's base instance is "base" + i,
+	the index of its offset in the per-draw buffer. commands and offsets must have room for "count" elements.
+	Returns the amount of commands written. */
+int world_render_build_commands(const struct chunk_draw* draws, int count, int base, draw_command_t* commands, vector3_t* offsets);
 
 /* Saves chunk to file */
 void world_file_load_world(unsigned int fallback_seed);
 /* Saves chunk to file */
 void world_file_save_chunk(int x, int z);
-/* Saves current loaded chunks and player position to file */
+/* Saves current loaded chunks and player position to file, waiting for any background save to finish first */
 void world_file_save_current(void);
-/* Deletes current world file */
+/* Copies the loaded chunks and hands them to a background thread to save. Skipped if the last background save is still running. */
+void world_file_save_async(void);
+/* Deletes current world's files */
 void world_file_delete(void);
-/* Loads chunk from file. If it doesn't exist, returns NULL */
+/* Finishes any background save and closes region files left open */
+void world_file_close(void);
+/* Marks the chunks a background save copied as saved once the writer has written them. Call every tick. */
+void world_file_update(void);
+/* Loads chunk from file, or returns it if it is already loaded. If it doesn't exist, returns NULL */
 struct chunk* world_file_find_chunk(int x, int z);
+/*	Encodes blocks on their own into dst, which must hold compress_bound(CHUNK_BLOCK_COUNT) bytes. Blocks are reordered into columns first,
+	so long runs of one block down a column compress well. Returns the amount of bytes written and the codec used in codec. */
+size_t world_file_encode_blocks(const block_type_t* arr, uint8_t* dst, size_t dst_len, codec_t* codec);
+/* Decodes what world_file_encode_blocks wrote into arr. Returns false if src is corrupt. */
+bool world_file_decode_blocks(codec_t codec, const uint8_t* src, size_t len, block_type_t arr[CHUNK_BLOCK_COUNT]);
+/* Returns whether the chunk at (x, z) has a record on disk. Safe to call from any thread. */
+bool world_file_has_chunk(int x, int z);
+/*	Reads the chunk at (x, z) from disk into arr and its metadata into meta, zeroing meta if it has none, without adding it to the world.
+	Returns false if it is not saved or corrupt. Safe to call from any thread. */
+bool world_file_read_chunk(int x, int z, block_type_t arr[CHUNK_BLOCK_COUNT], uint8_t meta[CHUNK_META_SIZE]);
+
+/* How well the read-ahead thread has kept up, counted since the world was opened */
+struct prefetch_stats
+{
+	int hits;		/* Chunks loaded from a staging buffer */
+	int late_hits;	/* Hits that still had to wait for the read to finish */
+	int misses;		/* Chunks read from disk on the game thread because nothing was staged */
+	int wasted;		/* Staged chunks thrown away before they were needed */
+	int reads;		/* Records the read-ahead thread has read */
+	double read_time, max_read_time; /* Total and longest time spent on one read, in seconds */
+};
+
+/*	Queues saved chunks in the ring just past RADIUS around (x, z), on the sides "velocity" heads toward, to be read and decoded on the
+	read-ahead thread. Drops staged chunks that fell out of range. */
+void world_prefetch_update(int x, int z, vector3_t velocity);
+/* Loads chunk at (x, z), adopting it from a staging buffer if the read-ahead thread got to it and reading it from disk otherwise. Returns NULL if it is not saved. */
+struct chunk* world_prefetch_find_chunk(int x, int z);
+/* Stops the read-ahead thread and throws away everything staged */
+void world_prefetch_stop(void);
+/* Gets the read-ahead thread's counters */
+struct prefetch_stats world_prefetch_stats(void);
+/* Prints the read-ahead thread's hit rate and read latency to stream */
+void world_prefetch_debug(FILE* stream);
+
+/*	Does everything that follows the block at coords in chunk changing from old to type besides the write itself: journals it, keeps tick counts
+	current, bumps the chunk's version, updates the block and its neighbors and marks meshes dirty. world_block_set_meta calls it after writing.
+	Light changes are only queued, so callers must call world_light_propagate once they are done. */
+void world_block_changed(struct chunk* chunk, block_coords_t coords, block_type_t old, int old_meta, block_type_t type, int meta);
+
+/* Schedules the block at coords to tick "delay" ticks from now, unless it already has a tick pending. Ignored in unloaded chunks. */
+void world_tick_schedule(block_coords_t coords, int delay);
+/* Schedules the block at coords with its type's delay if its type reacts to updates */
+void world_tick_block(block_coords_t coords);
+/* Does type react to updates? Blocks whose type does not can skip world_tick_block. */
+bool world_tick_reacts(block_type_t type);
+/* Runs every scheduled tick due at or before "now" */
+void world_tick_run(int now);
+/* Keeps chunk's random tick counts up to date when the block at index changes from old to type */
+void world_tick_replace(struct chunk* chunk, int index, block_type_t old, block_type_t type);
+/* Draws random ticks from every section of every loaded chunk with blocks that take them. Returns how many blocks were drawn. */
+int world_tick_random(void);
+/* Drops chunk's scheduled ticks */
+void world_tick_free(struct chunk* chunk);
+/* Frees scheduled ticks taken off a chunk. queue may be NULL. */
+void world_tick_free_queue(struct tick_queue* queue);
+/* Hands chunk the scheduled ticks in queue, which may be NULL. Ticks that came due meanwhile run on the next world_tick_run. */
+void world_tick_adopt(struct chunk* chunk, struct tick_queue* queue);
+/* Frees the tick scheduler's buffers */
+void world_tick_destroy(void);
+
+/*	Keeps light current when the block at coords in chunk changes from old to type. Queues what has to spread or darken without spreading it,
+	so a batch of edits can share one world_light_propagate. */
+void world_light_edit(struct chunk* chunk, block_coords_t coords, block_type_t old, block_type_t type);
+/* Spreads and darkens everything world_light_edit queued, and marks chunks whose light changed for remeshing */
+void world_light_propagate(void);
+/* Lights every chunk that has no light yet */
+void world_light_update(void);
+/*	Gets the light of the cell at local (x, z) and height y in chunk, sky light in the low nibble and block light in the high nibble.
+	y may be outside the chunk. Cells of NULL or unlit chunks, and above the world, are open sky. */
+int world_light_get(const struct chunk* chunk, int x, int y, int z);
+/* Frees chunk's light */
+void world_light_free(struct chunk* chunk);
+/* Frees the light engine's queues */
+void world_light_destroy(void);
+
+/* Marks the sections around coords as having water that may flow */
+void world_water_wake(block_coords_t coords);
+/* Steps water flow in every section that has not settled, if "now" is a flow tick */
+void world_water_run(int now);
+/* Frees water flow's buffers */
+void world_water_destroy(void);
+
+typedef void (*world_cache_callback_t)(int x, int z, const block_type_t* arr, const uint8_t* meta, void* user);
+
+/*	Compresses chunk into the cold cache, so it can be brought back without going to disk. Does not remove it from chunk_list, but takes
+	its scheduled ticks so they carry on once it comes back. They are dropped if the chunk is dropped from the cache, they are never saved. */
+void world_cache_store(struct chunk* chunk);
+/* Promotes the chunk at (x, z) out of the cold cache into chunk_list. Returns NULL if it is not cached. */
+struct chunk* world_cache_find_chunk(int x, int z);
+/* Returns whether the chunk at (x, z) is in the cold cache */
+bool world_cache_has(int x, int z);
+/*	Calls callback with the blocks and metadata (NULL if none) of every cached chunk edited since it was last saved. They stay dirty,
+	and so stay cached, until world_cache_saved is called once the save has been written. */
+void world_cache_save_dirty(world_cache_callback_t callback, void* user);
+/* Marks the chunks the last world_cache_save_dirty handed out as saved, letting them be dropped again */
+void world_cache_saved(void);
+/* Sets how many bytes of compressed chunks the cold cache may hold. Least recently evicted chunks are dropped past it. */
+void world_cache_set_budget(size_t bytes);
+/* Frees every cached chunk */
+void world_cache_clear(void);
+/* Prints the cold cache's size and hit rate to stream */
+void world_cache_debug(FILE* stream);
+
+/* Buffers an edit to be written to the journal at the end of the tick */
+void world_journal_record(block_coords_t coords, block_type_t old, block_type_t type, int meta);
+/* Writes this tick's edits to the journal in one go and waits for them to reach the disk */
+void world_journal_commit(void);
+/* Sets the journal aside as a checkpoint covered by the save about to start. Edits after this go to a fresh journal. */
+void world_journal_checkpoint(void);
+/* Deletes the checkpoint once the save covering it is on disk */
+void world_journal_checkpoint_done(void);
+/* Throws away the journal and checkpoint, for when every edit is known to be saved */
+void world_journal_truncate(void);
+/* Commits anything left and closes the journal */
+void world_journal_close(void);
+/* Reapplies edits left in the journal by a crash, saves them and unloads the chunks they touched */
+void world_journal_replay(void);
 
 #endif
\ No newline at end of file
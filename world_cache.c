@@ -0,0 +1,236 @@
+/*
+	world_cache.c ~ RL
+	Keeps recently unloaded chunks compressed in memory, so walking back over them never touches the disk
+*/
+
+#define WORLD_INTERNAL
+#include "world.h"
+#include "window.h"
+
+#define DEFAULT_BUDGET (32 * 1024 * 1024)
+
+/* A compressed chunk. Entries are linked from most to least recently stored, the order they are dropped in once over budget. */
+struct cold_chunk
+{
+	int x, z;
+	bool dirty;		/* Edited since it was last saved. Dirty entries are never dropped, the next save cleans them once it is written. */
+	bool saving;	/* Copied into a save the writer has not finished yet */
+	codec_t codec, meta_codec;
+	struct tick_queue* ticks;	/* The chunk's scheduled ticks, NULL if it had none */
+	size_t size, meta_size;	/* Bytes of encoded blocks, then of encoded metadata right after them. meta_size is 0 if the chunk has none. */
+	struct cold_chunk* newer, * older;
+	uint8_t data[];
+};
+
+static map_t cold_chunks;	/* struct cold_chunk* map, keyed by world_cache_key */
+static struct cold_chunk* newest, * oldest;
+static size_t budget = DEFAULT_BUDGET, used;
+static int hits, stored, dropped;
+static double promote_time;
+
+static inline hash_t world_cache_key(int x, int z)
+{
+	int32_t coords[2] = { ROUND_DOWN(x, CHUNK_WX), ROUND_DOWN(z, CHUNK_WZ) };
+	return mc_hash(coords, sizeof coords);
+}
+
+static struct cold_chunk* world_cache_get(int x, int z)
+{
+	struct cold_chunk* entry = NULL;
+	if (cold_chunks)
+	{
+		mc_map_get(cold_chunks, world_cache_key(x, z), &entry, sizeof entry);
+	}
+	return entry && entry->x == ROUND_DOWN(x, CHUNK_WX) && entry->z == ROUND_DOWN(z, CHUNK_WZ) ? entry : NULL;
+}
+
+/* Unlinks entry and frees it */
+static void world_cache_remove(struct cold_chunk* entry)
+{
+	*(entry->newer ? &entry->newer->older : &newest) = entry->older;
+	*(entry->older ? &entry->older->newer : &oldest) = entry->newer;
+	mc_map_remove(cold_chunks, world_cache_key(entry->x, entry->z), NULL, 0);
+	used -= sizeof * entry + entry->size + entry->meta_size;
+	world_tick_free_queue(entry->ticks);
+	free(entry);
+}
+
+/* Decodes entry's metadata into meta. Returns false if it has none. */
+static bool world_cache_decode_meta(const struct cold_chunk* entry, uint8_t meta[CHUNK_META_SIZE])
+{
+	if (entry->meta_size == 0)
+	{
+		return false;
+	}
+	bool result = compress_decode(entry->meta_codec, entry->data + entry->size, entry->meta_size, meta, CHUNK_META_SIZE) == CHUNK_META_SIZE;
+	assert(result);
+	return result;
+}
+
+/* Drops the oldest clean entries until the cache fits its budget */
+static void world_cache_trim(void)
+{
+	struct cold_chunk* entry = oldest;
+	while (used > budget && entry)
+	{
+		struct cold_chunk* newer = entry->newer;
+		if (!entry->dirty)
+		{
+			world_cache_remove(entry);
+			dropped++;
+		}
+		entry = newer;
+	}
+}
+
+void world_cache_store(struct chunk* chunk)
+{
+	if (!cold_chunks)
+	{
+		cold_chunks = mc_map_create(sizeof(struct cold_chunk*));
+	}
+	struct cold_chunk* old = world_cache_get(chunk->x, chunk->z);
+	if (old)
+	{
+		world_cache_remove(old);
+	}
+
+	size_t bound = compress_bound(CHUNK_BLOCK_COUNT);
+	uint8_t* scratch = mc_malloc(bound + compress_bound(CHUNK_META_SIZE));
+	codec_t codec, meta_codec = CODEC_RAW;
+	size_t size = world_file_encode_blocks(chunk->arr, scratch, bound, &codec), meta_size = 0;
+	if (chunk->meta)
+	{
+		meta_codec = CODEC_RLE_LZ;
+		meta_size = compress_encode(CODEC_RLE_LZ, chunk->meta, CHUNK_META_SIZE, scratch + size, compress_bound(CHUNK_META_SIZE));
+	}
+
+	struct cold_chunk* entry = mc_malloc(sizeof * entry + size + meta_size);
+	entry->x = chunk->x;
+	entry->z = chunk->z;
+	entry->dirty = chunk->version != chunk->saved_version;
+	entry->saving = chunk->saving && chunk->version == chunk->saving_version;
+	entry->codec = codec;
+	entry->meta_codec = meta_codec;
+	entry->size = size;
+	entry->meta_size = meta_size;
+	entry->ticks = chunk->ticks;
+	chunk->ticks = NULL;
+	memcpy(entry->data, scratch, size + meta_size);
+	free(scratch);
+
+	entry->newer = NULL;
+	entry->older = newest;
+	*(newest ? &newest->newer : &oldest) = entry;
+	newest = entry;
+	mc_map_add(cold_chunks, world_cache_key(entry->x, entry->z), &entry, sizeof entry);
+	used += sizeof * entry + size + meta_size;
+	stored++;
+
+	world_cache_trim();
+}
+
+struct chunk* world_cache_find_chunk(int x, int z)
+{
+	struct cold_chunk* entry = world_cache_get(x, z);
+	if (!entry)
+	{
+		return NULL;
+	}
+	if (world_chunk_get(x, z))
+	{
+		return world_chunk_get(x, z);
+	}
+
+	double start = window_time();
+	struct chunk* chunk = world_chunk_add(entry->x, entry->z, NULL);
+	bool result = world_file_decode_blocks(entry->codec, entry->data, entry->size, chunk->arr);
+	assert(result);
+	if (entry->meta_size != 0)
+	{
+		uint8_t* meta = mc_malloc(CHUNK_META_SIZE);
+		world_cache_decode_meta(entry, meta);
+		world_chunk_adopt_meta(chunk, meta);
+		free(meta);
+	}
+	if (entry->dirty)
+	{
+		chunk->version = chunk->saved_version + 1;
+		chunk->saving = entry->saving;
+		chunk->saving_version = chunk->version;
+	}
+	world_tick_adopt(chunk, entry->ticks);
+	entry->ticks = NULL;
+	world_cache_remove(entry);
+	promote_time += window_time() - start;
+	hits++;
+	return chunk;
+}
+
+bool world_cache_has(int x, int z)
+{
+	return world_cache_get(x, z) != NULL;
+}
+
+void world_cache_save_dirty(world_cache_callback_t callback, void* user)
+{
+	block_type_t* arr = NULL;
+	uint8_t* meta = NULL;
+	for (struct cold_chunk* entry = newest; entry; entry = entry->older)
+	{
+		if (!entry->dirty)
+		{
+			continue;
+		}
+		if (!arr)
+		{
+			arr = mc_malloc(CHUNK_BLOCK_COUNT * sizeof * arr);
+			meta = mc_malloc(CHUNK_META_SIZE);
+		}
+		world_file_decode_blocks(entry->codec, entry->data, entry->size, arr);
+		callback(entry->x, entry->z, arr, world_cache_decode_meta(entry, meta) ? meta : NULL, user);
+		entry->saving = true;
+	}
+	free(meta);
+	free(arr);
+}
+
+void world_cache_saved(void)
+{
+	for (struct cold_chunk* entry = newest; entry; entry = entry->older)
+	{
+		if (entry->saving)
+		{
+			entry->dirty = entry->saving = false;
+		}
+	}
+	world_cache_trim();
+}
+
+void world_cache_set_budget(size_t bytes)
+{
+	budget = bytes;
+	world_cache_trim();
+}
+
+void world_cache_clear(void)
+{
+	while (oldest)
+	{
+		world_cache_remove(oldest);
+	}
+	if (cold_chunks)
+	{
+		mc_map_destroy(&cold_chunks);
+	}
+	hits = stored = dropped = 0;
+	promote_time = 0.0;
+}
+
+void world_cache_debug(FILE* stream)
+{
+	int count = cold_chunks ? mc_map_count(cold_chunks) : 0;
+	fprintf(stream, "Cold cache: %i chunks in %zu/%zu KiB (%.1f%% of uncompressed), %i stored, %i promoted at %.1f us each, %i dropped\n",
+		count, used / 1024, budget / 1024, count > 0 ? used * 100.0 / ((double)count * CHUNK_BLOCK_COUNT) : 0.0,
+		stored, hits, hits > 0 ? promote_time * 1000000.0 / hits : 0.0, dropped);
+}
\ No newline at end of file
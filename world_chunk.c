@@ -12,47 +12,79 @@
 #define TWISTINESS (1.0F / 64.0F)
 
 #define MAX_CHUNKS_PER_TICK 2
+#define EVICT_RADIUS (RADIUS + 2)	/* Chunks are kept a little past RADIUS, so standing on a chunk border does not unload and load the same row over and over */
+#define MAX_EVICTIONS_PER_TICK 4
+
+#define WORM_SEGMENTS	128
+#define WORM_RADIUS		3
+#define WORM_SALT		0x5A17C0DEU	/* Keeps a chunk's worms from drawing the same numbers as its ores and trees */
 
 array_list_t chunk_list;
 
 static hash_set_t chunks_to_generate;
 
-/* The problem is that if the chunk already exists, it doesn't dig into it. */
-static array_list_t cave_blocks;
 static perlin_state_t perlin_terrain;
 
+/* Every worm steers with the same noise, so they all share one path. worm_path[i] is segment i's offset from the worm's start. */
+static vector3_t worm_path[WORM_SEGMENTS];
+static float worm_extent;	/* Furthest a worm's path strays from its start along x or z */
+static int worm_reach;		/* How many chunks away a worm's home chunk can be and still have it dig into a chunk */
+
+static void world_chunk_init_worms(void)
+{
+	vector3_t noise_pos = { 7.0 / 2048.0, 1163.0 / 2048.0, 409.0 / 2048.0 };
+	vector3_t seg_pos = { 0 };
+	float extent = 0.0F;
+	for (int i = 0; i < WORM_SEGMENTS; i++)
+	{
+		worm_path[i] = seg_pos;
+		extent = max(extent, max(fabsf(seg_pos.x), fabsf(seg_pos.z)));
+
+		double noiseX = perlin_at_3d(perlin_terrain, noise_pos.x + (i * TWISTINESS), noise_pos.y, noise_pos.z),
+			noiseY = perlin_at_3d(perlin_terrain, noise_pos.x, noise_pos.y + (i * TWISTINESS), noise_pos.z),
+			noiseZ = perlin_at_3d(perlin_terrain, noise_pos.x, noise_pos.y, noise_pos.z + (i * TWISTINESS));
+		vector3_t offset = { cosf(noiseX * 2.0 * M_PI), sinf(noiseY * 0.25 * M_PI), sinf(noiseZ * 2.0 * M_PI) };
+		offset.y = -fabsf(offset.y);
+		seg_pos = vector3_add(seg_pos, offset);
+	}
+	worm_extent = extent + WORM_RADIUS;
+	worm_reach = ((int)ceilf(worm_extent) + BLOCK_RADIUS) / CHUNK_WX + 1;
+}
+
 void world_chunk_init(unsigned int seed)
 {
 	chunk_list = mc_list_create(sizeof(struct chunk));
-	cave_blocks = mc_list_create(sizeof(block_coords_t));
-	perlin_terrain = perlin_create_with_seed(50);
+	perlin_terrain = perlin_create_with_seed(seed);
 	chunks_to_generate = mc_set_create(sizeof(block_coords_t));
+	world_chunk_init_worms();
 }
 
 void world_chunk_destroy(void)
 {
 	for (int i = 0; i < mc_list_count(chunk_list); i++)
 	{
-		graphics_buffer_delete(&MC_LIST_CAST_GET(chunk_list, i, struct chunk)->opaque_buffer);
-		graphics_buffer_delete(&MC_LIST_CAST_GET(chunk_list, i, struct chunk)->liquid_buffer);
+		world_chunk_free_mesh(MC_LIST_CAST_GET(chunk_list, i, struct chunk));
+		world_tick_free(MC_LIST_CAST_GET(chunk_list, i, struct chunk));
+		world_light_free(MC_LIST_CAST_GET(chunk_list, i, struct chunk));
+		free(MC_LIST_CAST_GET(chunk_list, i, struct chunk)->meta);
 	}
 	mc_list_destroy(&chunk_list);
-	mc_list_destroy(&cave_blocks);
+	world_cache_clear();
 	perlin_delete(&perlin_terrain);
 
 	mc_set_destroy(&chunks_to_generate);
 }
 
-static void world_chunk_spawn_vain(struct chunk* curr, block_type_t type, block_coords_t pos, int size_min, int size_max)
+static void world_chunk_spawn_vain(block_type_t* arr, random_t* random, block_type_t type, block_coords_t pos, int size_min, int size_max)
 {
-	if (CHUNK_AT(curr->arr, pos.x, pos.y, pos.z) != BLOCK_STONE)
+	if (CHUNK_AT(arr, pos.x, pos.y, pos.z) != BLOCK_STONE)
 	{
 		return;
 	}
-	int size = rand() % (size_max - size_min) + size_min;
+	int size = mc_random_range(random, size_max - size_min) + size_min;
 	for (int i = 0; i < size; i++)
 	{
-		CHUNK_AT(curr->arr, pos.x, pos.y, pos.z) = type;
+		CHUNK_AT(arr, pos.x, pos.y, pos.z) = type;
 		block_coords_t begin = pos;
 		for (int j = 0; is_block_coords_equal(begin, pos); j++)
 		{
@@ -60,184 +92,191 @@ static void world_chunk_spawn_vain(struct chunk* curr, block_type_t type, block_
 			{
 				return;
 			}
-			switch (rand() % 6)
+			switch (mc_random_range(random, 6))
 			{
 			case 0: /* left */
-				if (pos.x - 1 >= 0 && CHUNK_AT(curr->arr, pos.x - 1, pos.y, pos.z) != type) pos.x--;
+				if (pos.x - 1 >= 0 && CHUNK_AT(arr, pos.x - 1, pos.y, pos.z) != type) pos.x--;
 				break;
 			case 1: /* right */
-				if (pos.x + 1 < CHUNK_WX && CHUNK_AT(curr->arr, pos.x + 1, pos.y, pos.z) != type) pos.x++;
+				if (pos.x + 1 < CHUNK_WX && CHUNK_AT(arr, pos.x + 1, pos.y, pos.z) != type) pos.x++;
 				break;
 			case 2: /* forward */
-				if (pos.z - 1 >= 0 && CHUNK_AT(curr->arr, pos.x, pos.y, pos.z - 1) != type) pos.z--;
+				if (pos.z - 1 >= 0 && CHUNK_AT(arr, pos.x, pos.y, pos.z - 1) != type) pos.z--;
 				break;
 			case 3: /* backward */
-				if (pos.z + 1 < CHUNK_WZ && CHUNK_AT(curr->arr, pos.x, pos.y, pos.z + 1) != type) pos.z++;
+				if (pos.z + 1 < CHUNK_WZ && CHUNK_AT(arr, pos.x, pos.y, pos.z + 1) != type) pos.z++;
 				break;
 			case 4: /* up */
-				if (pos.y + 1 < CHUNK_WY && CHUNK_AT(curr->arr, pos.x, pos.y + 1, pos.z) != type) pos.y++;
+				if (pos.y + 1 < CHUNK_WY && CHUNK_AT(arr, pos.x, pos.y + 1, pos.z) != type) pos.y++;
 				break;
 			case 5: /* down */
-				if (pos.y - 1 >= 0 && CHUNK_AT(curr->arr, pos.x, pos.y - 1, pos.z) != type) pos.y--;
+				if (pos.y - 1 >= 0 && CHUNK_AT(arr, pos.x, pos.y - 1, pos.z) != type) pos.y--;
 				break;
 			}
 		}
 	}
 }
 
-static void world_chunk_spawn_ores(struct chunk* next)
+static inline block_coords_t world_chunk_random_pos(random_t* random, int y_range)
 {
-	for (int i = rand() % 20 + 10; i >= 0; i--)
+	block_coords_t result;
+	result.x = mc_random_range(random, CHUNK_WX);
+	result.y = mc_random_range(random, y_range) + 2;
+	result.z = mc_random_range(random, CHUNK_WZ);
+	return result;
+}
+
+static void world_chunk_spawn_ores(block_type_t* arr, random_t* random)
+{
+	for (int i = mc_random_range(random, 20) + 10; i >= 0; i--)
 	{
-		world_chunk_spawn_vain(next, BLOCK_ORE_COAL, (block_coords_t) { rand() % CHUNK_WX, rand() % 60 + 2, rand() % CHUNK_WZ }, 2, 10);
+		world_chunk_spawn_vain(arr, random, BLOCK_ORE_COAL, world_chunk_random_pos(random, 60), 2, 10);
 	}
-	for (int i = rand() % 16 + 4; i >= 0; i--)
+	for (int i = mc_random_range(random, 16) + 4; i >= 0; i--)
 	{
-		world_chunk_spawn_vain(next, BLOCK_ORE_IRON, (block_coords_t) { rand() % CHUNK_WX, rand() % 50 + 2, rand() % CHUNK_WZ }, 1, 6);
+		world_chunk_spawn_vain(arr, random, BLOCK_ORE_IRON, world_chunk_random_pos(random, 50), 1, 6);
 	}
-	for (int i = rand() % 6 + 3; i >= 0; i--)
+	for (int i = mc_random_range(random, 6) + 3; i >= 0; i--)
 	{
-		world_chunk_spawn_vain(next, BLOCK_ORE_GOLD, (block_coords_t) { rand() % CHUNK_WX, rand() % 30 + 2, rand() % CHUNK_WZ }, 1, 6);
+		world_chunk_spawn_vain(arr, random, BLOCK_ORE_GOLD, world_chunk_random_pos(random, 30), 1, 6);
 	}
-	world_chunk_spawn_vain(next, BLOCK_ORE_DIAMOND, (block_coords_t) { rand() % CHUNK_WX, rand() % 22 + 2, rand() % CHUNK_WZ }, 1, 8);
+	world_chunk_spawn_vain(arr, random, BLOCK_ORE_DIAMOND, world_chunk_random_pos(random, 22), 1, 8);
 }
 
-static void world_chunk_spawn_terrain(struct chunk* next)
+static void world_chunk_spawn_terrain(int x, int z, block_type_t* arr)
 {
 	for (int i = 0; i < CHUNK_FLOOR_BLOCK_COUNT; i++)
 	{
-		int slice_height = perlin_brownian_at(perlin_terrain, CHUNK_FX(i) + next->x, CHUNK_FZ(i) + next->z, 6) * 32;
+		int slice_height = perlin_brownian_at(perlin_terrain, CHUNK_FX(i) + x, CHUNK_FZ(i) + z, 6) * 32;
 		slice_height += 64;
 		slice_height = max(min(slice_height, CHUNK_WY - 1), 0);
-		CHUNK_AT(next->arr, CHUNK_X(i), slice_height--, CHUNK_Z(i)) = BLOCK_GRASS;
+		CHUNK_AT(arr, CHUNK_X(i), slice_height--, CHUNK_Z(i)) = BLOCK_GRASS;
 		for (int j = 1; j < 4 && slice_height >= 0; j++, slice_height--)
 		{
-			CHUNK_AT(next->arr, CHUNK_X(i), slice_height, CHUNK_Z(i)) = BLOCK_DIRT;
+			CHUNK_AT(arr, CHUNK_X(i), slice_height, CHUNK_Z(i)) = BLOCK_DIRT;
 		}
 		while (slice_height >= 0)
 		{
-			CHUNK_AT(next->arr, CHUNK_X(i), slice_height--, CHUNK_Z(i)) = BLOCK_STONE;
+			CHUNK_AT(arr, CHUNK_X(i), slice_height--, CHUNK_Z(i)) = BLOCK_STONE;
 		}
 	}
 }
 
-static inline void world_chunk_square(struct chunk* next, int x, int y, int z, int radius, block_type_t type)
+static inline void world_chunk_square(block_type_t* arr, int x, int y, int z, int radius, block_type_t type)
 {
 	for (int xo = max(0, x - radius); xo <= min(CHUNK_WX - 1, x + radius); xo++)
 	{
 		for (int zo = max(0, z - radius); zo <= min(CHUNK_WZ - 1, z + radius); zo++)
 		{
-			if (CHUNK_AT(next->arr, xo, y, zo) == BLOCK_AIR)
+			if (CHUNK_AT(arr, xo, y, zo) == BLOCK_AIR)
 			{
-				CHUNK_AT(next->arr, xo, y, zo) = BLOCK_LEAVES;
+				CHUNK_AT(arr, xo, y, zo) = BLOCK_LEAVES;
 			}
 		}
 	}
 }
 
-static void world_chunk_spawn_trees(struct chunk* next)
+static void world_chunk_spawn_trees(block_type_t* arr, random_t* random)
 {
-	int count = rand() % 4;
+	int count = mc_random_range(random, 4);
 	for (int i = 0; i < count; i++)
 	{
-		int x = 2 + rand() % (CHUNK_WX - 4), z = 2 + rand() % (CHUNK_WZ - 4);
+		int x = 2 + mc_random_range(random, CHUNK_WX - 4);
+		int z = 2 + mc_random_range(random, CHUNK_WZ - 4);
+		int len = mc_random_range(random, 3) + 4;
 		int y;
-		for (y = CHUNK_WY - 1; !IS_SOLID(CHUNK_AT(next->arr, x, y, z)); y--);
-		if (CHUNK_AT(next->arr, x, y, z) != BLOCK_GRASS || y >= 192)
+		for (y = CHUNK_WY - 1; !IS_SOLID(CHUNK_AT(arr, x, y, z)); y--);
+		if (CHUNK_AT(arr, x, y, z) != BLOCK_GRASS || y >= 192)
 		{
 			continue;
 		}
-		CHUNK_AT(next->arr, x, y, z) = BLOCK_DIRT;
+		CHUNK_AT(arr, x, y, z) = BLOCK_DIRT;
 		y++;
-		int len = rand() % 3 + 4;
 		for (int j = 0; j < len; j++)
 		{
-			CHUNK_AT(next->arr, x, y + j, z) = BLOCK_LOG;
+			CHUNK_AT(arr, x, y + j, z) = BLOCK_LOG;
 		}
 		for (int yo = len - 2; yo < len; yo++)
 		{
-			world_chunk_square(next, x, y + yo, z, 2, BLOCK_LEAVES);
+			world_chunk_square(arr, x, y + yo, z, 2, BLOCK_LEAVES);
 		}
 		for (int yo = len; yo < len + 2; yo++)
 		{
-			world_chunk_square(next, x, y + yo, z, 1, BLOCK_LEAVES);
+			world_chunk_square(arr, x, y + yo, z, 1, BLOCK_LEAVES);
 		}
 	}
 }
 
-static inline void world_chunk_remove_sphere(block_coords_t pos, int radius)
+/* Carves the part of a sphere at pos that lies inside the chunk at (cx, cz) */
+static inline void world_chunk_carve_sphere(int cx, int cz, block_type_t* arr, block_coords_t pos, int radius)
 {
-	vector3_t fpos = block_coords_to_vector(pos);
 	int radius_squared = radius * radius;
-
-	int cx = INT_MIN, cz = INT_MIN;
-	bool chunk_exists = false;
-
-	for (int x = pos.x - radius; x < pos.x + radius; x++)
+	for (int x = max(pos.x - radius, cx); x < min(pos.x + radius, cx + CHUNK_WX); x++)
 	{
-		for (int y = pos.y - radius; y < pos.y + radius; y++)
+		for (int y = max(pos.y - radius, 0); y < min(pos.y + radius, CHUNK_WY); y++)
 		{
-			for (int z = pos.z - radius; z < pos.z + radius; z++)
+			for (int z = max(pos.z - radius, cz); z < min(pos.z + radius, cz + CHUNK_WZ); z++)
 			{
-				if (vector3_distance_squared(fpos, (vector3_t) { x, y, z }) <= radius_squared)
+				int dx = x - pos.x, dy = y - pos.y, dz = z - pos.z;
+				if (dx * dx + dy * dy + dz * dz <= radius_squared)
 				{
-					if (ROUND_DOWN(cx, 16) != ROUND_DOWN(x, 16) || ROUND_DOWN(cz, 16) != ROUND_DOWN(z, 16))
-					{
-						struct chunk* chunk = world_chunk_get(x, z);
-						chunk_exists = !!chunk && !chunk->generating;
-						cx = x;
-						cz = z;
-					}
-
-					if (y >= 0 && y < CHUNK_WY && !chunk_exists)
-					{
-						block_coords_t curr = (block_coords_t){ x, y, z };
-						mc_list_add(cave_blocks, mc_list_count(cave_blocks), &curr, sizeof curr);
-					}
+					CHUNK_AT(arr, x - cx, y, z - cz) = BLOCK_AIR;
 				}
 			}
 		}
 	}
 }
 
-static void world_chunk_worm(struct chunk* next)
+/*	Digs every cave worm that passes through the chunk at (cx, cz). Worms belong to the chunk they start from, and each chunk's
+	worms come from its own generator, so a chunk is carved the same no matter which chunks around it were generated first. */
+static void world_chunk_spawn_caves(int cx, int cz, block_type_t* arr)
 {
-	vector3_t chunk_pos = { next->x, 0, next->z };
-	vector3_t seg_pos = { BLOCK_RADIUS - rand() % (BLOCK_RADIUS * 2), rand() % (CHUNK_WY / 3), BLOCK_RADIUS - rand() % (BLOCK_RADIUS * 2) };
-	vector3_t noise_pos = { 7.0 / 2048.0, 1163.0 / 2048.0, 409.0 / 2048.0 };
-	int segments = rand() % 64 + 64;
-	for (int i = 0; i < segments; i++)
+	for (int ox = -worm_reach; ox <= worm_reach; ox++)
 	{
-		double noiseX = perlin_at_3d(perlin_terrain, noise_pos.x + (i * TWISTINESS), noise_pos.y, noise_pos.z),
-			noiseY = perlin_at_3d(perlin_terrain, noise_pos.x, noise_pos.y + (i * TWISTINESS), noise_pos.z),
-			noiseZ = perlin_at_3d(perlin_terrain, noise_pos.x, noise_pos.y, noise_pos.z + (i * TWISTINESS));
-		vector3_t offset = { cosf(noiseX * 2.0 * M_PI), sinf(noiseY * 0.25 * M_PI), sinf(noiseZ * 2.0 * M_PI) };
-
-		/* slow way of doing it */
-		world_chunk_remove_sphere(vector_to_block_coords(vector3_add(seg_pos, chunk_pos)), 3);
-
-		offset.y = -fabsf(offset.y);
-		seg_pos = vector3_add(seg_pos, offset);
-
-		if (seg_pos.y <= 7)
+		for (int oz = -worm_reach; oz <= worm_reach; oz++)
 		{
-			break;
+			vector3_t origin = { cx + ox * CHUNK_WX, 0, cz + oz * CHUNK_WZ };
+			random_t random = mc_random_create(perlin_get_seed(perlin_terrain) ^ WORM_SALT, (int)origin.x, (int)origin.z);
+			int cave_count = mc_random_range(&random, 2) + 1;
+			for (int i = 0; i < cave_count; i++)
+			{
+				vector3_t start = { BLOCK_RADIUS - mc_random_range(&random, BLOCK_RADIUS * 2), mc_random_range(&random, CHUNK_WY / 3), BLOCK_RADIUS - mc_random_range(&random, BLOCK_RADIUS * 2) };
+				int segments = mc_random_range(&random, WORM_SEGMENTS / 2) + WORM_SEGMENTS / 2;
+				start = vector3_add(start, origin);
+				if (start.x < cx - worm_extent || start.x > cx + CHUNK_WX + worm_extent || start.z < cz - worm_extent || start.z > cz + CHUNK_WZ + worm_extent)
+				{
+					continue;
+				}
+
+				for (int j = 0; j < segments; j++)
+				{
+					vector3_t seg_pos = vector3_add(start, worm_path[j]);
+					if (j > 0 && seg_pos.y <= 7)
+					{
+						break;
+					}
+					block_coords_t pos = vector_to_block_coords(seg_pos);
+					if (pos.x + WORM_RADIUS > cx && pos.x - WORM_RADIUS < cx + CHUNK_WX && pos.z + WORM_RADIUS > cz && pos.z - WORM_RADIUS < cz + CHUNK_WZ)
+					{
+						world_chunk_carve_sphere(cx, cz, arr, pos, WORM_RADIUS);
+					}
+				}
+			}
 		}
 	}
 }
 
-static void world_chunk_delete_cave_blocks(struct chunk* next)
+void world_chunk_generate(int x, int z, block_type_t arr[CHUNK_BLOCK_COUNT])
 {
-	const block_coords_t* arr = mc_list_array(cave_blocks);
-	for (int i = mc_list_count(cave_blocks) - 1; i >= 0; i--)
-	{
-		if (arr[i].x >= next->x && arr[i].x < next->x + CHUNK_WX &&
-			arr[i].z >= next->z && arr[i].z < next->z + CHUNK_WZ)
-		{
-			CHUNK_AT(next->arr, arr[i].x - next->x, arr[i].y, arr[i].z - next->z) = BLOCK_AIR;
-			mc_list_remove(cave_blocks, i, NULL, 0);
-		}
-	}
+	x = ROUND_DOWN(x, CHUNK_WX);
+	z = ROUND_DOWN(z, CHUNK_WZ);
+	random_t random = mc_random_create(perlin_get_seed(perlin_terrain), x, z);
+
+	memset(arr, 0, CHUNK_BLOCK_COUNT * sizeof * arr);
+	world_chunk_spawn_terrain(x, z, arr);
+	world_chunk_spawn_caves(x, z, arr);
+	world_chunk_spawn_ores(arr, &random);
+	world_chunk_spawn_trees(arr, &random);
 }
 
 struct chunk* world_chunk_create(int x_o, int z_o)
@@ -253,36 +292,29 @@ struct chunk* world_chunk_create(int x_o, int z_o)
 	int res = mc_list_add(chunk_list, mc_list_count(chunk_list), NULL, sizeof(struct chunk));
 	struct chunk* next = MC_LIST_CAST_GET(chunk_list, res, struct chunk);
 
-	next->generating = true;
-
 	next->x = x_o;
 	next->z = z_o;
+	world_chunk_generate(x_o, z_o, next->arr);
 
-	memset(next->arr, 0, sizeof next->arr);
-
-	world_chunk_spawn_terrain(next);
-	int cave_count = rand() % 2 + 1;
-	for (int i = 0; i < cave_count; i++)
-	{
-		world_chunk_worm(next);
-	}
-	world_chunk_delete_cave_blocks(next);
-	world_chunk_spawn_ores(next);
-	world_chunk_spawn_trees(next);
-
+	/* Matches what generation gives back, so there is nothing to save until it is edited */
+	next->version = next->saved_version = 0;
+	next->saving = false;
 	next->dirty_mask = OPAQUE_BIT;
-	next->opaque_buffer = graphics_buffer_create(NULL, 0, VERTEX_BLOCK);
-	next->liquid_buffer = graphics_buffer_create(NULL, 0, VERTEX_BLOCK);
-
-	next->generating = false;
+	next->opaque_range = next->liquid_range = (arena_range_t){ 0 };
+	next->ticks = NULL;
+	next->meta = NULL;
+	next->water_active = 0;
+	next->random_counted = false;
+	next->light = NULL;
 	return next;
 }
 
 struct chunk* world_chunk_add(int x, int z, block_type_t chunk[CHUNK_BLOCK_COUNT])
 {
+	/* A loaded chunk is newer than any copy of it, so it is never replaced */
 	if (world_chunk_get(x, z))
 	{
-		world_chunk_remove(x, z);
+		return world_chunk_get(x, z);
 	}
 
 	int res = mc_list_add(chunk_list, mc_list_count(chunk_list), NULL, sizeof(struct chunk));
@@ -291,27 +323,90 @@ struct chunk* world_chunk_add(int x, int z, block_type_t chunk[CHUNK_BLOCK_COUNT
 	next->x = ROUND_DOWN(x, CHUNK_WX);
 	next->z = ROUND_DOWN(z, CHUNK_WZ);
 
-	memcpy(next->arr, chunk, sizeof * chunk * CHUNK_BLOCK_COUNT);
+	if (chunk)
+	{
+		memcpy(next->arr, chunk, sizeof * chunk * CHUNK_BLOCK_COUNT);
+	}
 
+	/* Chunks are only added from disk or the cold cache, so this already matches what is saved. The cache marks its edited chunks itself. */
+	next->version = next->saved_version = 0;
+	next->saving = false;
 	next->dirty_mask = OPAQUE_BIT;
-	next->opaque_buffer = graphics_buffer_create(NULL, 0, VERTEX_BLOCK);
-	next->liquid_buffer = graphics_buffer_create(NULL, 0, VERTEX_BLOCK);
+	next->opaque_range = next->liquid_range = (arena_range_t){ 0 };
+	next->ticks = NULL;
+	next->meta = NULL;
+	next->water_active = 0;
+	next->random_counted = false;
+	next->light = NULL;
 
 	return next;
 }
 
+void world_chunk_set_meta(struct chunk* chunk, int index, int meta)
+{
+	if (!chunk->meta)
+	{
+		if (meta == 0)
+		{
+			return;
+		}
+		chunk->meta = mc_malloc(CHUNK_META_SIZE);
+		memset(chunk->meta, 0, CHUNK_META_SIZE);
+	}
+	int shift = index % 2 * 4;
+	chunk->meta[index / 2] = (uint8_t)((chunk->meta[index / 2] & ~(0xF << shift)) | ((meta & 0xF) << shift));
+}
+
+void world_chunk_adopt_meta(struct chunk* chunk, const uint8_t* meta)
+{
+	free(chunk->meta);
+	chunk->meta = NULL;
+	if (!meta)
+	{
+		return;
+	}
+
+	/* Flowing water is saved mid-flow, so it has to pick up where it left off */
+	const int section_size = SECTION_BLOCK_COUNT / 2;
+	for (int section = 0; section < SECTION_COUNT; section++)
+	{
+		for (int i = section * section_size; i < (section + 1) * section_size; i++)
+		{
+			if (meta[i] != 0)
+			{
+				chunk->water_active |= 1U << section;
+				break;
+			}
+		}
+	}
+	if (chunk->water_active)
+	{
+		chunk->meta = mc_malloc(CHUNK_META_SIZE);
+		memcpy(chunk->meta, meta, CHUNK_META_SIZE);
+	}
+}
+
 void world_chunk_remove(int x, int z)
 {
 	x = ROUND_DOWN(x, CHUNK_WX);
 	z = ROUND_DOWN(z, CHUNK_WZ);
 	struct chunk* block_vertex_list = mc_list_array(chunk_list);
-	for (int i = 0; i < mc_list_count(chunk_list); i++)
+	int last = mc_list_count(chunk_list) - 1;
+	for (int i = 0; i <= last; i++)
 	{
 		if (block_vertex_list[i].x == x && block_vertex_list[i].z == z)
 		{
-			graphics_buffer_delete(&block_vertex_list[i].opaque_buffer);
-			graphics_buffer_delete(&block_vertex_list[i].liquid_buffer);
-			mc_list_remove(chunk_list, i, NULL, sizeof(struct chunk));
+			world_chunk_free_mesh(&block_vertex_list[i]);
+			world_tick_free(&block_vertex_list[i]);
+			world_light_free(&block_vertex_list[i]);
+			free(block_vertex_list[i].meta);
+
+			/* Chunks are far too big to shift the rest of the list down, so the last one takes this one's place. Nothing keeps indices across ticks. */
+			if (i != last)
+			{
+				memcpy(&block_vertex_list[i], &block_vertex_list[last], sizeof * block_vertex_list);
+			}
+			mc_list_splice(chunk_list, last, 1);
 			return;
 		}
 	}
@@ -351,13 +446,17 @@ static bool world_chunk_map_iterate(const hash_set_t set, void* value, void* use
 	struct iterate_state* state = (struct iterate_state*)user;
 	block_coords_t* to_load = (block_coords_t*)value;
 	
-	/* finding chunk creates it */
-	struct chunk* chunk = world_file_find_chunk(to_load->x, to_load->z);
+	/* finding chunk creates it. Whichever way it was found, it is loaded now and leaves the set. */
+	struct chunk* chunk = world_cache_find_chunk(to_load->x, to_load->z);
+	if (!chunk)
+	{
+		chunk = world_prefetch_find_chunk(to_load->x, to_load->z);
+	}
 	if (!chunk)
 	{
 		world_chunk_create(to_load->x, to_load->z);
-		state->arr[--state->left] = *to_load;
 	}
+	state->arr[--state->left] = *to_load;
 
 	world_chunk_make_dirty(world_chunk_get(to_load->x - CHUNK_WX, to_load->z), OPAQUE_BIT | LIQUID_BIT);
 	world_chunk_make_dirty(world_chunk_get(to_load->x + CHUNK_WX, to_load->z), OPAQUE_BIT | LIQUID_BIT);
@@ -367,12 +466,32 @@ static bool world_chunk_map_iterate(const hash_set_t set, void* value, void* use
 	return state->left > 0;
 }
 
+/* Moves chunks past EVICT_RADIUS from the player into the cold cache */
+static void world_chunk_evict(block_coords_t player_location)
+{
+	int evicted = 0;
+	for (int i = mc_list_count(chunk_list) - 1; i >= 0 && evicted < MAX_EVICTIONS_PER_TICK; i--)
+	{
+		struct chunk* chunk = MC_LIST_CAST_GET(chunk_list, i, struct chunk);
+		int dx = (chunk->x - player_location.x) / CHUNK_WX, dz = (chunk->z - player_location.z) / CHUNK_WZ;
+		if (dx >= -EVICT_RADIUS && dx < EVICT_RADIUS && dz >= -EVICT_RADIUS && dz < EVICT_RADIUS)
+		{
+			continue;
+		}
+		world_cache_store(chunk);
+		world_chunk_remove(chunk->x, chunk->z);
+		evicted++;
+	}
+}
+
 void world_chunk_update(void)
 {
 	block_coords_t player_location = vector_to_block_coords(aabb_get_center(player.hitbox));
 	player_location.x = ROUND_DOWN(player_location.x, CHUNK_WX);
 	player_location.z = ROUND_DOWN(player_location.z, CHUNK_WZ);
 	player_location.y = 0;
+	world_chunk_evict(player_location);
+	world_prefetch_update(player_location.x, player_location.z, player.velocity);
 	for (int i = -RADIUS; i < RADIUS; i++)
 	{
 		for (int j = -RADIUS; j < RADIUS; j++)
@@ -389,7 +508,7 @@ void world_chunk_update(void)
 	struct iterate_state state;
 	state.left = MAX_CHUNKS_PER_TICK;
 	mc_set_iterate(chunks_to_generate, world_chunk_map_iterate, &state);
-	for (int i = 0; i < MAX_CHUNKS_PER_TICK; i++)
+	for (int i = state.left; i < MAX_CHUNKS_PER_TICK; i++)
 	{
 		mc_set_remove(chunks_to_generate, &state.arr[i], sizeof state.arr[i]);
 	}
@@ -5,12 +5,26 @@
 
 #define WORLD_INTERNAL
 #include "world.h"
+#include "compress.h"
+#include "platform.h"
+#include "window.h"
 #include <stdint.h>
-#include <Windows.h>
 
 #define START_RADIUS 2
 #define WORLD_DIRECTORY "worlds"
 #define WORLD_FILE WORLD_DIRECTORY "/game.wrld"
+#define REGION_FORMAT WORLD_DIRECTORY "/r.%i.%i.rgn"
+#define REGION_TEMP_FORMAT REGION_FORMAT ".tmp"
+#define REGION_PATH_LENGTH 64
+
+#define REGION_CHUNKS		32	/* Regions are square, this many chunks on each side */
+#define REGION_CHUNK_COUNT	(REGION_CHUNKS * REGION_CHUNKS)
+#define SECTOR_SIZE			4096
+#define HEADER_SECTORS		((sizeof(struct region_entry) * REGION_CHUNK_COUNT + SECTOR_SIZE - 1) / SECTOR_SIZE)
+#define SECTORS_FOR(bytes)	(((bytes) + SECTOR_SIZE - 1) / SECTOR_SIZE)
+#define COMPACT_MIN_WASTE	16					/* Dead sectors a region needs, and at least a quarter of its records' worth, before it is worth rewriting */
+#define COMPACT_RATE		(4 * 1024 * 1024)	/* Most bytes a second the compactor copies, so it never fights the game for the disk */
+#define DELTA_MAX_SIZE		(SECTOR_SIZE - sizeof(struct file_chunk))	/* Deltas bigger than this are stored in full instead, keeping every delta record to one sector */
 
 struct file_header
 {
@@ -18,30 +32,356 @@ struct file_header
 	uint32_t seed;
 };
 
+#define FILE_CHUNK_META 1	/* The record's payload is followed by a file_meta and the chunk's metadata */
+
+/* Precedes every chunk record. The record's payload is "size" bytes of the chunk's blocks, encoded with "codec." */
 struct file_chunk
+{
+	int32_t x, z;
+	uint8_t codec;	/* codec_t */
+	uint8_t flags;	/* FILE_CHUNK_* bits */
+	uint16_t reserved;
+	uint32_t size;
+};
+
+/* A chunk in the format worlds were saved in before region files, stored whole one after another behind game.wrld's header */
+struct legacy_chunk
 {
 	int32_t x, z;
 	block_type_t blocks[CHUNK_BLOCK_COUNT];
 };
 
-static inline FILE* world_file_try_open_world(const char* mode)
+/* Follows the payload of records flagged FILE_CHUNK_META. "size" bytes of the chunk's metadata nibbles follow, encoded with "codec." */
+struct file_meta
+{
+	uint8_t codec;	/* codec_t */
+	uint8_t reserved[3];
+	uint32_t size;
+};
+
+/* Where a chunk's record lives in its region file. A sector of 0 means the chunk was never saved. */
+struct region_entry
+{
+	uint32_t sector, sector_count;
+};
+
+/* An open region file and its offset table. The table is kept in memory, so finding a chunk never reads more than the chunk. */
+struct region
+{
+	FILE* file;		/* NULL if the region has no file yet. Only used for writing. */
+	file_map_t map;	/* Read-only view of the file chunks are read from, remapped once records land past its end */
+	bool unflushed;	/* Has the file been written since it was last flushed? */
+	int x, z;		/* Region coordinates, in regions */
+	uint32_t end;	/* First sector past every record, where new records are appended */
+	unsigned int writes;	/* Bumped on every write, so the compactor can tell its copy went stale */
+	struct region_entry entries[REGION_CHUNK_COUNT];
+};
+
+static map_t regions;		/* struct region* map, keyed by world_file_region_key */
+static mutex_t region_lock;	/* Held while touching regions or their files, since both the game and the writer thread do */
+
+/* A chunk's blocks copied out of chunk_list, so the writer thread can save them while the game keeps editing the original */
+struct chunk_snapshot
+{
+	int x, z;
+	bool has_meta;
+	block_type_t arr[CHUNK_BLOCK_COUNT];
+	uint8_t meta[CHUNK_META_SIZE];
+};
+
+struct save_job
+{
+	struct file_header header;
+	array_list_t chunks; /* struct chunk_snapshot array_list */
+};
+
+static hash_set_t saved_chunks;	/* Coordinates of every chunk with a record on disk. Lookups for anything else skip the regions entirely. */
+static mutex_t index_lock;		/* Guards saved_chunks */
+
+static mutex_t save_lock;			/* Guards everything below */
+static cond_t save_cond;			/* Signalled when a job is handed over, a job finishes or the writer should quit */
+static thread_t writer;
+static struct save_job* pending;	/* Snapshot handed to the writer that it has not picked up yet */
+static bool saving, saved, writer_quit;	/* saved is set once a job is written, until the game marks its chunks saved */
+static int save_done, save_total;
+
+/* Creates the locks the first time the world's files are touched */
+static inline void world_file_start(void)
 {
-	FILE* file = fopen(WORLD_FILE, mode);
+	if (!region_lock)
+	{
+		region_lock = platform_mutex_create();
+		index_lock = platform_mutex_create();
+		save_lock = platform_mutex_create();
+		save_cond = platform_cond_create();
+		saved_chunks = mc_set_create(sizeof(int32_t) * 2);
+	}
+}
+
+/* Marks whether the chunk at block coordinates (x, z) has a record on disk */
+static void world_file_index_set(int x, int z, bool saved)
+{
+	int32_t coords[2] = { ROUND_DOWN(x, CHUNK_WX), ROUND_DOWN(z, CHUNK_WZ) };
+	platform_mutex_lock(index_lock);
+	if (saved)
+	{
+		mc_set_add(saved_chunks, coords, sizeof coords);
+	}
+	else
+	{
+		mc_set_remove(saved_chunks, coords, sizeof coords);
+	}
+	platform_mutex_unlock(index_lock);
+}
+
+static bool world_file_index_has(int x, int z)
+{
+	int32_t coords[2] = { ROUND_DOWN(x, CHUNK_WX), ROUND_DOWN(z, CHUNK_WZ) };
+	platform_mutex_lock(index_lock);
+	bool result = mc_set_has(saved_chunks, coords, sizeof coords);
+	platform_mutex_unlock(index_lock);
+	return result;
+}
+
+static inline FILE* world_file_try_open(const char* path, const char* mode)
+{
+	FILE* file = fopen(path, mode);
 	if (file)
 	{
 		/* either created file or opened pre-existing file */
 		return file;
 	}
 	/* directory doesn't exist */
-	mc_panic_if(!CreateDirectoryA(WORLD_DIRECTORY, NULL), "Failed to create worlds directory");
-	return fopen(WORLD_FILE, mode);
+	mc_panic_if(!platform_directory_create(WORLD_DIRECTORY), "Failed to create worlds directory");
+	return fopen(path, mode);
+}
+
+static inline hash_t world_file_region_key(int rx, int rz)
+{
+	int32_t coords[2] = { rx, rz };
+	return mc_hash(coords, sizeof coords);
+}
+
+static inline void world_file_region_path(const struct region* region, char path[REGION_PATH_LENGTH])
+{
+	snprintf(path, REGION_PATH_LENGTH, REGION_FORMAT, region->x, region->z);
+}
+
+/*	Makes sure the region's mapping covers its first "needed" bytes and shows every write made so far, mapping the file again if it has grown.
+	Call before any read through the mapping. Returns false if the file is shorter than that. */
+static bool world_file_region_map(struct region* region, size_t needed)
+{
+	/* Writes still sitting in the FILE's buffer are invisible to the mapping, records rewritten in place included */
+	if (region->unflushed)
+	{
+		fflush(region->file);
+		region->unflushed = false;
+	}
+	if (region->map && platform_file_map_size(region->map) >= needed)
+	{
+		return true;
+	}
+
+	char path[REGION_PATH_LENGTH];
+	world_file_region_path(region, path);
+	platform_file_unmap(&region->map);
+	region->map = platform_file_map(path);
+	return region->map && platform_file_map_size(region->map) >= needed;
+}
+
+/* Gets the region holding the chunk at block coordinates (x, z). When create is true, the region's file is made if it does not exist yet. */
+static struct region* world_file_region(int x, int z, bool create)
+{
+	int rx = ROUND_DOWN(ROUND_DOWN(x, CHUNK_WX) / CHUNK_WX, REGION_CHUNKS) / REGION_CHUNKS,
+		rz = ROUND_DOWN(ROUND_DOWN(z, CHUNK_WZ) / CHUNK_WZ, REGION_CHUNKS) / REGION_CHUNKS;
+
+	if (!regions)
+	{
+		regions = mc_map_create(sizeof(struct region*));
+	}
+
+	hash_t key = world_file_region_key(rx, rz);
+	struct region* region = NULL;
+	if (!mc_map_get(regions, key, &region, sizeof region))
+	{
+		region = mc_malloc(sizeof * region);
+		memset(region, 0, sizeof * region);
+		region->x = rx;
+		region->z = rz;
+		region->end = HEADER_SECTORS;
+
+		char path[REGION_PATH_LENGTH];
+		world_file_region_path(region, path);
+		region->file = fopen(path, "rb+");
+		if (region->file)
+		{
+			fread(region->entries, sizeof region->entries, 1, region->file);
+			for (int i = 0; i < REGION_CHUNK_COUNT; i++)
+			{
+				if (region->entries[i].sector != 0)
+				{
+					region->end = max(region->end, region->entries[i].sector + region->entries[i].sector_count);
+				}
+			}
+		}
+		mc_map_add(regions, key, &region, sizeof region);
+	}
+
+	if (create && !region->file)
+	{
+		char path[REGION_PATH_LENGTH];
+		world_file_region_path(region, path);
+		region->file = world_file_try_open(path, "wb+");
+		mc_panic_if(!region->file, "Failed to create region file");
+		fwrite(region->entries, sizeof region->entries, 1, region->file);
+	}
+	return region;
+}
+
+static inline int world_file_region_index(const struct region* region, int x, int z)
+{
+	int cx = ROUND_DOWN(x, CHUNK_WX) / CHUNK_WX - region->x * REGION_CHUNKS,
+		cz = ROUND_DOWN(z, CHUNK_WZ) / CHUNK_WZ - region->z * REGION_CHUNKS;
+	assert(cx >= 0 && cx < REGION_CHUNKS && cz >= 0 && cz < REGION_CHUNKS);
+	return cz * REGION_CHUNKS + cx;
+}
+
+/*	Copies the header of the record "entry" points to into record and returns the record's size, metadata included.
+	Returns 0 if there is no record or it runs past its sectors or the file. Call with region_lock held. */
+static size_t world_file_record_size(struct region* region, const struct region_entry* entry, struct file_chunk* record)
+{
+	size_t offset = (size_t)entry->sector * SECTOR_SIZE, size = sizeof * record;
+	if (!region->file || entry->sector == 0 || !world_file_region_map(region, offset + size))
+	{
+		return 0;
+	}
+	memcpy(record, platform_file_map_data(region->map) + offset, sizeof * record);
+	size += record->size;
+	if (record->flags & FILE_CHUNK_META)
+	{
+		struct file_meta meta;
+		if (!world_file_region_map(region, offset + size + sizeof meta))
+		{
+			return 0;
+		}
+		memcpy(&meta, platform_file_map_data(region->map) + offset + size, sizeof meta);
+		size += sizeof meta + meta.size;
+	}
+	return size <= (size_t)entry->sector_count * SECTOR_SIZE && world_file_region_map(region, offset + size) ? size : 0;
+}
+
+static bool world_file_close_region(const map_t map, hash_t key, void* value, void* user)
+{
+	struct region* region = *(struct region**)value;
+	platform_file_unmap(&region->map);
+	if (region->file)
+	{
+		fclose(region->file);
+	}
+	free(region);
+	return true;
+}
+
+void world_file_close(void)
+{
+	if (!region_lock)
+	{
+		return;
+	}
+
+	world_prefetch_stop();
+	if (writer)
+	{
+		/* The writer finishes a job it was handed before it sees the quit */
+		platform_mutex_lock(save_lock);
+		writer_quit = true;
+		platform_cond_broadcast(save_cond);
+		platform_mutex_unlock(save_lock);
+		platform_thread_join(&writer);
+		writer_quit = false;
+	}
+
+	if (regions)
+	{
+		mc_map_iterate(regions, world_file_close_region, NULL);
+		mc_map_destroy(&regions);
+	}
+	mc_set_destroy(&saved_chunks);
+	platform_cond_delete(&save_cond);
+	platform_mutex_delete(&save_lock);
+	platform_mutex_delete(&index_lock);
+	platform_mutex_delete(&region_lock);
+	world_journal_close();
+}
+
+static bool world_file_flush_region(const map_t map, hash_t key, void* value, void* user)
+{
+	struct region* region = *(struct region**)value;
+	if (region->file)
+	{
+		platform_file_sync(region->file);
+		region->unflushed = false;
+	}
+	return true;
+}
+
+/* Calls func with the file name of every region file in the world directory */
+static inline void world_file_for_each_region(file_list_func_t func)
+{
+	platform_directory_list(WORLD_DIRECTORY, ".rgn", func, NULL);
+}
+
+/* Adds every chunk the region file called name has a record for to saved_chunks */
+static void world_file_index_region(const char* name, void* user)
+{
+	int rx, rz;
+	if (sscanf(name, "r.%i.%i.rgn", &rx, &rz) != 2)
+	{
+		return;
+	}
+
+	platform_mutex_lock(region_lock);
+	struct region* region = world_file_region(rx * REGION_CHUNKS * CHUNK_WX, rz * REGION_CHUNKS * CHUNK_WZ, false);
+	for (int i = 0; i < REGION_CHUNK_COUNT; i++)
+	{
+		if (region->entries[i].sector != 0)
+		{
+			world_file_index_set((rx * REGION_CHUNKS + i % REGION_CHUNKS) * CHUNK_WX, (rz * REGION_CHUNKS + i / REGION_CHUNKS) * CHUNK_WZ, true);
+		}
+	}
+	platform_mutex_unlock(region_lock);
+}
+
+static void world_file_delete_region(const char* name, void* user)
+{
+	int rx, rz;
+	char path[REGION_PATH_LENGTH];
+	if (sscanf(name, "r.%i.%i.rgn", &rx, &rz) == 2)
+	{
+		snprintf(path, sizeof path, REGION_FORMAT, rx, rz);
+		mc_panic_if(!platform_file_delete(path), "Failed to delete region file");
+	}
+}
+
+static void world_file_import_legacy(const struct file_header* header);
+
+static bool world_file_load_header(struct file_header* header)
+{
+	FILE* file = fopen(WORLD_FILE, "rb");
+	if (!file)
+	{
+		return false;
+	}
+	bool result = fread(header, sizeof * header, 1, file) == 1;
+	fclose(file);
+	return result;
 }
 
 void world_file_load_world(unsigned int fallback_seed)
 {
-	long size;
-	char* world = mc_read_file_binary("worlds/game.wrld", &size);
-	if (!world)
+	world_file_start();
+	struct file_header header;
+	if (!world_file_load_header(&header))
 	{
 		printf("No world exists, creating new one...\n");
 		world_chunk_init(fallback_seed);
@@ -54,7 +394,11 @@ void world_file_load_world(unsigned int fallback_seed)
 		}
 
 		block_coords_t spawn = { 0, CHUNK_WY - 1, 0 };
-		for (; world_block_get(spawn) == BLOCK_AIR; spawn.y--);
+		block_cursor_t cursor = world_cursor_create(spawn);
+		for (; world_cursor_get(&cursor, 0, 0, 0) == BLOCK_AIR; world_cursor_move(&cursor, spawn))
+		{
+			spawn.y--;
+		}
 		spawn.y += 2;
 		player.hitbox = aabb_set_center(player.hitbox, block_coords_to_vector(spawn));
 
@@ -63,123 +407,710 @@ void world_file_load_world(unsigned int fallback_seed)
 	}
 
 	printf("Opening pre-existing world...\n");
-	struct file_header* header = (struct file_header*)world;
-	struct file_chunk* chunks = (struct file_chunk*)(header + 1);
-	int chunk_count = (size - sizeof(struct file_header)) / sizeof(struct file_chunk);
+	world_chunk_init(header.seed);
+	world_file_import_legacy(&header);
+	world_file_for_each_region(world_file_index_region);
+	player.hitbox = aabb_set_center(player.hitbox, block_coords_to_vector((block_coords_t) { header.player_x, header.player_y, header.player_z }));
+	world_journal_replay();
+
+	int px = ROUND_DOWN(header.player_x, CHUNK_WX),
+		pz = ROUND_DOWN(header.player_z, CHUNK_WZ);
+	for (int i = -RADIUS; i < RADIUS; i++)
+	{
+		for (int j = -RADIUS; j < RADIUS; j++)
+		{
+			world_file_find_chunk(px + i * CHUNK_WX, pz + j * CHUNK_WZ);
+		}
+	}
+}
+
+size_t world_file_encode_blocks(const block_type_t* arr, uint8_t* dst, size_t dst_len, codec_t* codec)
+{
+	uint8_t* columns = mc_malloc(CHUNK_BLOCK_COUNT);
+	for (int i = 0; i < CHUNK_BLOCK_COUNT; i++)
+	{
+		columns[(CHUNK_Z(i) * CHUNK_WX + CHUNK_X(i)) * CHUNK_WY + CHUNK_Y(i)] = arr[i];
+	}
+	size_t size = compress_encode(CODEC_RLE_LZ, columns, CHUNK_BLOCK_COUNT, dst, dst_len);
+	free(columns);
+
+	*codec = CODEC_RLE_LZ;
+	if (size == 0 || size >= CHUNK_BLOCK_COUNT)
+	{
+		*codec = CODEC_RAW;
+		size = compress_encode(CODEC_RAW, arr, CHUNK_BLOCK_COUNT, dst, dst_len);
+	}
+	return size;
+}
+
+bool world_file_decode_blocks(codec_t codec, const uint8_t* src, size_t len, block_type_t arr[CHUNK_BLOCK_COUNT])
+{
+	if (codec == CODEC_RAW)
+	{
+		return compress_decode(CODEC_RAW, src, len, arr, CHUNK_BLOCK_COUNT) == CHUNK_BLOCK_COUNT;
+	}
+
+	uint8_t* columns = mc_malloc(CHUNK_BLOCK_COUNT);
+	bool result = compress_decode(codec, src, len, columns, CHUNK_BLOCK_COUNT) == CHUNK_BLOCK_COUNT;
+	for (int i = 0; result && i < CHUNK_BLOCK_COUNT; i++)
+	{
+		arr[i] = columns[(CHUNK_Z(i) * CHUNK_WX + CHUNK_X(i)) * CHUNK_WY + CHUNK_Y(i)];
+	}
+	free(columns);
+	return result;
+}
+
+/*	Encodes a chunk's blocks into a record payload at dst, which must hold compress_bound(CHUNK_BLOCK_COUNT) bytes. "generated" is what generation
+	gives back for the chunk, and if the blocks differ from it in few enough places only those are stored. Otherwise they are stored in full. */
+static size_t world_file_encode_chunk(const block_type_t* arr, const block_type_t* generated, uint8_t* dst, size_t dst_len, codec_t* codec)
+{
+	size_t size = compress_delta_encode(generated, arr, CHUNK_BLOCK_COUNT, dst, min(dst_len, DELTA_MAX_SIZE));
+	if (size != 0)
+	{
+		*codec = CODEC_DELTA;
+		return size;
+	}
+	return world_file_encode_blocks(arr, dst, dst_len, codec);
+}
+
+/* Decodes a record payload into blocks. Delta records regenerate the chunk first and apply the payload over it. Returns false if the payload is corrupt. */
+static bool world_file_decode_chunk(const struct file_chunk* record, const uint8_t* payload, block_type_t blocks[CHUNK_BLOCK_COUNT])
+{
+	if (record->codec == CODEC_DELTA)
+	{
+		world_chunk_generate(record->x, record->z, blocks);
+		return compress_delta_decode(payload, record->size, blocks, CHUNK_BLOCK_COUNT);
+	}
+	return world_file_decode_blocks(record->codec, payload, record->size, blocks);
+}
+
+/* Forgets the chunk at (x, z)'s record, so loading it falls back to generating it */
+static void world_file_drop_chunk(int x, int z)
+{
+	platform_mutex_lock(region_lock);
+	struct region* region = world_file_region(x, z, false);
+	int index = world_file_region_index(region, x, z);
+	struct region_entry* entry = &region->entries[index];
+	if (entry->sector != 0)
+	{
+		*entry = (struct region_entry){ 0 };
+		fseek(region->file, index * sizeof * entry, SEEK_SET);
+		fwrite(entry, sizeof * entry, 1, region->file);
+		region->unflushed = true;
+		region->writes++;
+	}
+	platform_mutex_unlock(region_lock);
+	world_file_index_set(x, z, false);
+}
+
+/*	Writes the record for the chunk at (x, z) into its region. Rewrites it in place if the new record fits in its old sectors, otherwise appends it.
+	Chunks that are exactly what generation gives back are not stored at all, and ones close to it only store where they differ. Safe to call from any thread. Returns the size of the record in bytes. */
+static size_t world_file_save_chunk_internal(int x, int z, const block_type_t* arr, const uint8_t* meta)
+{
+	block_type_t* generated = mc_malloc(CHUNK_BLOCK_COUNT * sizeof * generated);
+	world_chunk_generate(x, z, generated);
+	if (!meta && memcmp(generated, arr, CHUNK_BLOCK_COUNT * sizeof * generated) == 0)
+	{
+		free(generated);
+		world_file_drop_chunk(x, z);
+		return 0;
+	}
 
-	world_chunk_init(header->seed);
+	size_t bound = compress_bound(CHUNK_BLOCK_COUNT);
+	uint8_t* payload = mc_malloc(bound);
+	codec_t codec;
+	struct file_chunk record = { .x = x, .z = z };
+	record.size = (uint32_t)world_file_encode_chunk(arr, generated, payload, bound, &codec);
+	record.codec = (uint8_t)codec;
+	free(generated);
 
-	for (int i = 0; i < chunk_count; i++)
+	struct file_meta meta_record = { 0 };
+	uint8_t* meta_payload = NULL;
+	if (meta)
 	{
-		if (chunks[i].x - RADIUS_BLOCKS < header->player_x && chunks[i].x + RADIUS_BLOCKS > header->player_x &&
-			chunks[i].z - RADIUS_BLOCKS < header->player_z && chunks[i].z + RADIUS_BLOCKS > header->player_z)
+		record.flags |= FILE_CHUNK_META;
+		meta_payload = mc_malloc(compress_bound(CHUNK_META_SIZE));
+		meta_record.codec = CODEC_RLE_LZ;
+		meta_record.size = (uint32_t)compress_encode(CODEC_RLE_LZ, meta, CHUNK_META_SIZE, meta_payload, compress_bound(CHUNK_META_SIZE));
+		if (meta_record.size == 0 || meta_record.size >= CHUNK_META_SIZE)
 		{
-			world_chunk_add(chunks[i].x, chunks[i].z, chunks[i].blocks);
+			meta_record.codec = CODEC_RAW;
+			meta_record.size = (uint32_t)compress_encode(CODEC_RAW, meta, CHUNK_META_SIZE, meta_payload, compress_bound(CHUNK_META_SIZE));
 		}
 	}
-	
-	player.hitbox = aabb_set_center(player.hitbox, block_coords_to_vector((block_coords_t) { header->player_x, header->player_y, header->player_z }));
+	size_t total = sizeof record + record.size + (meta ? sizeof meta_record + meta_record.size : 0);
+
+	platform_mutex_lock(region_lock);
+	struct region* region = world_file_region(x, z, true);
+	int index = world_file_region_index(region, x, z);
+	struct region_entry* entry = &region->entries[index];
 
-	free(world);
+	uint32_t needed = SECTORS_FOR(total);
+	if (entry->sector == 0 || entry->sector_count < needed)
+	{
+		entry->sector = region->end;
+		entry->sector_count = needed;
+		region->end += needed;
+
+		fseek(region->file, index * sizeof * entry, SEEK_SET);
+		fwrite(entry, sizeof * entry, 1, region->file);
+	}
+
+	fseek(region->file, (long)entry->sector * SECTOR_SIZE, SEEK_SET);
+	fwrite(&record, sizeof record, 1, region->file);
+	fwrite(payload, record.size, 1, region->file);
+	if (meta)
+	{
+		fwrite(&meta_record, sizeof meta_record, 1, region->file);
+		fwrite(meta_payload, meta_record.size, 1, region->file);
+	}
+	region->unflushed = true;
+	region->writes++;
+	platform_mutex_unlock(region_lock);
+	world_file_index_set(x, z, true);
+
+	free(meta_payload);
+	free(payload);
+	return total;
 }
 
-static void world_file_save_chunk_internal(FILE* file, int x, int z)
+static void world_file_flush(void)
 {
-	struct chunk* chunk = world_chunk_get(x, z);
-	assert(chunk);
-	x = ROUND_DOWN(x, CHUNK_WX);
-	z = ROUND_DOWN(z, CHUNK_WZ);
-	fseek(file, sizeof(struct file_header), SEEK_SET);
-	while (fgetc(file) != EOF)
+	platform_mutex_lock(region_lock);
+	if (regions)
 	{
-		int cx = -1, cz = -1;
-		fread(&cx, 1, sizeof cx, file);
-		fread(&cz, 1, sizeof cz, file);
-		if (cx == x && cz == z)
+		mc_map_iterate(regions, world_file_flush_region, NULL);
+	}
+	platform_mutex_unlock(region_lock);
+}
+
+static void world_file_save_header(const struct file_header* header)
+{
+	FILE* file = world_file_try_open(WORLD_FILE, "wb");
+	mc_panic_if(!file, "Failed to save world");
+
+	fwrite(header, sizeof * header, 1, file);
+	fclose(file);
+}
+
+/*	Moves the chunks of a world saved in the old format into region files, then rewrites game.wrld as just its header so this only
+	happens once. Stopping partway imports them again next time, which is harmless. Call after world_chunk_init, deltas need the seed. */
+static void world_file_import_legacy(const struct file_header* header)
+{
+	FILE* file = fopen(WORLD_FILE, "rb");
+	if (!file)
+	{
+		return;
+	}
+
+	/* Later records of the same chunk were saved later, so they win */
+	struct legacy_chunk* legacy = mc_malloc(sizeof * legacy);
+	int count = 0;
+	fseek(file, sizeof * header, SEEK_SET);
+	while (fread(legacy, sizeof * legacy, 1, file) == 1)
+	{
+		world_file_save_chunk_internal(legacy->x, legacy->z, legacy->blocks, NULL);
+		count++;
+	}
+	free(legacy);
+	fclose(file);
+
+	if (count > 0)
+	{
+		world_file_flush();
+		world_file_save_header(header);
+		printf("Imported %i chunks from the old world format\n", count);
+	}
+}
+
+static inline struct file_header world_file_current_header(void)
+{
+	block_coords_t rounded_pos = vector_to_block_coords(aabb_get_center(player.hitbox));
+	return (struct file_header) { rounded_pos.x, rounded_pos.y, rounded_pos.z, world_seed() };
+}
+
+static void world_file_snapshot_blocks(int x, int z, const block_type_t* arr, const uint8_t* meta, void* user)
+{
+	struct save_job* job = user;
+	int index = mc_list_add(job->chunks, mc_list_count(job->chunks), NULL, sizeof(struct chunk_snapshot));
+	struct chunk_snapshot* snapshot = MC_LIST_CAST_GET(job->chunks, index, struct chunk_snapshot);
+	snapshot->x = x;
+	snapshot->z = z;
+	snapshot->has_meta = meta != NULL;
+	memcpy(snapshot->arr, arr, sizeof snapshot->arr);
+	if (meta)
+	{
+		memcpy(snapshot->meta, meta, sizeof snapshot->meta);
+	}
+}
+
+/*	Copies every chunk edited since it was last saved into a save job, including edited chunks in the cold cache. They are only marked
+	saved by world_file_saved once the job is written, so until then they stay dirty and the cold cache keeps them. */
+static struct save_job* world_file_snapshot(void)
+{
+	struct save_job* job = mc_malloc(sizeof * job);
+	job->header = world_file_current_header();
+	job->chunks = mc_list_create(sizeof(struct chunk_snapshot));
+	struct chunk* chunks = mc_list_array(chunk_list);
+	for (int i = 0; i < mc_list_count(chunk_list); i++)
+	{
+		if (chunks[i].version == chunks[i].saved_version)
 		{
-			fseek(file, 0, SEEK_CUR);
-			fwrite(chunk->arr, 1, sizeof chunk->arr, file);
+			continue;
 		}
-		fseek(file, CHUNK_BLOCK_COUNT * sizeof(block_type_t), SEEK_CUR);
+		world_file_snapshot_blocks(chunks[i].x, chunks[i].z, chunks[i].arr, chunks[i].meta, job);
+		chunks[i].saving = true;
+		chunks[i].saving_version = chunks[i].version;
+	}
+	world_cache_save_dirty(world_file_snapshot_blocks, job);
+	return job;
+}
+
+/* Marks the chunks the last snapshot copied as saved. Chunks edited since then are still ahead of what was saved. */
+static void world_file_saved(void)
+{
+	struct chunk* chunks = mc_list_array(chunk_list);
+	for (int i = 0; i < mc_list_count(chunk_list); i++)
+	{
+		if (chunks[i].saving)
+		{
+			chunks[i].saved_version = chunks[i].saving_version;
+			chunks[i].saving = false;
+		}
+	}
+	world_cache_saved();
+}
+
+static void world_file_write_job(struct save_job* job)
+{
+	double start = window_time();
+	world_file_save_header(&job->header);
+
+	size_t written = 0;
+	int count = mc_list_count(job->chunks), pristine = 0;
+	struct chunk_snapshot* chunks = mc_list_array(job->chunks);
+	for (int i = 0; i < count; i++)
+	{
+		size_t size = world_file_save_chunk_internal(chunks[i].x, chunks[i].z, chunks[i].arr, chunks[i].has_meta ? chunks[i].meta : NULL);
+		written += size;
+		pristine += size == 0;
+
+		platform_mutex_lock(save_lock);
+		save_done = i + 1;
+		platform_mutex_unlock(save_lock);
+	}
+	world_file_flush();
+
+	printf("Saved %i edited chunks (%i matched generation) in %.2f seconds, %zu KiB (%zu KiB uncompressed)\n", count - pristine, pristine,
+		window_time() - start, written / 1024, (size_t)(count - pristine) * CHUNK_BLOCK_COUNT / 1024);
+}
+
+/* Gets the sectors in region no record uses. Call with region_lock held. */
+static uint32_t world_file_region_waste(const struct region* region)
+{
+	uint32_t used = HEADER_SECTORS;
+	for (int i = 0; i < REGION_CHUNK_COUNT; i++)
+	{
+		used += region->entries[i].sector != 0 ? region->entries[i].sector_count : 0;
 	}
-	fseek(file, 0, SEEK_CUR);
-	fwrite(&x, 1, sizeof x, file);
-	fwrite(&z, 1, sizeof z, file);
-	fwrite(chunk->arr, 1, sizeof chunk->arr, file);
+	return region->end - used;
+}
+
+struct compact_search
+{
+	struct region* region;
+	uint32_t waste;
+};
+
+static bool world_file_find_fragmented(const map_t map, hash_t key, void* value, void* user)
+{
+	struct region* region = *(struct region**)value;
+	struct compact_search* search = user;
+	uint32_t waste = world_file_region_waste(region);
+	if (region->file && waste >= COMPACT_MIN_WASTE && waste * 4 >= region->end - HEADER_SECTORS - waste && waste > search->waste)
+	{
+		search->region = region;
+		search->waste = waste;
+	}
+	return true;
+}
+
+/* Converts a Morton code, the bits of x and z interleaved, back to an index into a region's entries */
+static inline int world_file_morton_index(int code)
+{
+	int cx = 0, cz = 0;
+	for (int bit = 0; (1 << bit) < REGION_CHUNKS; bit++)
+	{
+		cx |= ((code >> (bit * 2)) & 1) << bit;
+		cz |= ((code >> (bit * 2 + 1)) & 1) << bit;
+	}
+	return cz * REGION_CHUNKS + cx;
+}
+
+/* Returns whether the writer has a save to get to or should quit */
+static bool world_file_compact_interrupted(void)
+{
+	platform_mutex_lock(save_lock);
+	bool result = pending || writer_quit;
+	platform_mutex_unlock(save_lock);
+	return result;
 }
 
-static void world_file_save_header(FILE* file, block_coords_t rounded_pos, uint32_t seed)
+/*	Rewrites region into a temporary file with its records packed back to back in Morton order of their chunk coordinates, so chunks near
+	each other sit near each other on disk, then swaps it in for the original. Copies one record at a time without holding region_lock
+	in between, at no more than COMPACT_RATE. Gives up if the region is written to meanwhile or the writer is needed. Returns whether it swapped. */
+static bool world_file_compact_region(struct region* region)
 {
+	char path[REGION_PATH_LENGTH], temp[REGION_PATH_LENGTH];
+	platform_mutex_lock(region_lock);
+	world_file_region_path(region, path);
+	snprintf(temp, sizeof temp, REGION_TEMP_FORMAT, region->x, region->z);
+	unsigned int writes = region->writes;
+	uint32_t old_end = region->end;
+	if (region->unflushed)
+	{
+		fflush(region->file);
+		region->unflushed = false;
+	}
+	platform_mutex_unlock(region_lock);
+
+	FILE* file = fopen(temp, "wb");
+	if (!file)
+	{
+		return false;
+	}
+
+	double start = window_time();
+	struct region_entry* entries = mc_malloc(sizeof region->entries);
+	memset(entries, 0, sizeof region->entries);
+	uint32_t end = HEADER_SECTORS;
+	size_t copied = 0;
+	bool stale = false;
+	for (int code = 0; code < REGION_CHUNK_COUNT && !stale; code++)
+	{
+		int index = world_file_morton_index(code);
+		uint8_t* record = NULL;
+		size_t size = 0;
+
+		/* Records that cannot be read are left behind, loading them would fail all the same */
+		platform_mutex_lock(region_lock);
+		struct file_chunk header;
+		stale = region->writes != writes;
+		size = stale ? 0 : world_file_record_size(region, &region->entries[index], &header);
+		if (size)
+		{
+			record = mc_malloc(size);
+			memcpy(record, platform_file_map_data(region->map) + (size_t)region->entries[index].sector * SECTOR_SIZE, size);
+		}
+		platform_mutex_unlock(region_lock);
+		if (!record)
+		{
+			continue;
+		}
+
+		entries[index] = (struct region_entry){ end, SECTORS_FOR(size) };
+		fseek(file, (long)end * SECTOR_SIZE, SEEK_SET);
+		fwrite(record, size, 1, file);
+		end += entries[index].sector_count;
+		free(record);
+
+		/* Sleeps off however far the copy has gotten ahead of COMPACT_RATE */
+		copied += size;
+		double ahead = (double)copied / COMPACT_RATE - (window_time() - start);
+		if (ahead > 0.0)
+		{
+			platform_sleep((int)(ahead * 1000.0));
+		}
+		stale = stale || world_file_compact_interrupted();
+	}
+
 	fseek(file, 0, SEEK_SET);
-	fwrite(&rounded_pos.x, 1, sizeof rounded_pos.x, file);
-	fwrite(&rounded_pos.y, 1, sizeof rounded_pos.y, file);
-	fwrite(&rounded_pos.z, 1, sizeof rounded_pos.z, file);
-	fwrite(&seed, 1, sizeof seed, file);
+	fwrite(entries, sizeof region->entries, 1, file);
+	platform_file_sync(file);
+	fclose(file);
+
+	bool swapped = false;
+	platform_mutex_lock(region_lock);
+	if (!stale && region->writes == writes)
+	{
+		/* The original has to be closed before it can be replaced */
+		platform_file_unmap(&region->map);
+		fclose(region->file);
+		swapped = platform_file_replace(temp, path);
+		region->file = fopen(path, "rb+");
+		mc_panic_if(!region->file, "Failed to reopen region file after compacting it");
+		if (swapped)
+		{
+			memcpy(region->entries, entries, sizeof region->entries);
+			region->end = end;
+		}
+	}
+	platform_mutex_unlock(region_lock);
+
+	if (swapped)
+	{
+		printf("Compacted region (%i, %i) from %u to %u sectors in %.2f seconds\n", region->x, region->z, old_end, end, window_time() - start);
+	}
+	else if (!platform_file_delete(temp))
+	{
+		printf("Failed to delete %s, it is left over from an abandoned compaction\n", temp);
+	}
+	free(entries);
+	return swapped;
+}
+
+/* Compacts the most fragmented regions one after another, until none are worth it or the writer is needed */
+static void world_file_compact(void)
+{
+	while (!world_file_compact_interrupted())
+	{
+		struct compact_search search = { 0 };
+		platform_mutex_lock(region_lock);
+		if (regions)
+		{
+			mc_map_iterate(regions, world_file_find_fragmented, &search);
+		}
+		platform_mutex_unlock(region_lock);
+		if (!search.region || !world_file_compact_region(search.region))
+		{
+			return;
+		}
+	}
+}
+
+static void world_file_writer(void* user)
+{
+	platform_mutex_lock(save_lock);
+	while (true)
+	{
+		while (!pending && !writer_quit)
+		{
+			platform_cond_wait(save_cond, save_lock);
+		}
+		if (!pending)
+		{
+			break;
+		}
+
+		struct save_job* job = pending;
+		pending = NULL;
+		saving = true;
+		save_done = 0;
+		save_total = mc_list_count(job->chunks);
+		platform_mutex_unlock(save_lock);
+
+		world_file_write_job(job);
+		world_journal_checkpoint_done();
+		mc_list_destroy(&job->chunks);
+		free(job);
+
+		platform_mutex_lock(save_lock);
+		saving = false;
+		saved = true;
+		platform_cond_broadcast(save_cond);
+		platform_mutex_unlock(save_lock);
+
+		/* Tidies up what the save left behind while there is nothing else to do */
+		world_file_compact();
+		platform_mutex_lock(save_lock);
+	}
+	platform_mutex_unlock(save_lock);
+}
+
+/* Blocks until the writer thread has nothing left to save */
+static void world_file_wait(void)
+{
+	platform_mutex_lock(save_lock);
+	while (pending || saving)
+	{
+		platform_cond_wait(save_cond, save_lock);
+	}
+	platform_mutex_unlock(save_lock);
 }
 
 void world_file_save_chunk(int x, int z)
 {
-#pragma warning( push )
-#pragma warning( disable : 6387)
-	FILE* file = world_file_try_open_world("ab+");
-	mc_panic_if(!file, "Failed to save chunk");
+	world_file_start();
+	struct chunk* chunk = world_chunk_get(x, z);
+	assert(chunk);
+	world_file_save_chunk_internal(chunk->x, chunk->z, chunk->arr, chunk->meta);
+	chunk->saved_version = chunk->version;
+	world_file_flush();
+}
 
-	world_file_save_chunk_internal(file, x, z);
+void world_file_update(void)
+{
+	if (!save_lock)
+	{
+		return;
+	}
 
-	fclose(file);
-#pragma warning( pop ) 
+	platform_mutex_lock(save_lock);
+	bool finished = saved;
+	saved = false;
+	platform_mutex_unlock(save_lock);
+	if (finished)
+	{
+		world_file_saved();
+	}
 }
 
 void world_file_save_current(void)
 {
-#pragma warning( push )
-#pragma warning( disable : 6387)
 	printf("Saving current world...\n");
+	world_file_start();
+	world_file_wait();
+	world_file_update();
 
-	FILE* file = world_file_try_open_world("ab+");
-	mc_panic_if(!file, "Failed to save chunk");
+	struct save_job* job = world_file_snapshot();
+	world_file_write_job(job);
+	world_file_saved();
+	world_journal_truncate();
+	mc_list_destroy(&job->chunks);
+	free(job);
+}
 
-	world_file_save_header(file, vector_to_block_coords(aabb_get_center(player.hitbox)), world_seed());
-	struct chunk* chunks = mc_list_array(chunk_list);
-	for (int i = 0; i < mc_list_count(chunk_list); i++)
+void world_file_save_async(void)
+{
+	world_file_start();
+
+	/* A finished job has to be marked saved before the next snapshot, or that snapshot's chunks would be marked saved along with it */
+	platform_mutex_lock(save_lock);
+	bool busy = pending || saving, finished = saved;
+	saved = false;
+	platform_mutex_unlock(save_lock);
+	if (finished)
+	{
+		world_file_saved();
+	}
+	if (busy)
 	{
-		world_file_save_chunk_internal(file, chunks[i].x, chunks[i].z);
+		printf("Previous save is still running, skipping autosave\n");
+		return;
 	}
 
-	fclose(file);
-#pragma warning( pop ) 
+	double start = window_time();
+	world_journal_checkpoint();
+	struct save_job* job = world_file_snapshot();
+	printf("Autosaving %i edited chunks in the background, snapshot took %.2f ms\n", mc_list_count(job->chunks), (window_time() - start) * 1000.0);
+
+	if (!writer)
+	{
+		writer = platform_thread_create(world_file_writer, NULL);
+	}
+	platform_mutex_lock(save_lock);
+	pending = job;
+	platform_cond_broadcast(save_cond);
+	platform_mutex_unlock(save_lock);
+}
+
+bool world_file_save_progress(float* progress)
+{
+	if (!save_lock)
+	{
+		return false;
+	}
+
+	platform_mutex_lock(save_lock);
+	bool result = pending || saving;
+	if (progress)
+	{
+		*progress = saving && save_total > 0 ? (float)save_done / save_total : 0.0F;
+	}
+	platform_mutex_unlock(save_lock);
+	return result;
 }
 
 void world_file_delete(void)
 {
 	printf("Removing current world...\n");
-	remove(WORLD_FILE);
+	world_file_close();
+	world_file_start();
+	world_journal_truncate();
+	mc_panic_if(!platform_file_delete(WORLD_FILE), "Failed to delete world file");
+
+	world_file_for_each_region(world_file_delete_region);
 }
 
-struct chunk* world_file_find_chunk(int x, int z)
+bool world_file_has_chunk(int x, int z)
 {
-	FILE* file = world_file_try_open_world("rb+");
-	mc_panic_if(!file, "Failed to open world");
+	world_file_start();
+	return world_file_index_has(x, z);
+}
 
-	x = ROUND_DOWN(x, CHUNK_WX);
-	z = ROUND_DOWN(z, CHUNK_WZ);
-	fseek(file, sizeof(struct file_header), SEEK_SET);
-	while (fgetc(file) != EOF)
+bool world_file_read_chunk(int x, int z, block_type_t arr[CHUNK_BLOCK_COUNT], uint8_t meta[CHUNK_META_SIZE])
+{
+	world_file_start();
+	if (!world_file_index_has(x, z))
 	{
-		int cx = -1, cz = -1;
-		fread(&cx, 1, sizeof cx, file);
-		fread(&cz, 1, sizeof cz, file);
-		if (cx == x && cz == z)
-		{
-			fseek(file, 0, SEEK_CUR);
-			block_type_t chunk[CHUNK_BLOCK_COUNT];
-			fread(chunk, 1, CHUNK_BLOCK_COUNT, file);
-			fclose(file);
+		return false;
+	}
 
-			return world_chunk_add(x, z, chunk);
+	/*	Decodes straight out of the mapping. The lock stays held so the writer cannot rewrite the record meanwhile.
+		Delta records are copied out instead, regenerating the chunk takes far longer than the writer should wait. */
+	platform_mutex_lock(region_lock);
+	struct region* region = world_file_region(x, z, false);
+	const struct region_entry* entry = &region->entries[world_file_region_index(region, x, z)];
+	struct file_chunk record;
+	uint8_t* delta = NULL;
+	bool result = false, meta_result = true;
+	memset(meta, 0, CHUNK_META_SIZE);
+	if (world_file_record_size(region, entry, &record) && record.codec < CODEC_COUNT)
+	{
+		const uint8_t* payload = platform_file_map_data(region->map) + (size_t)entry->sector * SECTOR_SIZE + sizeof record;
+		if (record.flags & FILE_CHUNK_META)
+		{
+			struct file_meta meta_record;
+			memcpy(&meta_record, payload + record.size, sizeof meta_record);
+			meta_result = meta_record.codec < CODEC_COUNT
+				&& compress_decode(meta_record.codec, payload + record.size + sizeof meta_record, meta_record.size, meta, CHUNK_META_SIZE) == CHUNK_META_SIZE;
+		}
+		if (record.codec == CODEC_DELTA)
+		{
+			delta = mc_malloc(max(record.size, 1));
+			memcpy(delta, payload, record.size);
+		}
+		else
+		{
+			result = world_file_decode_chunk(&record, payload, arr);
 		}
-		fseek(file, CHUNK_BLOCK_COUNT * sizeof(block_type_t), SEEK_CUR);
 	}
-	fclose(file);
-	return NULL;
+	platform_mutex_unlock(region_lock);
+
+	if (delta)
+	{
+		result = world_file_decode_chunk(&record, delta, arr);
+		free(delta);
+	}
+	return result && meta_result;
+}
+
+struct chunk* world_file_find_chunk(int x, int z)
+{
+	/* The loaded chunk has every edit the file has and maybe more */
+	struct chunk* loaded = world_chunk_get(x, z);
+	if (loaded)
+	{
+		return loaded;
+	}
+	if (!world_file_has_chunk(x, z))
+	{
+		return NULL;
+	}
+
+	/* Decodes straight into the new chunk */
+	struct chunk* chunk = world_chunk_add(x, z, NULL);
+	uint8_t* meta = mc_malloc(CHUNK_META_SIZE);
+	bool result = world_file_read_chunk(x, z, chunk->arr, meta);
+	if (result)
+	{
+		world_chunk_adopt_meta(chunk, meta);
+	}
+	else
+	{
+		world_chunk_remove(x, z);
+		chunk = NULL;
+	}
+	free(meta);
+	return chunk;
 }
\ No newline at end of file
@@ -0,0 +1,151 @@
+/*
+	world_journal.c ~ RL
+	Write-ahead log of block edits, so edits survive a crash between saves
+*/
+
+#define WORLD_INTERNAL
+#include "world.h"
+#include "platform.h"
+#include <stdint.h>
+
+#define JOURNAL_FILE		"worlds/journal.log"
+#define CHECKPOINT_FILE		"worlds/journal.ckpt"	/* Journal being covered by a running save */
+
+/* One block edit. Replaying records in order rebuilds every edit made since the last completed save. */
+struct journal_record
+{
+	int32_t x, z;
+	uint8_t y, old, type, meta;
+};
+
+static FILE* journal;
+static array_list_t pending; /* struct journal_record array_list, edits this tick that have not been committed */
+
+void world_journal_record(block_coords_t coords, block_type_t old, block_type_t type, int meta)
+{
+	if (!pending)
+	{
+		pending = mc_list_create(sizeof(struct journal_record));
+	}
+	struct journal_record record = { coords.x, coords.z, (uint8_t)coords.y, old, type, (uint8_t)meta };
+	mc_list_add(pending, mc_list_count(pending), &record, sizeof record);
+}
+
+void world_journal_commit(void)
+{
+	if (!pending || mc_list_count(pending) == 0)
+	{
+		return;
+	}
+
+	if (!journal)
+	{
+		journal = fopen(JOURNAL_FILE, "ab");
+		mc_panic_if(!journal, "Failed to open journal");
+	}
+	fwrite(mc_list_array(pending), sizeof(struct journal_record), mc_list_count(pending), journal);
+	platform_file_sync(journal);
+	mc_list_splice(pending, 0, mc_list_count(pending));
+}
+
+void world_journal_checkpoint(void)
+{
+	world_journal_commit();
+	if (!journal)
+	{
+		return;
+	}
+
+	/* A checkpoint left by a save that never finished still has edits the journal does not, so keep both until a save completes */
+	FILE* previous = fopen(CHECKPOINT_FILE, "rb");
+	if (previous)
+	{
+		fclose(previous);
+		return;
+	}
+
+	fclose(journal);
+	journal = NULL;
+	rename(JOURNAL_FILE, CHECKPOINT_FILE);
+}
+
+void world_journal_checkpoint_done(void)
+{
+	remove(CHECKPOINT_FILE);
+}
+
+void world_journal_truncate(void)
+{
+	if (pending)
+	{
+		mc_list_splice(pending, 0, mc_list_count(pending));
+	}
+	if (journal)
+	{
+		fclose(journal);
+		journal = NULL;
+	}
+	remove(JOURNAL_FILE);
+	remove(CHECKPOINT_FILE);
+}
+
+void world_journal_close(void)
+{
+	world_journal_commit();
+	if (journal)
+	{
+		fclose(journal);
+		journal = NULL;
+	}
+	mc_list_destroy(&pending);
+}
+
+/* Applies every record in the journal at path to the loaded chunks, loading or generating chunks as needed. Returns the amount of records applied. */
+static int world_journal_apply(const char* path)
+{
+	long size;
+	struct journal_record* records = (struct journal_record*)mc_read_file_binary(path, &size);
+	if (!records)
+	{
+		return 0;
+	}
+
+	/* A torn record at the end is an edit that was never committed */
+	int count = size / sizeof * records;
+	for (int i = 0; i < count; i++)
+	{
+		struct chunk* chunk = world_chunk_get(records[i].x, records[i].z);
+		if (!chunk)
+		{
+			chunk = world_file_find_chunk(records[i].x, records[i].z);
+		}
+		if (!chunk)
+		{
+			chunk = world_chunk_create(records[i].x, records[i].z);
+		}
+		int index = CHUNK_INDEX_OF(records[i].x - chunk->x, records[i].y, records[i].z - chunk->z);
+		chunk->arr[index] = records[i].type;
+		world_chunk_set_meta(chunk, index, records[i].meta);
+		chunk->version++;
+	}
+	free(records);
+	return count;
+}
+
+void world_journal_replay(void)
+{
+	int count = world_journal_apply(CHECKPOINT_FILE);
+	count += world_journal_apply(JOURNAL_FILE);
+	if (count == 0)
+	{
+		return;
+	}
+
+	printf("Replaying %i edits from the journal...\n", count);
+	world_file_save_current();
+	while (mc_list_count(chunk_list) > 0)
+	{
+		struct chunk* last = MC_LIST_CAST_GET(chunk_list, mc_list_count(chunk_list) - 1, struct chunk);
+		world_chunk_remove(last->x, last->z);
+	}
+}
\ No newline at end of file
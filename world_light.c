@@ -0,0 +1,599 @@
+/*
+	world_light.c ~ RL
+	Sky and block light, kept current by flood filling out from each edit rather than relighting whole chunks
+*/
+
+#define WORLD_INTERNAL
+#include "world.h"
+#include <assert.h>
+#include "window.h"
+
+#define LIGHT_BLOCKED	(LIGHT_MAX + 1)	/* Cost of passing through an opaque block, more than any light has */
+
+#define SIDE_LEFT		1
+#define SIDE_RIGHT		2
+#define SIDE_BACKWARD	4
+#define SIDE_FORWARD	8
+
+enum light_channel
+{
+	LIGHT_SKY,		/* Low nibble of a cell */
+	LIGHT_BLOCK,	/* High nibble of a cell */
+	LIGHT_CHANNELS
+};
+
+struct chunk_light
+{
+	uint8_t* sections[SECTION_COUNT];			/* Cell per block, indexed like arr. NULL while every cell of the section is fill. */
+	uint8_t fill[SECTION_COUNT];				/* What every cell of a section without storage holds */
+	uint16_t height[CHUNK_FLOOR_BLOCK_COUNT];	/* One above the highest block in each column that is not air. Sky light falls straight down to it. */
+	bool touched;								/* Has a cell changed since the last flush? */
+	int touched_sides;							/* SIDE_ bits of edges with changed cells, whose neighbors mesh faces against them */
+};
+
+struct light_node
+{
+	int x, y, z;
+	int level; /* What the cell held before it was darkened. Unused by increase queues, which read the cell itself. */
+};
+
+struct light_queue
+{
+	array_list_t nodes; /* struct light_node array_list */
+	int head;
+};
+
+static const int neighbors[6][3] = { { -1, 0, 0 }, { 1, 0, 0 }, { 0, -1, 0 }, { 0, 1, 0 }, { 0, 0, -1 }, { 0, 0, 1 } };
+
+static struct light_queue increase[LIGHT_CHANNELS], decrease[LIGHT_CHANNELS];
+static array_list_t touched_chunks; /* block_coords_t array_list of chunks with touched set, y unused */
+static struct chunk* cached_chunk; /* Last chunk looked up. Reset on every entry, since chunk_list moves around between calls. */
+
+/* How much light loses passing into a block of type */
+static inline int world_light_cost(block_type_t type)
+{
+	switch (type)
+	{
+	case BLOCK_AIR:		return 1;
+	case BLOCK_LEAVES:	return 2;
+	case BLOCK_WATER:	return 3;
+	default:			return LIGHT_BLOCKED;
+	}
+}
+
+/* How much block light type gives off. Nothing glows yet, this is where torches and lava would go. */
+static inline int world_light_emission(block_type_t type)
+{
+	(void)type;
+	return 0;
+}
+
+/* Gets the lit chunk containing (x, z), or NULL. Unlit chunks are left alone until world_light_update gets to them. */
+static inline struct chunk* world_light_chunk_get(int x, int z)
+{
+	if (!cached_chunk || cached_chunk->x != ROUND_DOWN(x, CHUNK_WX) || cached_chunk->z != ROUND_DOWN(z, CHUNK_WZ))
+	{
+		cached_chunk = world_chunk_get(x, z);
+	}
+	return cached_chunk && cached_chunk->light ? cached_chunk : NULL;
+}
+
+static inline int world_light_cell(const struct chunk_light* light, int index)
+{
+	const uint8_t* section = light->sections[index / SECTION_BLOCK_COUNT];
+	return section ? section[index % SECTION_BLOCK_COUNT] : light->fill[index / SECTION_BLOCK_COUNT];
+}
+
+static inline int world_light_level(const struct chunk_light* light, int index, int channel)
+{
+	return (world_light_cell(light, index) >> (channel * 4)) & 0xF;
+}
+
+/* Sets one channel of the cell at index, giving its section storage first if it has none */
+static void world_light_set(struct chunk* chunk, int index, int channel, int level)
+{
+	struct chunk_light* light = chunk->light;
+	int section = index / SECTION_BLOCK_COUNT;
+	if (!light->sections[section])
+	{
+		light->sections[section] = mc_malloc(SECTION_BLOCK_COUNT);
+		memset(light->sections[section], light->fill[section], SECTION_BLOCK_COUNT);
+	}
+	uint8_t* cell = &light->sections[section][index % SECTION_BLOCK_COUNT];
+	int shift = channel * 4;
+	*cell = (uint8_t)((*cell & ~(0xF << shift)) | (level << shift));
+
+	if (!light->touched)
+	{
+		if (!touched_chunks)
+		{
+			touched_chunks = mc_list_create(sizeof(block_coords_t));
+		}
+		block_coords_t coords = { chunk->x, 0, chunk->z };
+		mc_list_add(touched_chunks, mc_list_count(touched_chunks), &coords, sizeof coords);
+		light->touched = true;
+	}
+	int x = CHUNK_X(index), z = CHUNK_Z(index);
+	light->touched_sides |= (x == 0 ? SIDE_LEFT : 0) | (x == CHUNK_WX - 1 ? SIDE_RIGHT : 0)
+		| (z == 0 ? SIDE_BACKWARD : 0) | (z == CHUNK_WZ - 1 ? SIDE_FORWARD : 0);
+}
+
+static inline void world_light_push(struct light_queue* queue, int x, int y, int z, int level)
+{
+	if (!queue->nodes)
+	{
+		queue->nodes = mc_list_create(sizeof(struct light_node));
+	}
+	struct light_node node = { x, y, z, level };
+	mc_list_add(queue->nodes, mc_list_count(queue->nodes), &node, sizeof node);
+}
+
+static inline bool world_light_pop(struct light_queue* queue, struct light_node* out)
+{
+	if (!queue->nodes || queue->head >= mc_list_count(queue->nodes))
+	{
+		if (queue->nodes)
+		{
+			mc_list_splice(queue->nodes, 0, mc_list_count(queue->nodes));
+		}
+		queue->head = 0;
+		return false;
+	}
+	*out = ((struct light_node*)mc_list_array(queue->nodes))[queue->head++];
+	return true;
+}
+
+/* Spreads every cell in the channel's increase queue into its neighbors, queueing each neighbor it brightens */
+static void world_light_spread(int channel)
+{
+	struct light_node node;
+	while (world_light_pop(&increase[channel], &node))
+	{
+		struct chunk* chunk = world_light_chunk_get(node.x, node.z);
+		if (!chunk)
+		{
+			continue;
+		}
+		int level = world_light_level(chunk->light, CHUNK_INDEX_OF(node.x - chunk->x, node.y, node.z - chunk->z), channel);
+		if (level <= 1)
+		{
+			continue;
+		}
+
+		for (int i = 0; i < 6; i++)
+		{
+			int x = node.x + neighbors[i][0], y = node.y + neighbors[i][1], z = node.z + neighbors[i][2];
+			struct chunk* next;
+			if (y < 0 || y >= CHUNK_WY || !(next = world_light_chunk_get(x, z)))
+			{
+				continue;
+			}
+			int index = CHUNK_INDEX_OF(x - next->x, y, z - next->z);
+			int spread = level - world_light_cost(next->arr[index]);
+			if (spread > world_light_level(next->light, index, channel))
+			{
+				world_light_set(next, index, channel, spread);
+				world_light_push(&increase[channel], x, y, z, spread);
+			}
+		}
+	}
+}
+
+/*	Darkens everything the cells in the channel's decrease queue may have lit. Neighbors dimmer than the cell that darkened could only have been lit
+	through it, so they go dark too. Anything as bright or brighter has another source, and is queued to light the dark cells back up. */
+static void world_light_darken(int channel)
+{
+	struct light_node node;
+	while (world_light_pop(&decrease[channel], &node))
+	{
+		for (int i = 0; i < 6; i++)
+		{
+			int x = node.x + neighbors[i][0], y = node.y + neighbors[i][1], z = node.z + neighbors[i][2];
+			struct chunk* next;
+			if (y < 0 || y >= CHUNK_WY || !(next = world_light_chunk_get(x, z)))
+			{
+				continue;
+			}
+			int index = CHUNK_INDEX_OF(x - next->x, y, z - next->z);
+			int level = world_light_level(next->light, index, channel);
+			if (level == 0)
+			{
+				continue;
+			}
+			if (level >= node.level)
+			{
+				world_light_push(&increase[channel], x, y, z, level);
+				continue;
+			}
+
+			world_light_set(next, index, channel, 0);
+			world_light_push(&decrease[channel], x, y, z, level);
+			int emitted = channel == LIGHT_BLOCK ? world_light_emission(next->arr[index]) : 0;
+			if (emitted > 0)
+			{
+				world_light_set(next, index, channel, emitted);
+				world_light_push(&increase[channel], x, y, z, emitted);
+			}
+		}
+	}
+}
+
+static inline void world_light_mark(int x, int z)
+{
+	struct chunk* chunk = world_chunk_get(x, z);
+	if (chunk)
+	{
+		chunk->dirty_mask |= OPAQUE_BIT | LIQUID_BIT;
+	}
+}
+
+/* Marks every chunk whose light changed for remeshing, along with the neighbors meshing faces against its edges */
+static void world_light_flush(void)
+{
+	if (!touched_chunks)
+	{
+		return;
+	}
+	for (int i = 0; i < mc_list_count(touched_chunks); i++)
+	{
+		block_coords_t coords = *MC_LIST_CAST_GET(touched_chunks, i, block_coords_t);
+		struct chunk* chunk = world_chunk_get(coords.x, coords.z);
+		int sides = chunk->light->touched_sides;
+		chunk->light->touched = false;
+		chunk->light->touched_sides = 0;
+		chunk->dirty_mask |= OPAQUE_BIT | LIQUID_BIT;
+
+		if (sides & SIDE_LEFT)
+		{
+			world_light_mark(coords.x - CHUNK_WX, coords.z);
+		}
+		if (sides & SIDE_RIGHT)
+		{
+			world_light_mark(coords.x + CHUNK_WX, coords.z);
+		}
+		if (sides & SIDE_BACKWARD)
+		{
+			world_light_mark(coords.x, coords.z - CHUNK_WZ);
+		}
+		if (sides & SIDE_FORWARD)
+		{
+			world_light_mark(coords.x, coords.z + CHUNK_WZ);
+		}
+	}
+	mc_list_splice(touched_chunks, 0, mc_list_count(touched_chunks));
+}
+
+void world_light_propagate(void)
+{
+	cached_chunk = NULL;
+	for (int channel = 0; channel < LIGHT_CHANNELS; channel++)
+	{
+		world_light_darken(channel);
+	}
+	for (int channel = 0; channel < LIGHT_CHANNELS; channel++)
+	{
+		world_light_spread(channel);
+	}
+	world_light_flush();
+}
+
+void world_light_edit(struct chunk* chunk, block_coords_t coords, block_type_t old, block_type_t type)
+{
+	if (!chunk->light || (world_light_cost(old) == world_light_cost(type) && world_light_emission(old) == world_light_emission(type)))
+	{
+		return;
+	}
+	cached_chunk = NULL;
+
+	struct chunk_light* light = chunk->light;
+	int x = coords.x - chunk->x, z = coords.z - chunk->z, column = CHUNK_INDEX_OF(x, 0, z);
+	if (type != BLOCK_AIR && coords.y >= light->height[column])
+	{
+		/* Everything from here down to the old top of the column loses the sky */
+		for (int y = light->height[column]; y <= coords.y; y++)
+		{
+			world_light_set(chunk, CHUNK_INDEX_OF(x, y, z), LIGHT_SKY, 0);
+			world_light_push(&decrease[LIGHT_SKY], coords.x, y, coords.z, LIGHT_MAX);
+		}
+		light->height[column] = (uint16_t)(coords.y + 1);
+	}
+	else if (type == BLOCK_AIR && coords.y == light->height[column] - 1)
+	{
+		/* The top of the column opened up, so the sky falls to the next block down */
+		int height = coords.y;
+		while (height > 0 && CHUNK_AT(chunk->arr, x, height - 1, z) == BLOCK_AIR)
+		{
+			height--;
+		}
+		for (int y = height; y <= coords.y; y++)
+		{
+			world_light_set(chunk, CHUNK_INDEX_OF(x, y, z), LIGHT_SKY, LIGHT_MAX);
+			world_light_push(&increase[LIGHT_SKY], coords.x, y, coords.z, LIGHT_MAX);
+		}
+		light->height[column] = (uint16_t)height;
+	}
+
+	int index = CHUNK_INDEX_OF(x, coords.y, z);
+	for (int channel = 0; channel < LIGHT_CHANNELS; channel++)
+	{
+		/* Open sky keeps its light whatever happened around it, even when edits in a batch reach the column out of order */
+		int level = world_light_level(light, index, channel);
+		if (level > 0 && !(channel == LIGHT_SKY && coords.y >= light->height[column]))
+		{
+			world_light_set(chunk, index, channel, 0);
+			world_light_push(&decrease[channel], coords.x, coords.y, coords.z, level);
+		}
+
+		/* Light around the block may reach further through what replaced it */
+		for (int i = 0; i < 6; i++)
+		{
+			int y = coords.y + neighbors[i][1];
+			if (y >= 0 && y < CHUNK_WY)
+			{
+				world_light_push(&increase[channel], coords.x + neighbors[i][0], y, coords.z + neighbors[i][2], 0);
+			}
+		}
+	}
+
+	int emitted = world_light_emission(type);
+	if (emitted > 0)
+	{
+		world_light_set(chunk, index, LIGHT_BLOCK, emitted);
+		world_light_push(&increase[LIGHT_BLOCK], coords.x, coords.y, coords.z, emitted);
+	}
+}
+
+/* Height of the column at local (x, z) of chunk, which may be just outside of it. Columns of unlit chunks count as "fallback." */
+static inline int world_light_height(const struct chunk* chunk, int x, int z, int fallback)
+{
+	if (x >= 0 && x < CHUNK_WX && z >= 0 && z < CHUNK_WZ)
+	{
+		return chunk->light->height[CHUNK_INDEX_OF(x, 0, z)];
+	}
+	const struct chunk* next = world_light_chunk_get(chunk->x + x, chunk->z + z);
+	return next ? next->light->height[CHUNK_INDEX_OF(x - (next->x - chunk->x), 0, z - (next->z - chunk->z))] : fallback;
+}
+
+/* Queues the cells of a lit neighbor's edge that are bright enough to spread into chunk */
+static void world_light_pull(struct chunk* chunk, int dx, int dz)
+{
+	struct chunk* next = world_light_chunk_get(chunk->x + dx * CHUNK_WX, chunk->z + dz * CHUNK_WZ);
+	if (!next)
+	{
+		return;
+	}
+	for (int i = 0; i < CHUNK_WX; i++)
+	{
+		/* Chunk-local coordinates of the edge inside chunk and the one across it inside next */
+		int x = dx < 0 ? 0 : dx > 0 ? CHUNK_WX - 1 : i, z = dz < 0 ? 0 : dz > 0 ? CHUNK_WZ - 1 : i;
+		int nx = dx < 0 ? CHUNK_WX - 1 : dx > 0 ? 0 : i, nz = dz < 0 ? CHUNK_WZ - 1 : dz > 0 ? 0 : i;
+		for (int y = 0; y < CHUNK_WY; y++)
+		{
+			int inside = world_light_cell(chunk->light, CHUNK_INDEX_OF(x, y, z)), across = world_light_cell(next->light, CHUNK_INDEX_OF(nx, y, nz));
+			for (int channel = 0; channel < LIGHT_CHANNELS; channel++)
+			{
+				if (((across >> (channel * 4)) & 0xF) > ((inside >> (channel * 4)) & 0xF) + 1)
+				{
+					world_light_push(&increase[channel], next->x + nx, y, next->z + nz, 0);
+				}
+			}
+		}
+	}
+}
+
+/* Seeds chunk's light from its heightmap and glowing blocks, queueing everything that spreads. Does not propagate. */
+static void world_light_seed(struct chunk* chunk)
+{
+	struct chunk_light* light = mc_malloc(sizeof * light);
+	memset(light, 0, sizeof * light);
+	chunk->light = light;
+
+	int top = 0;
+	for (int column = 0; column < CHUNK_FLOOR_BLOCK_COUNT; column++)
+	{
+		int height = CHUNK_WY;
+		while (height > 0 && chunk->arr[(height - 1) * CHUNK_FLOOR_BLOCK_COUNT + column] == BLOCK_AIR)
+		{
+			height--;
+		}
+		light->height[column] = (uint16_t)height;
+		top = max(top, height);
+	}
+
+	/* Sections above every column are open sky and never need storage */
+	for (int section = 0; section < SECTION_COUNT; section++)
+	{
+		light->fill[section] = section * SECTION_HEIGHT >= top ? LIGHT_MAX : 0;
+	}
+	int open = (top + SECTION_HEIGHT - 1) / SECTION_HEIGHT * SECTION_HEIGHT;
+	for (int z = 0; z < CHUNK_WZ; z++)
+	{
+		for (int x = 0; x < CHUNK_WX; x++)
+		{
+			int height = light->height[CHUNK_INDEX_OF(x, 0, z)];
+			for (int y = height; y < open; y++)
+			{
+				world_light_set(chunk, CHUNK_INDEX_OF(x, y, z), LIGHT_SKY, LIGHT_MAX);
+			}
+		}
+	}
+
+	/* Sky only spreads sideways out of the open part of a column that its neighbors lack, and down into its top block */
+	for (int z = 0; z < CHUNK_WZ; z++)
+	{
+		for (int x = 0; x < CHUNK_WX; x++)
+		{
+			int height = light->height[CHUNK_INDEX_OF(x, 0, z)], reach = height + 1;
+			reach = max(reach, world_light_height(chunk, x - 1, z, height));
+			reach = max(reach, world_light_height(chunk, x + 1, z, height));
+			reach = max(reach, world_light_height(chunk, x, z - 1, height));
+			reach = max(reach, world_light_height(chunk, x, z + 1, height));
+			for (int y = height; y < min(reach, CHUNK_WY); y++)
+			{
+				world_light_push(&increase[LIGHT_SKY], chunk->x + x, y, chunk->z + z, 0);
+			}
+		}
+	}
+
+	for (int index = 0; index < CHUNK_BLOCK_COUNT; index++)
+	{
+		int emitted = world_light_emission(chunk->arr[index]);
+		if (emitted > 0)
+		{
+			world_light_set(chunk, index, LIGHT_BLOCK, emitted);
+			world_light_push(&increase[LIGHT_BLOCK], chunk->x + CHUNK_X(index), CHUNK_Y(index), chunk->z + CHUNK_Z(index), 0);
+		}
+	}
+
+	world_light_pull(chunk, -1, 0);
+	world_light_pull(chunk, 1, 0);
+	world_light_pull(chunk, 0, -1);
+	world_light_pull(chunk, 0, 1);
+}
+
+void world_light_update(void)
+{
+	cached_chunk = NULL;
+	bool seeded = false;
+	for (int i = 0; i < mc_list_count(chunk_list); i++)
+	{
+		struct chunk* chunk = MC_LIST_CAST_GET(chunk_list, i, struct chunk);
+		if (!chunk->light)
+		{
+			world_light_seed(chunk);
+			seeded = true;
+		}
+	}
+	if (seeded)
+	{
+		world_light_propagate();
+	}
+}
+
+int world_light_get(const struct chunk* chunk, int x, int y, int z)
+{
+	if (y >= CHUNK_WY || !chunk || !chunk->light)
+	{
+		return LIGHT_MAX;
+	}
+	return y < 0 ? 0 : world_light_cell(chunk->light, CHUNK_INDEX_OF(x, y, z));
+}
+
+void world_light_free(struct chunk* chunk)
+{
+	if (!chunk->light)
+	{
+		return;
+	}
+	for (int section = 0; section < SECTION_COUNT; section++)
+	{
+		free(chunk->light->sections[section]);
+	}
+	free(chunk->light);
+	chunk->light = NULL;
+}
+
+void world_light_destroy(void)
+{
+	for (int channel = 0; channel < LIGHT_CHANNELS; channel++)
+	{
+		if (increase[channel].nodes)
+		{
+			mc_list_destroy(&increase[channel].nodes);
+		}
+		if (decrease[channel].nodes)
+		{
+			mc_list_destroy(&decrease[channel].nodes);
+		}
+		increase[channel].head = decrease[channel].head = 0;
+	}
+	if (touched_chunks)
+	{
+		mc_list_destroy(&touched_chunks);
+	}
+	cached_chunk = NULL;
+}
+
+#define BENCHMARK_RADIUS	4
+#define BENCHMARK_EDITS		2000
+
+/* Hashes every cell of every loaded chunk */
+static hash_t world_light_hash(void)
+{
+	static uint8_t cells[CHUNK_BLOCK_COUNT];
+	hash_t result = 0;
+	for (int i = 0; i < mc_list_count(chunk_list); i++)
+	{
+		const struct chunk* chunk = MC_LIST_CAST_GET(chunk_list, i, struct chunk);
+		for (int index = 0; index < CHUNK_BLOCK_COUNT; index++)
+		{
+			cells[index] = (uint8_t)world_light_cell(chunk->light, index);
+		}
+		result = result * 31 + mc_hash(cells, sizeof cells);
+	}
+	return result;
+}
+
+void world_light_benchmark(FILE* stream)
+{
+	world_chunk_init(1);
+	for (int i = -BENCHMARK_RADIUS; i < BENCHMARK_RADIUS; i++)
+	{
+		for (int j = -BENCHMARK_RADIUS; j < BENCHMARK_RADIUS; j++)
+		{
+			world_chunk_create(i * CHUNK_WX, j * CHUNK_WZ);
+		}
+	}
+	int chunks = mc_list_count(chunk_list);
+
+	double start = window_time();
+	world_light_update();
+	double light_time = window_time() - start;
+
+	/* Digging, building on top, carving out caves and roofing columns over, away from the unlit edge of the square */
+	random_t random = mc_random_create(1, 0, 0);
+	const int reach = (BENCHMARK_RADIUS - 1) * CHUNK_WX;
+	start = window_time();
+	for (int i = 0; i < BENCHMARK_EDITS; i++)
+	{
+		block_coords_t coords = { mc_random_range(&random, reach * 2) - reach, 0, mc_random_range(&random, reach * 2) - reach };
+		struct chunk* chunk = world_chunk_get(coords.x, coords.z);
+		int height = chunk->light->height[CHUNK_INDEX_OF(coords.x - chunk->x, 0, coords.z - chunk->z)];
+		switch (i % 4)
+		{
+		case 0:
+			coords.y = height - 1;
+			world_block_set(coords, BLOCK_AIR);
+			break;
+		case 1:
+			coords.y = height;
+			world_block_set(coords, BLOCK_STONE);
+			break;
+		case 2:
+			coords.y = max(height - 2 - mc_random_range(&random, 10), 0);
+			world_block_set(coords, BLOCK_AIR);
+			break;
+		case 3:
+			coords.y = min(height + 2 + mc_random_range(&random, 4), CHUNK_WY - 1);
+			world_block_set(coords, BLOCK_LEAVES);
+			break;
+		}
+	}
+	double edit_time = window_time() - start;
+
+	/* Lighting the edited world from scratch has to land on exactly what the edits left behind */
+	hash_t incremental = world_light_hash();
+	for (int i = 0; i < chunks; i++)
+	{
+		world_light_free(MC_LIST_CAST_GET(chunk_list, i, struct chunk));
+	}
+	world_light_update();
+	hash_t relit = world_light_hash();
+
+	fprintf(stream, "world_light: %i chunks lit in %.2f ms (%.3f ms per chunk), %i edits %.2f us per edit, %s\n", chunks, light_time * 1000.0,
+		light_time * 1000.0 / chunks, BENCHMARK_EDITS, edit_time / BENCHMARK_EDITS * 1.0e6, incremental == relit ? "same light as relighting" : "LIGHT DIFFERS");
+
+	world_chunk_destroy();
+	world_tick_destroy();
+	world_light_destroy();
+}
\ No newline at end of file
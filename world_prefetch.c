@@ -0,0 +1,249 @@
+/*
+	world_prefetch.c ~ RL
+	Reads saved chunks ahead of the player on a background thread
+*/
+
+#define WORLD_INTERNAL
+#include "world.h"
+#include "platform.h"
+#include "window.h"
+
+#define PREFETCH_SLOTS		(RADIUS * 4 + 1)	/* Enough for two sides of the ring and the corner between them */
+#define PREFETCH_DEAD_ZONE	0.5F				/* Speed along an axis below which the player is not heading either way */
+
+typedef enum slot_state
+{
+	SLOT_FREE,
+	SLOT_QUEUED,	/* Waiting for the read-ahead thread */
+	SLOT_READING,	/* Owned by the read-ahead thread until it is done */
+	SLOT_READY,		/* Decoded and waiting to be adopted */
+	SLOT_MISSING	/* Read failed, the chunk is generated instead */
+} slot_state_t;
+
+/* A staging buffer the read-ahead thread decodes a chunk into */
+struct staged_chunk
+{
+	int x, z;
+	slot_state_t state;
+	block_type_t arr[CHUNK_BLOCK_COUNT];
+	uint8_t meta[CHUNK_META_SIZE];
+};
+
+static struct staged_chunk* slots;
+static mutex_t slot_lock;	/* Guards every slot's state and stats. A slot's blocks belong to whoever moved it out of SLOT_QUEUED. */
+static cond_t slot_cond;	/* Signalled when a slot is queued, a read finishes or the thread should quit */
+static thread_t reader;
+static bool reader_quit;
+static struct prefetch_stats stats;
+
+static void world_prefetch_reader(void* user)
+{
+	platform_mutex_lock(slot_lock);
+	while (true)
+	{
+		struct staged_chunk* slot = NULL;
+		for (int i = 0; !reader_quit && i < PREFETCH_SLOTS && !slot; i++)
+		{
+			slot = slots[i].state == SLOT_QUEUED ? &slots[i] : NULL;
+		}
+		if (reader_quit)
+		{
+			break;
+		}
+		if (!slot)
+		{
+			platform_cond_wait(slot_cond, slot_lock);
+			continue;
+		}
+
+		slot->state = SLOT_READING;
+		int x = slot->x, z = slot->z;
+		platform_mutex_unlock(slot_lock);
+
+		double start = window_time();
+		bool result = world_file_read_chunk(x, z, slot->arr, slot->meta);
+		double elapsed = window_time() - start;
+
+		platform_mutex_lock(slot_lock);
+		slot->state = result ? SLOT_READY : SLOT_MISSING;
+		stats.reads++;
+		stats.read_time += elapsed;
+		stats.max_read_time = max(stats.max_read_time, elapsed);
+		platform_cond_broadcast(slot_cond);
+	}
+	platform_mutex_unlock(slot_lock);
+}
+
+static struct staged_chunk* world_prefetch_slot(int x, int z)
+{
+	for (int i = 0; i < PREFETCH_SLOTS; i++)
+	{
+		if (slots[i].state != SLOT_FREE && slots[i].x == x && slots[i].z == z)
+		{
+			return &slots[i];
+		}
+	}
+	return NULL;
+}
+
+/* Queues the chunk at (x, z) if it is saved, not loaded, cached or staged already. Call with slot_lock held. */
+static void world_prefetch_queue(int x, int z)
+{
+	if (world_chunk_get(x, z) || world_cache_has(x, z) || world_prefetch_slot(x, z) || !world_file_has_chunk(x, z))
+	{
+		return;
+	}
+	for (int i = 0; i < PREFETCH_SLOTS; i++)
+	{
+		if (slots[i].state == SLOT_FREE)
+		{
+			slots[i].x = x;
+			slots[i].z = z;
+			slots[i].state = SLOT_QUEUED;
+			platform_cond_signal(slot_cond);
+			return;
+		}
+	}
+}
+
+void world_prefetch_update(int x, int z, vector3_t velocity)
+{
+	if (!reader)
+	{
+		slots = mc_malloc(PREFETCH_SLOTS * sizeof * slots);
+		for (int i = 0; i < PREFETCH_SLOTS; i++)
+		{
+			slots[i].state = SLOT_FREE;
+		}
+		slot_lock = platform_mutex_create();
+		slot_cond = platform_cond_create();
+		reader = platform_thread_create(world_prefetch_reader, NULL);
+	}
+
+	x = ROUND_DOWN(x, CHUNK_WX);
+	z = ROUND_DOWN(z, CHUNK_WZ);
+	platform_mutex_lock(slot_lock);
+
+	/* Loaded chunks cover [-RADIUS, RADIUS) chunks around the player, anything staged outside of the ring past that is stale */
+	for (int i = 0; i < PREFETCH_SLOTS; i++)
+	{
+		if (slots[i].state == SLOT_FREE || slots[i].state == SLOT_READING)
+		{
+			continue;
+		}
+		int dx = (slots[i].x - x) / CHUNK_WX, dz = (slots[i].z - z) / CHUNK_WZ;
+		if (dx >= -RADIUS - 1 && dx <= RADIUS && dz >= -RADIUS - 1 && dz <= RADIUS)
+		{
+			continue;
+		}
+		stats.wasted += slots[i].state == SLOT_READY;
+		slots[i].state = SLOT_FREE;
+	}
+
+	/* Side of the ring the player is heading toward on each axis, 0 if neither */
+	int step_x = velocity.x > PREFETCH_DEAD_ZONE ? RADIUS : velocity.x < -PREFETCH_DEAD_ZONE ? -RADIUS - 1 : 0;
+	int step_z = velocity.z > PREFETCH_DEAD_ZONE ? RADIUS : velocity.z < -PREFETCH_DEAD_ZONE ? -RADIUS - 1 : 0;
+	for (int i = -RADIUS - 1; i <= RADIUS; i++)
+	{
+		if (step_x != 0)
+		{
+			world_prefetch_queue(x + step_x * CHUNK_WX, z + i * CHUNK_WZ);
+		}
+		if (step_z != 0)
+		{
+			world_prefetch_queue(x + i * CHUNK_WX, z + step_z * CHUNK_WZ);
+		}
+	}
+	platform_mutex_unlock(slot_lock);
+}
+
+struct chunk* world_prefetch_find_chunk(int x, int z)
+{
+	x = ROUND_DOWN(x, CHUNK_WX);
+	z = ROUND_DOWN(z, CHUNK_WZ);
+	if (!reader || world_chunk_get(x, z))
+	{
+		return world_file_find_chunk(x, z);
+	}
+
+	platform_mutex_lock(slot_lock);
+	struct staged_chunk* slot = world_prefetch_slot(x, z);
+	bool waited = false;
+	while (slot && slot->state == SLOT_READING)
+	{
+		/* Already on its way, waiting out the rest of the read beats starting it over */
+		platform_cond_wait(slot_cond, slot_lock);
+		waited = true;
+	}
+
+	struct chunk* chunk = NULL;
+	if (slot && slot->state == SLOT_READY)
+	{
+		chunk = world_chunk_add(x, z, slot->arr);
+		world_chunk_adopt_meta(chunk, slot->meta);
+		stats.hits++;
+		stats.late_hits += waited;
+	}
+	if (slot)
+	{
+		slot->state = SLOT_FREE;
+	}
+	platform_mutex_unlock(slot_lock);
+	if (chunk)
+	{
+		return chunk;
+	}
+
+	chunk = world_file_find_chunk(x, z);
+	if (chunk)
+	{
+		platform_mutex_lock(slot_lock);
+		stats.misses++;
+		platform_mutex_unlock(slot_lock);
+	}
+	return chunk;
+}
+
+void world_prefetch_stop(void)
+{
+	if (!reader)
+	{
+		return;
+	}
+
+	platform_mutex_lock(slot_lock);
+	reader_quit = true;
+	platform_cond_broadcast(slot_cond);
+	platform_mutex_unlock(slot_lock);
+	platform_thread_join(&reader);
+	reader_quit = false;
+
+	world_prefetch_debug(stdout);
+	free(slots);
+	slots = NULL;
+	platform_cond_delete(&slot_cond);
+	platform_mutex_delete(&slot_lock);
+	stats = (struct prefetch_stats){ 0 };
+}
+
+struct prefetch_stats world_prefetch_stats(void)
+{
+	if (!reader)
+	{
+		return stats;
+	}
+
+	platform_mutex_lock(slot_lock);
+	struct prefetch_stats result = stats;
+	platform_mutex_unlock(slot_lock);
+	return result;
+}
+
+void world_prefetch_debug(FILE* stream)
+{
+	struct prefetch_stats current = world_prefetch_stats();
+	int loads = current.hits + current.misses;
+	fprintf(stream, "Read-ahead: %i/%i chunk loads staged (%.0f%%, %i waited on), %i wasted. %i reads, %.2f ms average, %.2f ms worst\n",
+		current.hits, loads, loads > 0 ? current.hits * 100.0 / loads : 0.0, current.late_hits, current.wasted,
+		current.reads, current.reads > 0 ? current.read_time * 1000.0 / current.reads : 0.0, current.max_read_time * 1000.0);
+}
\ No newline at end of file
@@ -0,0 +1,252 @@
+/*
+	world_ray.c ~ RL
+	Casts batches of rays four at a time, stepping each from block to block instead of testing every block around it
+*/
+
+#define WORLD_INTERNAL
+#include "world.h"
+#include "window.h"
+
+#define RAY_LANES	4
+#define RAY_NEVER	1.0e30F /* Time a ray takes to cross a boundary on an axis it does not move along */
+#define RAY_REACH	1.0e7F	/* Farthest from the origin a ray may start, keeping block coordinates well inside an int */
+
+typedef union ray_lanes
+{
+	__m128 v;
+	float f[RAY_LANES];
+} ray_lanes_t;
+
+/* Where a ray sits in the cast order, sorted by the chunk it starts in */
+struct ray_order
+{
+	int chunk_x, chunk_z;
+	int index;
+};
+
+static int world_ray_order_compare(const void* a, const void* b)
+{
+	const struct ray_order* ra = a, * rb = b;
+	if (ra->chunk_x != rb->chunk_x)
+	{
+		return ra->chunk_x < rb->chunk_x ? -1 : 1;
+	}
+	return ra->chunk_z < rb->chunk_z ? -1 : ra->chunk_z > rb->chunk_z;
+}
+
+/* Can ray i be cast? Rays that are not finite or start absurdly far out would never finish stepping, so they miss right away instead. */
+static inline bool world_ray_valid(const ray_batch_t* batch, int i)
+{
+	return isfinite(batch->direction_x[i]) && isfinite(batch->direction_y[i]) && isfinite(batch->direction_z[i]) && isfinite(batch->length[i])
+		&& fabsf(batch->origin_x[i]) < RAY_REACH && fabsf(batch->origin_y[i]) < RAY_REACH && fabsf(batch->origin_z[i]) < RAY_REACH;
+}
+
+/* Picks a where mask is set and b everywhere else */
+static inline __m128 world_ray_select(__m128 mask, __m128 a, __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+/* Rounds each lane toward negative infinity using only SSE2 */
+static inline __m128 world_ray_floor(__m128 v)
+{
+	__m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(v));
+	return _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, v), _mm_set1_ps(1.0F)));
+}
+
+/* Sets up stepping along one axis: which way the ray steps, the time between boundaries and the time to the first one */
+static inline void world_ray_axis(__m128 origin, __m128 direction, __m128 cell, __m128* step, __m128* delta, __m128* next)
+{
+	__m128 one = _mm_set1_ps(1.0F), zero = _mm_setzero_ps();
+	__m128 positive = _mm_cmpgt_ps(direction, zero), still = _mm_cmpeq_ps(direction, zero);
+	__m128 inverse = _mm_div_ps(one, world_ray_select(still, one, direction));
+	*step = world_ray_select(positive, one, _mm_set1_ps(-1.0F));
+	*delta = world_ray_select(still, _mm_set1_ps(RAY_NEVER * 2.0F), _mm_andnot_ps(_mm_set1_ps(-0.0F), inverse));
+	*next = world_ray_select(still, _mm_set1_ps(RAY_NEVER), _mm_mul_ps(_mm_sub_ps(_mm_add_ps(cell, _mm_and_ps(positive, one)), origin), inverse));
+}
+
+static inline bool world_ray_wants(ray_settings_t settings, block_type_t type)
+{
+	return (settings & RAY_SOLID && IS_SOLID(type))
+		|| (settings & RAY_AIR && type == BLOCK_AIR)
+		|| (settings & RAY_LIQUID && type == BLOCK_WATER);
+}
+
+void world_ray_cast_batch(const ray_batch_t* batch, ray_settings_t settings, ray_t* results)
+{
+	if (batch->count <= 0)
+	{
+		return;
+	}
+
+	/* Rays that start in the same chunk go down the same lanes together, so their cursors rarely look chunks up */
+	struct ray_order* order = mc_malloc(sizeof * order * batch->count);
+	for (int i = 0; i < batch->count; i++)
+	{
+		order[i] = (struct ray_order){ 0, 0, i };
+		if (world_ray_valid(batch, i))
+		{
+			order[i].chunk_x = ROUND_DOWN((int)floorf(batch->origin_x[i]), CHUNK_WX) / CHUNK_WX;
+			order[i].chunk_z = ROUND_DOWN((int)floorf(batch->origin_z[i]), CHUNK_WZ) / CHUNK_WZ;
+		}
+	}
+	qsort(order, batch->count, sizeof * order, world_ray_order_compare);
+
+	for (int first = 0; first < batch->count; first += RAY_LANES)
+	{
+		ray_lanes_t ox, oy, oz, dx, dy, dz, len;
+		int index[RAY_LANES], active = 0;
+		for (int l = 0; l < RAY_LANES; l++)
+		{
+			/* Lanes past the end of the batch, or with a ray that cannot be cast, step a dummy ray that is never read */
+			index[l] = first + l < batch->count ? order[first + l].index : -1;
+			int i = index[l];
+			bool valid = i >= 0 && world_ray_valid(batch, i);
+			vector3_t direction = valid ? vector3_normalize((vector3_t) { batch->direction_x[i], batch->direction_y[i], batch->direction_z[i] }) : (vector3_t) { 1.0F };
+			ox.f[l] = valid ? batch->origin_x[i] : 0.0F;
+			oy.f[l] = valid ? batch->origin_y[i] : 0.0F;
+			oz.f[l] = valid ? batch->origin_z[i] : 0.0F;
+			dx.f[l] = direction.x;
+			dy.f[l] = direction.y;
+			dz.f[l] = direction.z;
+			len.f[l] = valid ? batch->length[i] : -1.0F;
+
+			if (i >= 0)
+			{
+				/* Misses end at their full length. Rays with no direction, or that cannot be cast, never get anywhere, so they miss right away. */
+				vector3_t origin = { batch->origin_x[i], batch->origin_y[i], batch->origin_z[i] };
+				results[i] = (ray_t){ .block = {.y = -1}, .min = origin, .max = valid ? vector3_add(origin, vector3_mul_scalar(direction, len.f[l])) : origin };
+				active |= (valid && (dx.f[l] != 0.0F || dy.f[l] != 0.0F || dz.f[l] != 0.0F)) << l;
+			}
+		}
+
+		__m128 cell_x = world_ray_floor(ox.v), cell_y = world_ray_floor(oy.v), cell_z = world_ray_floor(oz.v);
+		__m128 step_x, step_y, step_z, delta_x, delta_y, delta_z, next_x, next_y, next_z;
+		world_ray_axis(ox.v, dx.v, cell_x, &step_x, &delta_x, &next_x);
+		world_ray_axis(oy.v, dy.v, cell_y, &step_y, &delta_y, &next_y);
+		world_ray_axis(oz.v, dz.v, cell_z, &step_z, &delta_z, &next_z);
+
+		block_cursor_t cursors[RAY_LANES];
+		for (int l = 0; l < RAY_LANES; l++)
+		{
+			cursors[l] = world_cursor_create((block_coords_t) { (int)floorf(ox.f[l]), (int)floorf(oy.f[l]), (int)floorf(oz.f[l]) });
+		}
+
+		while (active)
+		{
+			/* Every lane's current block is entered at the latest boundary crossed to get there and left at the soonest one ahead */
+			ray_lanes_t x, y, z, enter, leave;
+			x.v = cell_x;
+			y.v = cell_y;
+			z.v = cell_z;
+			enter.v = _mm_max_ps(_mm_max_ps(_mm_sub_ps(next_x, delta_x), _mm_sub_ps(next_y, delta_y)), _mm_sub_ps(next_z, delta_z));
+			leave.v = _mm_min_ps(_mm_min_ps(next_x, next_y), next_z);
+
+			for (int l = 0; l < RAY_LANES; l++)
+			{
+				if (!(active & 1 << l))
+				{
+					continue;
+				}
+				if (enter.f[l] > len.f[l])
+				{
+					active &= ~(1 << l);
+					continue;
+				}
+
+				block_coords_t coords = { (int)x.f[l], (int)y.f[l], (int)z.f[l] };
+				world_cursor_move(&cursors[l], coords);
+				if (world_ray_wants(settings, world_cursor_get(&cursors[l], 0, 0, 0)))
+				{
+					ray_t* result = &results[index[l]];
+					result->block = coords;
+					result->min = (vector3_t){ ox.f[l] + dx.f[l] * enter.f[l], oy.f[l] + dy.f[l] * enter.f[l], oz.f[l] + dz.f[l] * enter.f[l] };
+					result->max = (vector3_t){ ox.f[l] + dx.f[l] * leave.f[l], oy.f[l] + dy.f[l] * leave.f[l], oz.f[l] + dz.f[l] * leave.f[l] };
+					active &= ~(1 << l);
+				}
+			}
+
+			/* Step every lane across whichever of its boundaries comes first. Finished lanes keep stepping, they are just never read. */
+			__m128 cross_x = _mm_and_ps(_mm_cmple_ps(next_x, next_y), _mm_cmple_ps(next_x, next_z));
+			__m128 cross_y = _mm_andnot_ps(cross_x, _mm_cmple_ps(next_y, next_z));
+			__m128 cross_z = _mm_andnot_ps(_mm_or_ps(cross_x, cross_y), _mm_cmpeq_ps(next_z, next_z));
+			cell_x = _mm_add_ps(cell_x, _mm_and_ps(cross_x, step_x));
+			cell_y = _mm_add_ps(cell_y, _mm_and_ps(cross_y, step_y));
+			cell_z = _mm_add_ps(cell_z, _mm_and_ps(cross_z, step_z));
+			next_x = _mm_add_ps(next_x, _mm_and_ps(cross_x, delta_x));
+			next_y = _mm_add_ps(next_y, _mm_and_ps(cross_y, delta_y));
+			next_z = _mm_add_ps(next_z, _mm_and_ps(cross_z, delta_z));
+		}
+	}
+
+	free(order);
+}
+
+#define BENCHMARK_RADIUS	4
+#define BENCHMARK_RAYS		4096
+#define BENCHMARK_PASSES	50
+#define BENCHMARK_SINGLE	256 /* Rays also cast one at a time, which is far too slow to do for the whole batch */
+
+void world_ray_benchmark(FILE* stream)
+{
+	world_chunk_init(1);
+	for (int i = -BENCHMARK_RADIUS; i < BENCHMARK_RADIUS; i++)
+	{
+		for (int j = -BENCHMARK_RADIUS; j < BENCHMARK_RADIUS; j++)
+		{
+			world_chunk_create(i * CHUNK_WX, j * CHUNK_WZ);
+		}
+	}
+
+	/* Line of sight checks from mob eyes standing around the square, looking every which way */
+	const int reach = (BENCHMARK_RADIUS - 1) * CHUNK_WX;
+	random_t random = mc_random_create(1, 0, 0);
+	float* components = mc_malloc(sizeof * components * BENCHMARK_RAYS * 7);
+	ray_batch_t batch = { BENCHMARK_RAYS, components, components + BENCHMARK_RAYS, components + BENCHMARK_RAYS * 2,
+		components + BENCHMARK_RAYS * 3, components + BENCHMARK_RAYS * 4, components + BENCHMARK_RAYS * 5, components + BENCHMARK_RAYS * 6 };
+	for (int i = 0; i < BENCHMARK_RAYS; i++)
+	{
+		block_coords_t ground = { mc_random_range(&random, reach * 2) - reach, CHUNK_WY - 1, mc_random_range(&random, reach * 2) - reach };
+		block_cursor_t cursor = world_cursor_create(ground);
+		for (; ground.y > 0 && !IS_SOLID(world_cursor_get(&cursor, 0, 0, 0)); world_cursor_move(&cursor, ground))
+		{
+			ground.y--;
+		}
+		components[i] = ground.x + 0.5F;
+		components[BENCHMARK_RAYS + i] = ground.y + 2.62F;
+		components[BENCHMARK_RAYS * 2 + i] = ground.z + 0.5F;
+		components[BENCHMARK_RAYS * 3 + i] = (float)mc_random_range(&random, 201) - 100.0F;
+		components[BENCHMARK_RAYS * 4 + i] = (float)mc_random_range(&random, 201) - 100.0F;
+		components[BENCHMARK_RAYS * 5 + i] = (float)mc_random_range(&random, 201) - 100.0F;
+		components[BENCHMARK_RAYS * 6 + i] = (float)(8 + mc_random_range(&random, 25));
+	}
+
+	ray_t* results = mc_malloc(sizeof * results * BENCHMARK_RAYS);
+	double start = window_time();
+	for (int pass = 0; pass < BENCHMARK_PASSES; pass++)
+	{
+		world_ray_cast_batch(&batch, RAY_SOLID | RAY_LIQUID, results);
+	}
+	double batch_time = window_time() - start;
+
+	int hits = 0, agree = 0;
+	for (int i = 0; i < BENCHMARK_RAYS; i++)
+	{
+		hits += !IS_INVALID_BLOCK_COORDS(results[i].block);
+	}
+	start = window_time();
+	for (int i = 0; i < BENCHMARK_SINGLE; i++)
+	{
+		vector3_t origin = { batch.origin_x[i], batch.origin_y[i], batch.origin_z[i] }, direction = { batch.direction_x[i], batch.direction_y[i], batch.direction_z[i] };
+		agree += is_block_coords_equal(world_ray_cast(origin, direction, batch.length[i], RAY_SOLID | RAY_LIQUID).block, results[i].block);
+	}
+	double single_time = window_time() - start;
+
+	fprintf(stream, "world_ray: %i rays, %.2f million rays/s batched, %.3f million rays/s one at a time, %.0f%% hit, %i/%i agree with world_ray_cast\n",
+		BENCHMARK_RAYS, BENCHMARK_RAYS * BENCHMARK_PASSES / batch_time / 1.0e6, BENCHMARK_SINGLE / single_time / 1.0e6, 100.0 * hits / BENCHMARK_RAYS, agree, BENCHMARK_SINGLE);
+
+	free(results);
+	free(components);
+	world_chunk_destroy();
+	world_tick_destroy();
+}
\ No newline at end of file
@@ -0,0 +1,287 @@
+/*
+	world_region.c ~ RL
+	Edits boxes of blocks in one pass per chunk, updating and remeshing once at the end rather than per block
+*/
+
+#define WORLD_INTERNAL
+#include "world.h"
+#include "window.h"
+#include <limits.h>
+
+/* A chunk an edit touched, and which of its blocks changed */
+struct region_chunk
+{
+	int x, z;
+	int min_x, min_y, min_z, max_x, max_y, max_z;	/* Chunk-local box around the blocks that changed, inclusive */
+	int dirty_mask;
+	uint64_t changed[CHUNK_BLOCK_COUNT / 64];		/* Bit per block, indexed like arr */
+};
+
+typedef enum region_mode
+{
+	REGION_FILL,
+	REGION_REPLACE,
+	REGION_PASTE
+} region_mode_t;
+
+struct region_edit
+{
+	region_mode_t mode;
+	block_type_t type, from;		/* Fill with type, or replace "from" with type */
+	const block_type_t* blocks;		/* Paste source, size.x by size.z by size.y with origin at "origin" */
+	block_coords_t min, size;
+	block_coords_t origin;			/* Where min started out, before the box was clipped to the world. Indexes the paste source. */
+	bool skip_air;
+};
+
+/* Picks what the block at coords becomes. Returns false to leave it as it is. */
+static inline bool world_region_pick(const struct region_edit* edit, int x, int y, int z, block_type_t old, block_type_t* type)
+{
+	switch (edit->mode)
+	{
+	case REGION_FILL:
+		*type = edit->type;
+		return true;
+	case REGION_REPLACE:
+		*type = edit->type;
+		return old == edit->from;
+	case REGION_PASTE:
+		*type = edit->blocks[((y - edit->origin.y) * edit->size.z + z - edit->origin.z) * edit->size.x + x - edit->origin.x];
+		return !edit->skip_air || *type != BLOCK_AIR;
+	}
+	return false;
+}
+
+static inline bool world_region_is_changed(const struct region_chunk* touched, int count, int x, int y, int z)
+{
+	if (y < 0 || y >= CHUNK_WY)
+	{
+		return false;
+	}
+	int chunk_x = ROUND_DOWN(x, CHUNK_WX), chunk_z = ROUND_DOWN(z, CHUNK_WZ);
+	for (int i = 0; i < count; i++)
+	{
+		if (touched[i].x == chunk_x && touched[i].z == chunk_z)
+		{
+			int index = CHUNK_INDEX_OF(x - chunk_x, y, z - chunk_z);
+			return (touched[i].changed[index / 64] >> (index % 64)) & 1;
+		}
+	}
+	return false;
+}
+
+/*	Writes one chunk's share of the box, a row of x at a time through each section. Everything a single world_block_set does besides
+	updates and meshes happens per block here, since the journal, random tick counts and light need every change. Returns how many blocks changed. */
+static int world_region_write(const struct region_edit* edit, block_coords_t last, struct region_chunk* touched)
+{
+	struct chunk* chunk = world_chunk_get(touched->x, touched->z);
+	int x0 = max(edit->min.x - chunk->x, 0), x1 = min(last.x - chunk->x, CHUNK_WX - 1);
+	int z0 = max(edit->min.z - chunk->z, 0), z1 = min(last.z - chunk->z, CHUNK_WZ - 1);
+
+	int changed = 0;
+	for (int section = edit->min.y / SECTION_HEIGHT; section <= last.y / SECTION_HEIGHT; section++)
+	{
+		int y0 = max(edit->min.y, section * SECTION_HEIGHT), y1 = min(last.y, section * SECTION_HEIGHT + SECTION_HEIGHT - 1);
+		for (int y = y0; y <= y1; y++)
+		{
+			for (int z = z0; z <= z1; z++)
+			{
+				block_type_t* row = &chunk->arr[CHUNK_INDEX_OF(0, y, z)];
+				for (int x = x0; x <= x1; x++)
+				{
+					block_type_t type, old = row[x];
+					int index = CHUNK_INDEX_OF(x, y, z);
+					if (!world_region_pick(edit, chunk->x + x, y, chunk->z + z, old, &type) || (type == old && world_chunk_meta(chunk, index) == 0))
+					{
+						continue;
+					}
+
+					world_journal_record((block_coords_t) { chunk->x + x, y, chunk->z + z }, old, type, 0);
+					world_tick_replace(chunk, index, old, type);
+					row[x] = type;
+					world_chunk_set_meta(chunk, index, 0);
+					world_light_edit(chunk, (block_coords_t) { chunk->x + x, y, chunk->z + z }, old, type);
+
+					touched->changed[index / 64] |= 1ULL << (index % 64);
+					touched->min_x = min(touched->min_x, x), touched->max_x = max(touched->max_x, x);
+					touched->min_y = min(touched->min_y, y), touched->max_y = max(touched->max_y, y);
+					touched->min_z = min(touched->min_z, z), touched->max_z = max(touched->max_z, z);
+					touched->dirty_mask |= (old == BLOCK_WATER || type == BLOCK_WATER ? LIQUID_BIT : 0) | (old != BLOCK_WATER || type != BLOCK_WATER ? OPAQUE_BIT : 0);
+					changed++;
+				}
+			}
+		}
+	}
+	if (changed > 0)
+	{
+		chunk->version++;
+	}
+	return changed;
+}
+
+static inline void world_region_mark(int x, int z, int mask)
+{
+	struct chunk* chunk = world_chunk_get(x, z);
+	if (chunk)
+	{
+		chunk->dirty_mask |= mask;
+	}
+}
+
+/*	Updates every block that changed or borders one that did, the same set world_block_set would have updated one block at a time.
+	Only types that react to updates can do anything with one, so everything else is skipped before looking at its neighbors. */
+static void world_region_update(const struct region_chunk* touched, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		const struct region_chunk* curr = &touched[i];
+		if (curr->dirty_mask == 0)
+		{
+			continue;
+		}
+
+		/* Blocks just past the chunk's edge are read through a cursor, which stays put on each neighbor while a row is in it */
+		const struct chunk* chunk = world_chunk_get(curr->x, curr->z);
+		block_cursor_t cursor = world_cursor_create((block_coords_t) { curr->x, 0, curr->z });
+		for (int y = max(curr->min_y - 1, 0); y <= min(curr->max_y + 1, CHUNK_WY - 1); y++)
+		{
+			for (int z = curr->min_z - 1; z <= curr->max_z + 1; z++)
+			{
+				for (int x = curr->min_x - 1; x <= curr->max_x + 1; x++)
+				{
+					block_coords_t coords = { curr->x + x, y, curr->z + z };
+					bool inside = x >= 0 && x < CHUNK_WX && z >= 0 && z < CHUNK_WZ;
+					if (!inside)
+					{
+						world_cursor_move(&cursor, coords);
+					}
+					if (!world_tick_reacts(inside ? CHUNK_AT(chunk->arr, x, y, z) : world_cursor_get(&cursor, 0, 0, 0)))
+					{
+						continue;
+					}
+					if (world_region_is_changed(touched, count, coords.x, y, coords.z)
+						|| world_region_is_changed(touched, count, coords.x - 1, y, coords.z) || world_region_is_changed(touched, count, coords.x + 1, y, coords.z)
+						|| world_region_is_changed(touched, count, coords.x, y - 1, coords.z) || world_region_is_changed(touched, count, coords.x, y + 1, coords.z)
+						|| world_region_is_changed(touched, count, coords.x, y, coords.z - 1) || world_region_is_changed(touched, count, coords.x, y, coords.z + 1))
+					{
+						world_tick_block(coords);
+					}
+				}
+			}
+		}
+
+		world_region_mark(curr->x, curr->z, curr->dirty_mask);
+		if (curr->min_x == 0)
+		{
+			world_region_mark(curr->x - CHUNK_WX, curr->z, curr->dirty_mask);
+		}
+		if (curr->max_x == CHUNK_WX - 1)
+		{
+			world_region_mark(curr->x + CHUNK_WX, curr->z, curr->dirty_mask);
+		}
+		if (curr->min_z == 0)
+		{
+			world_region_mark(curr->x, curr->z - CHUNK_WZ, curr->dirty_mask);
+		}
+		if (curr->max_z == CHUNK_WZ - 1)
+		{
+			world_region_mark(curr->x, curr->z + CHUNK_WZ, curr->dirty_mask);
+		}
+	}
+}
+
+/* Runs an edit over the box from edit->min to last. Chunks the box reaches are created first, like world_block_set does. */
+static int world_region_edit(struct region_edit* edit, block_coords_t last)
+{
+	edit->origin = edit->min;
+	edit->min.y = max(edit->min.y, 0);
+	last.y = min(last.y, CHUNK_WY - 1);
+	if (edit->min.x > last.x || edit->min.y > last.y || edit->min.z > last.z)
+	{
+		return 0;
+	}
+
+	int columns_x = (ROUND_DOWN(last.x, CHUNK_WX) - ROUND_DOWN(edit->min.x, CHUNK_WX)) / CHUNK_WX + 1;
+	int columns_z = (ROUND_DOWN(last.z, CHUNK_WZ) - ROUND_DOWN(edit->min.z, CHUNK_WZ)) / CHUNK_WZ + 1;
+	int count = columns_x * columns_z;
+	struct region_chunk* touched = mc_malloc(sizeof * touched * count);
+	for (int i = 0; i < count; i++)
+	{
+		struct region_chunk* curr = &touched[i];
+		curr->x = ROUND_DOWN(edit->min.x, CHUNK_WX) + i % columns_x * CHUNK_WX;
+		curr->z = ROUND_DOWN(edit->min.z, CHUNK_WZ) + i / columns_x * CHUNK_WZ;
+		curr->min_x = curr->min_y = curr->min_z = INT_MAX;
+		curr->max_x = curr->max_y = curr->max_z = INT_MIN;
+		curr->dirty_mask = 0;
+		memset(curr->changed, 0, sizeof curr->changed);
+		world_chunk_create(curr->x, curr->z);
+	}
+
+	/* Creating chunks moves chunk_list around, so chunks are only looked up once they all exist */
+	int changed = 0;
+	for (int i = 0; i < count; i++)
+	{
+		changed += world_region_write(edit, last, &touched[i]);
+	}
+	world_light_propagate();
+	world_region_update(touched, count);
+	free(touched);
+	return changed;
+}
+
+int world_region_fill(block_coords_t first, block_coords_t last, block_type_t type)
+{
+	struct region_edit edit = { .mode = REGION_FILL, .type = type, .min = { min(first.x, last.x), min(first.y, last.y), min(first.z, last.z) } };
+	return world_region_edit(&edit, (block_coords_t) { max(first.x, last.x), max(first.y, last.y), max(first.z, last.z) });
+}
+
+int world_region_replace(block_coords_t first, block_coords_t last, block_type_t from, block_type_t to)
+{
+	struct region_edit edit = { .mode = REGION_REPLACE, .type = to, .from = from, .min = { min(first.x, last.x), min(first.y, last.y), min(first.z, last.z) } };
+	return world_region_edit(&edit, (block_coords_t) { max(first.x, last.x), max(first.y, last.y), max(first.z, last.z) });
+}
+
+int world_region_paste(block_coords_t origin, block_coords_t size, const block_type_t* blocks, bool skip_air)
+{
+	if (size.x <= 0 || size.y <= 0 || size.z <= 0)
+	{
+		return 0;
+	}
+	struct region_edit edit = { .mode = REGION_PASTE, .blocks = blocks, .min = origin, .size = size, .skip_air = skip_air };
+	return world_region_edit(&edit, (block_coords_t) { origin.x + size.x - 1, origin.y + size.y - 1, origin.z + size.z - 1 });
+}
+
+#define BENCHMARK_SIZE	47	/* 47^3 is a little over 100k blocks */
+
+void world_region_benchmark(FILE* stream)
+{
+	world_chunk_init(1);
+	block_coords_t first = { -BENCHMARK_SIZE / 2, 40, -BENCHMARK_SIZE / 2 };
+	block_coords_t last = { first.x + BENCHMARK_SIZE - 1, first.y + BENCHMARK_SIZE - 1, first.z + BENCHMARK_SIZE - 1 };
+	world_region_fill(first, last, BLOCK_AIR);
+
+	block_type_t* blocks = mc_malloc(BENCHMARK_SIZE * BENCHMARK_SIZE * BENCHMARK_SIZE);
+	for (int i = 0; i < BENCHMARK_SIZE * BENCHMARK_SIZE * BENCHMARK_SIZE; i++)
+	{
+		blocks[i] = i % 3 == 0 ? BLOCK_LOG : i % 3 == 1 ? BLOCK_LEAVES : BLOCK_AIR;
+	}
+
+	double start = window_time();
+	int filled = world_region_fill(first, last, BLOCK_STONE);
+	double fill_time = window_time() - start;
+
+	start = window_time();
+	int replaced = world_region_replace(first, last, BLOCK_STONE, BLOCK_DIRT);
+	double replace_time = window_time() - start;
+
+	start = window_time();
+	int pasted = world_region_paste(first, (block_coords_t) { BENCHMARK_SIZE, BENCHMARK_SIZE, BENCHMARK_SIZE }, blocks, true);
+	double paste_time = window_time() - start;
+
+	fprintf(stream, "world_region: fill %i blocks %.2f ms, replace %i blocks %.2f ms, paste %i blocks %.2f ms\n",
+		filled, fill_time * 1000.0, replaced, replace_time * 1000.0, pasted, paste_time * 1000.0);
+
+	free(blocks);
+	world_chunk_destroy();
+	world_tick_destroy();
+}
\ No newline at end of file
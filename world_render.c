@@ -11,6 +11,18 @@
 
 static vertex_buffer_t debug_chunk_border;
 static bool display_debug_chunk_border;
+static int opaque_count, liquid_count;	/* Draw commands world_render_prepare last uploaded, opaque ones first */
+
+static vertex_arena_t chunk_arena;
+
+/* Per-frame scratch for building draw commands, grown to fit twice the chunk count (opaque and liquid passes) */
+static struct draw_scratch
+{
+	int reserved;
+	struct chunk_draw* draws;
+	draw_command_t* commands;
+	vector3_t* offsets;
+} scratch;
 
 enum quad_normal
 {
@@ -30,7 +42,8 @@ static struct block_vertex_list
 	block_vertex_t array[];
 } *block_vertex_list;
 
-static void world_mesh_quad(int mask, int type, enum quad_normal normal)
+/* Meshes the face of the block at mask facing "normal," lit by "light," the light of the cell in front of the face */
+static void world_mesh_quad(int mask, int type, enum quad_normal normal, int light)
 {
 	static const faces[BLOCK_COUNT - 1][8] =
 	{
@@ -102,6 +115,11 @@ static void world_mesh_quad(int mask, int type, enum quad_normal normal)
 		d = SET_BLOCK_VERTEX_TEXTURE(d, 1, 1, type, faces[type][normal]);
 	}
 
+	a = SET_BLOCK_VERTEX_LIGHT(a, light);
+	b = SET_BLOCK_VERTEX_LIGHT(b, light);
+	c = SET_BLOCK_VERTEX_LIGHT(c, light);
+	d = SET_BLOCK_VERTEX_LIGHT(d, light);
+
 	size_t curr = block_vertex_list->count;
 	block_vertex_list->count += 6;
 	block_vertex_list->array[curr + 0] = a;
@@ -122,9 +140,8 @@ static void world_mesh_quad(int mask, int type, enum quad_normal normal)
 	}
 }
 
-static inline const block_type_t* world_chunk_get_array_or_default(int x, int z, const block_type_t* def)
+static inline const block_type_t* world_chunk_array_or_default(const struct chunk* chunk, const block_type_t* def)
 {
-	struct chunk* chunk = world_chunk_get(x, z);
 	if (chunk)
 	{
 		return chunk->arr;
@@ -135,10 +152,14 @@ static inline const block_type_t* world_chunk_get_array_or_default(int x, int z,
 static void world_chunk_clean(struct chunk* chunk)
 {
 	static const block_type_t def[CHUNK_BLOCK_COUNT];
-	const block_type_t* left = world_chunk_get_array_or_default(chunk->x - CHUNK_WX, chunk->z, def),
-		*right = world_chunk_get_array_or_default(chunk->x + CHUNK_WX, chunk->z, def),
-		*backward = world_chunk_get_array_or_default(chunk->x, chunk->z - CHUNK_WZ, def),
-		*forward = world_chunk_get_array_or_default(chunk->x, chunk->z + CHUNK_WZ, def);
+	const struct chunk* left_chunk = world_chunk_get(chunk->x - CHUNK_WX, chunk->z),
+		*right_chunk = world_chunk_get(chunk->x + CHUNK_WX, chunk->z),
+		*backward_chunk = world_chunk_get(chunk->x, chunk->z - CHUNK_WZ),
+		*forward_chunk = world_chunk_get(chunk->x, chunk->z + CHUNK_WZ);
+	const block_type_t* left = world_chunk_array_or_default(left_chunk, def),
+		*right = world_chunk_array_or_default(right_chunk, def),
+		*backward = world_chunk_array_or_default(backward_chunk, def),
+		*forward = world_chunk_array_or_default(forward_chunk, def);
 	const block_type_t* arr = chunk->arr;
 
 	for (int mask = 0; mask < CHUNK_BLOCK_COUNT; mask++)
@@ -152,60 +173,60 @@ static void world_chunk_clean(struct chunk* chunk)
 		curr--;
 		if (y == 0 || !IS_SOLID(CHUNK_AT(arr, x, y - 1, z)))
 		{
-			world_mesh_quad(mask, curr, UP);
+			world_mesh_quad(mask, curr, UP, world_light_get(chunk, x, y - 1, z));
 		}
 		if (y == CHUNK_WY - 1 || !IS_SOLID(CHUNK_AT(arr, x, y + 1, z)))
 		{
-			world_mesh_quad(mask, curr, DOWN);
+			world_mesh_quad(mask, curr, DOWN, world_light_get(chunk, x, y + 1, z));
 		}
 
 		if (x == 0)
 		{
 			if (!IS_SOLID(CHUNK_AT(left, CHUNK_WX - 1, y, z)))
 			{
-				world_mesh_quad(mask, curr, LEFT);
+				world_mesh_quad(mask, curr, LEFT, world_light_get(left_chunk, CHUNK_WX - 1, y, z));
 			}
 		}
 		else if (!IS_SOLID(CHUNK_AT(arr, x - 1, y, z)))
 		{
-			world_mesh_quad(mask, curr, LEFT);
+			world_mesh_quad(mask, curr, LEFT, world_light_get(chunk, x - 1, y, z));
 		}
 		if (x == CHUNK_WX - 1)
 		{
 			if (!IS_SOLID(CHUNK_AT(right, 0, y, z)))
 			{
-				world_mesh_quad(mask, curr, RIGHT);
+				world_mesh_quad(mask, curr, RIGHT, world_light_get(right_chunk, 0, y, z));
 			}
 		}
 		else if (!IS_SOLID(CHUNK_AT(arr, x + 1, y, z)))
 		{
-			world_mesh_quad(mask, curr, RIGHT);
+			world_mesh_quad(mask, curr, RIGHT, world_light_get(chunk, x + 1, y, z));
 		}
 		if (z == 0)
 		{
 			if (!IS_SOLID(CHUNK_AT(backward, x, y, CHUNK_WZ - 1)))
 			{
-				world_mesh_quad(mask, curr, BACKWARD);
+				world_mesh_quad(mask, curr, BACKWARD, world_light_get(backward_chunk, x, y, CHUNK_WZ - 1));
 			}
 		}
 		else if (!IS_SOLID(CHUNK_AT(arr, x, y, z - 1)))
 		{
-			world_mesh_quad(mask, curr, BACKWARD);
+			world_mesh_quad(mask, curr, BACKWARD, world_light_get(chunk, x, y, z - 1));
 		}
 		if (z == CHUNK_WZ - 1)
 		{
 			if (!IS_SOLID(CHUNK_AT(forward, x, y, 0)))
 			{
-				world_mesh_quad(mask, curr, FORWARD);
+				world_mesh_quad(mask, curr, FORWARD, world_light_get(forward_chunk, x, y, 0));
 			}
 		}
 		else if (!IS_SOLID(CHUNK_AT(arr, x, y, z + 1)))
 		{
-			world_mesh_quad(mask, curr, FORWARD);
+			world_mesh_quad(mask, curr, FORWARD, world_light_get(chunk, x, y, z + 1));
 		}
 	}
 
-	graphics_buffer_modify(chunk->opaque_buffer, block_vertex_list->array, block_vertex_list->count);
+	graphics_arena_modify(chunk_arena, &chunk->opaque_range, block_vertex_list->array, (int)block_vertex_list->count);
 	block_vertex_list->count = 0;
 	chunk->dirty_mask ^= OPAQUE_BIT;
 }
@@ -213,10 +234,14 @@ static void world_chunk_clean(struct chunk* chunk)
 static void world_chunk_clean_liquid(struct chunk* chunk)
 {
 	static const block_type_t def[CHUNK_BLOCK_COUNT];
-	const block_type_t* left = world_chunk_get_array_or_default(chunk->x - CHUNK_WX, chunk->z, def),
-		* right = world_chunk_get_array_or_default(chunk->x + CHUNK_WX, chunk->z, def),
-		* backward = world_chunk_get_array_or_default(chunk->x, chunk->z - CHUNK_WZ, def),
-		* forward = world_chunk_get_array_or_default(chunk->x, chunk->z + CHUNK_WZ, def);
+	const struct chunk* left_chunk = world_chunk_get(chunk->x - CHUNK_WX, chunk->z),
+		*right_chunk = world_chunk_get(chunk->x + CHUNK_WX, chunk->z),
+		*backward_chunk = world_chunk_get(chunk->x, chunk->z - CHUNK_WZ),
+		*forward_chunk = world_chunk_get(chunk->x, chunk->z + CHUNK_WZ);
+	const block_type_t* left = world_chunk_array_or_default(left_chunk, def),
+		*right = world_chunk_array_or_default(right_chunk, def),
+		*backward = world_chunk_array_or_default(backward_chunk, def),
+		*forward = world_chunk_array_or_default(forward_chunk, def);
 	const block_type_t* arr = chunk->arr;
 
 	for (int mask = 0; mask < CHUNK_BLOCK_COUNT; mask++)
@@ -230,59 +255,59 @@ static void world_chunk_clean_liquid(struct chunk* chunk)
 		curr--;
 		if (y == 0 || CHUNK_AT(arr, x, y - 1, z) != BLOCK_WATER)
 		{
-			world_mesh_quad(mask, curr, UP);
+			world_mesh_quad(mask, curr, UP, world_light_get(chunk, x, y - 1, z));
 		}
 		if (y == CHUNK_WY - 1 || CHUNK_AT(arr, x, y + 1, z) != BLOCK_WATER)
 		{
-			world_mesh_quad(mask, curr, DOWN);
+			world_mesh_quad(mask, curr, DOWN, world_light_get(chunk, x, y + 1, z));
 		}
 		if (x == 0)
 		{
 			if (CHUNK_AT(left, CHUNK_WX - 1, y, z) != BLOCK_WATER)
 			{
-				world_mesh_quad(mask, curr, LEFT);
+				world_mesh_quad(mask, curr, LEFT, world_light_get(left_chunk, CHUNK_WX - 1, y, z));
 			}
 		}
 		else if (CHUNK_AT(arr, x - 1, y, z) != BLOCK_WATER)
 		{
-			world_mesh_quad(mask, curr, LEFT);
+			world_mesh_quad(mask, curr, LEFT, world_light_get(chunk, x - 1, y, z));
 		}
 		if (x == CHUNK_WX - 1)
 		{
 			if (CHUNK_AT(right, 0, y, z) != BLOCK_WATER)
 			{
-				world_mesh_quad(mask, curr, RIGHT);
+				world_mesh_quad(mask, curr, RIGHT, world_light_get(right_chunk, 0, y, z));
 			}
 		}
 		else if (CHUNK_AT(arr, x + 1, y, z) != BLOCK_WATER)
 		{
-			world_mesh_quad(mask, curr, RIGHT);
+			world_mesh_quad(mask, curr, RIGHT, world_light_get(chunk, x + 1, y, z));
 		}
 		if (z == 0)
 		{
 			if (CHUNK_AT(backward, x, y, CHUNK_WZ - 1) != BLOCK_WATER)
 			{
-				world_mesh_quad(mask, curr, BACKWARD);
+				world_mesh_quad(mask, curr, BACKWARD, world_light_get(backward_chunk, x, y, CHUNK_WZ - 1));
 			}
 		}
 		else if (CHUNK_AT(arr, x, y, z - 1) != BLOCK_WATER)
 		{
-			world_mesh_quad(mask, curr, BACKWARD);
+			world_mesh_quad(mask, curr, BACKWARD, world_light_get(chunk, x, y, z - 1));
 		}
 		if (z == CHUNK_WZ - 1)
 		{
 			if (CHUNK_AT(forward, x, y, 0) != BLOCK_WATER)
 			{
-				world_mesh_quad(mask, curr, FORWARD);
+				world_mesh_quad(mask, curr, FORWARD, world_light_get(forward_chunk, x, y, 0));
 			}
 		}
 		else if (CHUNK_AT(arr, x, y, z + 1) != BLOCK_WATER)
 		{
-			world_mesh_quad(mask, curr, FORWARD);
+			world_mesh_quad(mask, curr, FORWARD, world_light_get(chunk, x, y, z + 1));
 		}
 	}
 
-	graphics_buffer_modify(chunk->liquid_buffer, block_vertex_list->array, block_vertex_list->count);
+	graphics_arena_modify(chunk_arena, &chunk->liquid_range, block_vertex_list->array, (int)block_vertex_list->count);
 	block_vertex_list->count = 0;
 	chunk->dirty_mask ^= LIQUID_BIT;
 }
@@ -309,6 +334,54 @@ void world_chunk_clean_mesh(struct chunk* chunk)
 	}
 }
 
+void world_chunk_free_mesh(struct chunk* chunk)
+{
+	if (chunk_arena)
+	{
+		graphics_arena_free(chunk_arena, &chunk->opaque_range);
+		graphics_arena_free(chunk_arena, &chunk->liquid_range);
+	}
+}
+
+int world_render_build_commands(const struct chunk_draw* draws, int count, int base, draw_command_t* commands, vector3_t* offsets)
+{
+	int written = 0;
+	for (int i = 0; i < count; i++)
+	{
+		if (draws[i].range.count <= 0)
+		{
+			continue;
+		}
+
+		commands[written] = (draw_command_t)
+		{
+			.count = (uint32_t)draws[i].range.count,
+			.instance_count = 1,
+			.first = (uint32_t)draws[i].range.first,
+			.base_instance = (uint32_t)(base + written)
+		};
+		offsets[written] = (vector3_t){ (float)draws[i].x, 0.0F, (float)draws[i].z };
+		written++;
+	}
+	return written;
+}
+
+static void world_render_reserve_scratch(int count)
+{
+	if (count <= scratch.reserved)
+	{
+		return;
+	}
+
+	free(scratch.draws);
+	free(scratch.commands);
+	free(scratch.offsets);
+	scratch.reserved = max(count, scratch.reserved * 2);
+	scratch.draws = mc_malloc(sizeof * scratch.draws * scratch.reserved);
+	scratch.commands = mc_malloc(sizeof * scratch.commands * scratch.reserved);
+	scratch.offsets = mc_malloc(sizeof * scratch.offsets * scratch.reserved);
+}
+
 void world_render_init(void)
 {
 	array_list_t vertices = mc_list_create(sizeof(float));
@@ -320,40 +393,39 @@ void world_render_init(void)
 	}
 	debug_chunk_border = graphics_buffer_create(mc_list_array(vertices), mc_list_count(vertices) / 3, VERTEX_POSITION);
 	mc_list_destroy(&vertices);
+
+	chunk_arena = graphics_arena_create(1 << 20, VERTEX_BLOCK);
 }
 
 void world_render_destroy(void)
 {
 	graphics_buffer_delete(&debug_chunk_border);
+	graphics_arena_delete(&chunk_arena);
+
+	free(scratch.draws);
+	free(scratch.commands);
+	free(scratch.offsets);
+	scratch = (struct draw_scratch){ 0 };
 }
 
-void world_render(const shader_t solid, const shader_t liquid, float delta)
+void world_render_prepare(void)
 {
-	graphics_shader_use(solid);
-	matrix_t cam;
-	camera_view_projection(cam);
-	graphics_shader_matrix("camera", cam);
-	for (int i = 0; i < mc_list_count(chunk_list); i++)
+	int chunk_count = mc_list_count(chunk_list);
+	world_render_reserve_scratch(chunk_count * 2);
+
+	/* Opaque draws fill the front half of the scratch, liquid draws the back half */
+	for (int i = 0; i < chunk_count; i++)
 	{
 		struct chunk* chunk = MC_LIST_CAST_GET(chunk_list, i, struct chunk);
 		world_chunk_clean_mesh(chunk);
-
-		matrix_t transform;
-		matrix_translation((vector3_t) { (float)chunk->x, 0.0F, (float)chunk->z }, transform);
-		graphics_shader_matrix("model", transform);
-		graphics_buffer_draw(chunk->opaque_buffer);
+		scratch.draws[i] = (struct chunk_draw){ chunk->x, chunk->z, chunk->opaque_range };
+		scratch.draws[chunk_count + i] = (struct chunk_draw){ chunk->x, chunk->z, chunk->liquid_range };
 	}
 
-	graphics_shader_use(liquid);
-	graphics_shader_matrix("camera", cam);
-	for (int i = 0; i < mc_list_count(chunk_list); i++)
-	{
-		struct chunk* chunk = MC_LIST_CAST_GET(chunk_list, i, struct chunk);
-		matrix_t transform;
-		matrix_translation((vector3_t) { (float)chunk->x, 0.0F, (float)chunk->z }, transform);
-		graphics_shader_matrix("model", transform);
-		graphics_buffer_draw(chunk->liquid_buffer);
-	}
+	opaque_count = world_render_build_commands(scratch.draws, chunk_count, 0, scratch.commands, scratch.offsets);
+	liquid_count = world_render_build_commands(scratch.draws + chunk_count, chunk_count, opaque_count,
+		scratch.commands + opaque_count, scratch.offsets + opaque_count);
+	graphics_arena_commands(chunk_arena, scratch.commands, opaque_count + liquid_count, scratch.offsets, sizeof * scratch.offsets);
 
 	static int prev_tick = -1;
 	if (prev_tick != world_ticks())
@@ -364,10 +436,26 @@ void world_render(const shader_t solid, const shader_t liquid, float delta)
 			display_debug_chunk_border = !display_debug_chunk_border;
 		}
 	}
+}
+
+void world_render(const shader_t solid, const shader_t liquid, float daylight, float delta)
+{
+	matrix_t cam;
+	camera_view_projection(cam);
+
+	graphics_shader_use(solid);
+	graphics_shader_matrix("camera", cam);
+	graphics_shader_float("daylight", daylight);
+	graphics_arena_draw(chunk_arena, 0, opaque_count);
+
+	graphics_shader_use(liquid);
+	graphics_shader_matrix("camera", cam);
+	graphics_shader_float("daylight", daylight);
+	graphics_arena_draw(chunk_arena, opaque_count, liquid_count);
 
 	if (display_debug_chunk_border)
 	{
-		vector3_t player_pos = aabb_get_center(player.hitbox);
+		vector3_t player_pos = camera_position();
 		player_pos.x = ROUND_DOWN(round(player_pos.x), CHUNK_WX);
 		player_pos.y = 0.0F;
 		player_pos.z = ROUND_DOWN(round(player_pos.z), CHUNK_WZ);
@@ -377,4 +465,39 @@ void world_render(const shader_t solid, const shader_t liquid, float delta)
 				.position = player_pos
 		});
 	}
-}
\ No newline at end of file
+}
+
+#define BENCHMARK_DRAWS			10000
+#define BENCHMARK_ITERATIONS	1000
+
+void world_render_benchmark(FILE* stream)
+{
+	struct chunk_draw* draws = mc_malloc(sizeof * draws * BENCHMARK_DRAWS);
+	draw_command_t* commands = mc_malloc(sizeof * commands * BENCHMARK_DRAWS);
+	vector3_t* offsets = mc_malloc(sizeof * offsets * BENCHMARK_DRAWS);
+
+	/* Roughly what a loaded scene looks like: most meshes have a few thousand vertices, some are empty */
+	srand(1);
+	int first = 0;
+	for (int i = 0; i < BENCHMARK_DRAWS; i++)
+	{
+		int count = rand() % 8 == 0 ? 0 : rand() % 6144;
+		draws[i] = (struct chunk_draw){ (rand() % 200 - 100) * CHUNK_WX, (rand() % 200 - 100) * CHUNK_WZ, { first, count, count } };
+		first += count;
+	}
+
+	int written = 0;
+	double start = window_time();
+	for (int i = 0; i < BENCHMARK_ITERATIONS; i++)
+	{
+		written = world_render_build_commands(draws, BENCHMARK_DRAWS, 0, commands, offsets);
+	}
+	double elapsed = window_time() - start;
+
+	fprintf(stream, "world_render_build_commands: %i draws -> %i commands, %.2f us per build (%.1f ns per draw)\n",
+		BENCHMARK_DRAWS, written, elapsed / BENCHMARK_ITERATIONS * 1.0e6, elapsed / BENCHMARK_ITERATIONS / BENCHMARK_DRAWS * 1.0e9);
+
+	free(draws);
+	free(commands);
+	free(offsets);
+}
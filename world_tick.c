@@ -0,0 +1,577 @@
+/*
+	world_tick.c ~ RL
+	Schedules block ticks per chunk, so a tick only costs anything for the blocks that are due, and draws random ticks
+*/
+
+#define WORLD_INTERNAL
+#include "world.h"
+#include "window.h"
+#include "worker.h"
+#include <limits.h>
+
+#define RANDOM_TICKS_PER_SECTION	3			/* Blocks drawn from every section with something to tick, each tick */
+#define RANDOM_TICK_SALT			0x7E1C4A55U	/* Keeps random ticks from drawing the same numbers as generation */
+#define TILE_CHUNKS					2			/* Chunks along each side of a random tick tile */
+#define TILE_WIDTH					(TILE_CHUNKS * CHUNK_WX)
+#define TILE_PASSES					4			/* Checkerboard passes, tiles in the same pass never touch */
+
+struct tick_tile;
+
+typedef void (*block_tick_func_t)(block_coords_t coords);
+/*	Random tick handler. "random" is 32 bits for the handler to make its own choices with. Handlers run on workers alongside the rest of their pass,
+	so they may only read blocks up to a chunk away from coords and must set blocks through world_tick_set. */
+typedef void (*block_random_func_t)(struct tick_tile* tile, block_coords_t coords, uint32_t random);
+
+/*	How a block type reacts to being updated and to random ticks. Types without a tick function ignore updates entirely,
+	and types without a random tick function never count toward a section's random ticks. */
+struct block_behavior
+{
+	int delay;					/* Ticks between an update reaching the block and it ticking */
+	block_tick_func_t tick;
+	block_random_func_t random_tick;
+};
+
+/* One pending block tick */
+struct scheduled_tick
+{
+	int due;
+	uint16_t index;	/* CHUNK_INDEX_OF the block in its chunk */
+};
+
+/* A chunk's pending block ticks. Chunks without any have none allocated. */
+struct tick_queue
+{
+	struct scheduled_tick* heap;	/* Min-heap on due, earliest at 0 */
+	int count, reserved;
+	uint64_t* scheduled[SECTION_COUNT];	/* Bit per block of each section, set while it has a pending tick so repeats coalesce. NULL if none do. */
+};
+
+/* A block a random tick handler set */
+struct tick_edit
+{
+	block_coords_t coords;
+	block_type_t old, type;
+	uint8_t old_meta, meta;
+};
+
+/*	A square of TILE_CHUNKS by TILE_CHUNKS chunks whose random ticks run together on one worker. Tiles run in four passes by the parity of their
+	coordinates, so the tiles of a pass are a whole tile apart and a handler reaching a chunk over never meets another handler of the same pass. */
+struct tick_tile
+{
+	int x, z;		/* Block space, multiples of TILE_WIDTH */
+	int pass;
+	int chunks[TILE_CHUNKS * TILE_CHUNKS];	/* Indices into chunk_list */
+	int chunk_count, drawn;
+	array_list_t written;	/* struct tick_edit array_list of blocks in the tile, already written. The rest of their bookkeeping waits for the merge. */
+	array_list_t deferred;	/* struct tick_edit array_list of blocks outside the tile, set at the merge */
+};
+
+/* Sort key placing chunks by pass, then tile, then position in the tile */
+struct tile_key
+{
+	int pass, z, x, chunk_z, chunk_x, index;
+};
+
+static void world_tick_grass(struct tick_tile* tile, block_coords_t coords, uint32_t random);
+
+static const struct block_behavior block_behaviors[BLOCK_COUNT] =
+{
+	[BLOCK_WATER] = { 1, world_water_wake },	/* Flows in world_water.c, it only needs to know which sections to step */
+	[BLOCK_GRASS] = { 0, NULL, world_tick_grass },
+};
+
+static int next_due = INT_MAX;		/* Earliest due tick of any chunk, ticks before it skip the chunks entirely */
+static array_list_t due_ticks;		/* block_coords_t array_list, reused each tick */
+static array_list_t tiles;			/* struct tick_tile array_list, kept between ticks so the edit lists are reused */
+static array_list_t tile_keys;		/* struct tile_key array_list, reused each tick */
+
+/*	Sets the block at coords for a random tick handler running in tile. Blocks inside the tile are written right away, and the tile sees its own
+	writes. Blocks outside it are left for the merge, as another tile may be reading them. Like water, ticks do not reach into unloaded chunks. */
+static void world_tick_set(struct tick_tile* tile, block_coords_t coords, block_type_t type)
+{
+	struct chunk* chunk = world_chunk_get(coords.x, coords.z);
+	if (IS_INVALID_BLOCK_COORDS(coords) || !chunk)
+	{
+		return;
+	}
+
+	struct tick_edit edit = { coords, BLOCK_AIR, type, 0, 0 };
+	if (coords.x >= tile->x && coords.x < tile->x + TILE_WIDTH && coords.z >= tile->z && coords.z < tile->z + TILE_WIDTH)
+	{
+		int index = CHUNK_INDEX_OF(coords.x - chunk->x, coords.y, coords.z - chunk->z);
+		edit.old = chunk->arr[index];
+		edit.old_meta = (uint8_t)world_chunk_meta(chunk, index);
+		chunk->arr[index] = type;
+		world_chunk_set_meta(chunk, index, 0);
+		mc_list_add(tile->written, mc_list_count(tile->written), &edit, sizeof edit);
+	}
+	else
+	{
+		mc_list_add(tile->deferred, mc_list_count(tile->deferred), &edit, sizeof edit);
+	}
+}
+
+/* Grass dies under solid blocks, and otherwise spreads to dirt with nothing solid on it up to a block away and three down */
+static void world_tick_grass(struct tick_tile* tile, block_coords_t coords, uint32_t random)
+{
+	block_cursor_t cursor = world_cursor_create(coords);
+	if (IS_SOLID(world_cursor_get(&cursor, 0, 1, 0)))
+	{
+		world_tick_set(tile, coords, BLOCK_DIRT);
+		return;
+	}
+
+	int dx = (int)(random % 3) - 1, dy = (int)(random / 3 % 5) - 3, dz = (int)(random / 15 % 3) - 1;
+	if (world_cursor_get(&cursor, dx, dy, dz) == BLOCK_DIRT && !IS_SOLID(world_cursor_get(&cursor, dx, dy + 1, dz)))
+	{
+		world_tick_set(tile, (block_coords_t) { coords.x + dx, coords.y + dy, coords.z + dz }, BLOCK_GRASS);
+	}
+}
+
+/* Flips the coalescing bit for the block at index in queue, returning what it was */
+static inline bool world_tick_toggle(struct tick_queue* queue, int index, bool set)
+{
+	int section = CHUNK_Y(index) / SECTION_HEIGHT, bit = index % SECTION_BLOCK_COUNT;
+	if (!queue->scheduled[section])
+	{
+		if (!set)
+		{
+			return false;
+		}
+		queue->scheduled[section] = mc_malloc(SECTION_BLOCK_COUNT / 8);
+		memset(queue->scheduled[section], 0, SECTION_BLOCK_COUNT / 8);
+	}
+	uint64_t* word = &queue->scheduled[section][bit / 64], mask = 1ULL << (bit % 64);
+	bool was = (*word & mask) != 0;
+	*word = set ? *word | mask : *word & ~mask;
+	return was;
+}
+
+static void world_tick_push(struct tick_queue* queue, struct scheduled_tick tick)
+{
+	if (queue->count >= queue->reserved)
+	{
+		queue->reserved = max(queue->reserved * 2, 16);
+		queue->heap = realloc(queue->heap, queue->reserved * sizeof * queue->heap);
+		mc_panic_if(!queue->heap, "Failed to grow block tick queue");
+	}
+	int i = queue->count++;
+	while (i > 0 && queue->heap[(i - 1) / 2].due > tick.due)
+	{
+		queue->heap[i] = queue->heap[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+	queue->heap[i] = tick;
+}
+
+static struct scheduled_tick world_tick_pop(struct tick_queue* queue)
+{
+	struct scheduled_tick result = queue->heap[0], last = queue->heap[--queue->count];
+	int i = 0;
+	while (i * 2 + 1 < queue->count)
+	{
+		int child = i * 2 + 1;
+		if (child + 1 < queue->count && queue->heap[child + 1].due < queue->heap[child].due)
+		{
+			child++;
+		}
+		if (last.due <= queue->heap[child].due)
+		{
+			break;
+		}
+		queue->heap[i] = queue->heap[child];
+		i = child;
+	}
+	queue->heap[i] = last;
+	return result;
+}
+
+void world_tick_schedule(block_coords_t coords, int delay)
+{
+	struct chunk* chunk = world_chunk_get(coords.x, coords.z);
+	if (IS_INVALID_BLOCK_COORDS(coords) || !chunk)
+	{
+		return;
+	}
+
+	if (!chunk->ticks)
+	{
+		chunk->ticks = mc_malloc(sizeof * chunk->ticks);
+		memset(chunk->ticks, 0, sizeof * chunk->ticks);
+	}
+	int index = CHUNK_INDEX_OF(coords.x - chunk->x, coords.y, coords.z - chunk->z);
+	if (world_tick_toggle(chunk->ticks, index, true))
+	{
+		return;
+	}
+
+	int due = world_ticks() + max(delay, 1);
+	world_tick_push(chunk->ticks, (struct scheduled_tick) { due, (uint16_t)index });
+	next_due = min(next_due, due);
+}
+
+void world_tick_block(block_coords_t coords)
+{
+	const struct block_behavior* behavior = &block_behaviors[world_block_get(coords)];
+	if (behavior->tick)
+	{
+		world_tick_schedule(coords, behavior->delay);
+	}
+}
+
+bool world_tick_reacts(block_type_t type)
+{
+	return block_behaviors[type].tick != NULL;
+}
+
+void world_tick_run(int now)
+{
+	if (now < next_due)
+	{
+		return;
+	}
+
+	/* Every due tick is taken out before any run, since ticks can add chunks and move chunk_list around */
+	if (!due_ticks)
+	{
+		due_ticks = mc_list_create(sizeof(block_coords_t));
+	}
+	next_due = INT_MAX;
+	struct chunk* chunks = mc_list_array(chunk_list);
+	for (int i = 0; i < mc_list_count(chunk_list); i++)
+	{
+		struct tick_queue* queue = chunks[i].ticks;
+		while (queue && queue->count > 0 && queue->heap[0].due <= now)
+		{
+			struct scheduled_tick tick = world_tick_pop(queue);
+			world_tick_toggle(queue, tick.index, false);
+			block_coords_t coords = { chunks[i].x + CHUNK_X(tick.index), CHUNK_Y(tick.index), chunks[i].z + CHUNK_Z(tick.index) };
+			mc_list_add(due_ticks, mc_list_count(due_ticks), &coords, sizeof coords);
+		}
+		if (queue && queue->count > 0)
+		{
+			next_due = min(next_due, queue->heap[0].due);
+		}
+	}
+
+	block_coords_t* due = mc_list_array(due_ticks);
+	for (int i = 0; i < mc_list_count(due_ticks); i++)
+	{
+		const struct block_behavior* behavior = &block_behaviors[world_block_get(due[i])];
+		if (behavior->tick)
+		{
+			behavior->tick(due[i]);
+		}
+	}
+	mc_list_splice(due_ticks, 0, mc_list_count(due_ticks));
+}
+
+void world_tick_free(struct chunk* chunk)
+{
+	world_tick_free_queue(chunk->ticks);
+	chunk->ticks = NULL;
+}
+
+void world_tick_free_queue(struct tick_queue* queue)
+{
+	if (!queue)
+	{
+		return;
+	}
+	for (int i = 0; i < SECTION_COUNT; i++)
+	{
+		free(queue->scheduled[i]);
+	}
+	free(queue->heap);
+	free(queue);
+}
+
+void world_tick_adopt(struct chunk* chunk, struct tick_queue* queue)
+{
+	world_tick_free(chunk);
+	chunk->ticks = queue;
+	if (queue && queue->count > 0)
+	{
+		next_due = min(next_due, queue->heap[0].due);
+	}
+}
+
+void world_tick_destroy(void)
+{
+	if (due_ticks)
+	{
+		mc_list_destroy(&due_ticks);
+	}
+	if (tiles)
+	{
+		for (int i = 0; i < mc_list_count(tiles); i++)
+		{
+			struct tick_tile* tile = MC_LIST_CAST_GET(tiles, i, struct tick_tile);
+			mc_list_destroy(&tile->written);
+			mc_list_destroy(&tile->deferred);
+		}
+		mc_list_destroy(&tiles);
+		mc_list_destroy(&tile_keys);
+	}
+	next_due = INT_MAX;
+}
+
+static inline uint32_t world_tick_xorshift(uint32_t* state)
+{
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *state = x;
+}
+
+/* Counts the blocks with a random tick in each of chunk's sections and seeds the sections' generators */
+static void world_tick_count(struct chunk* chunk)
+{
+	random_t random = mc_random_create(world_seed() ^ RANDOM_TICK_SALT, chunk->x, chunk->z);
+	for (int section = 0; section < SECTION_COUNT; section++)
+	{
+		int count = 0;
+		const block_type_t* blocks = &chunk->arr[section * SECTION_BLOCK_COUNT];
+		for (int i = 0; i < SECTION_BLOCK_COUNT; i++)
+		{
+			count += block_behaviors[blocks[i]].random_tick != NULL;
+		}
+		chunk->random_tickable[section] = (uint16_t)count;
+		chunk->random_state[section] = mc_random_next(&random) | 1;
+	}
+	chunk->random_counted = true;
+}
+
+void world_tick_replace(struct chunk* chunk, int index, block_type_t old, block_type_t type)
+{
+	if (!chunk->random_counted)
+	{
+		return;
+	}
+	int section = CHUNK_Y(index) / SECTION_HEIGHT;
+	chunk->random_tickable[section] -= block_behaviors[old].random_tick != NULL;
+	chunk->random_tickable[section] += block_behaviors[type].random_tick != NULL;
+}
+
+static int world_tick_compare_keys(const void* a, const void* b)
+{
+	const struct tile_key* left = a, * right = b;
+	if (left->pass != right->pass)
+	{
+		return left->pass - right->pass;
+	}
+	if (left->z != right->z)
+	{
+		return left->z < right->z ? -1 : 1;
+	}
+	if (left->x != right->x)
+	{
+		return left->x < right->x ? -1 : 1;
+	}
+	if (left->chunk_z != right->chunk_z)
+	{
+		return left->chunk_z < right->chunk_z ? -1 : 1;
+	}
+	return left->chunk_x < right->chunk_x ? -1 : left->chunk_x > right->chunk_x;
+}
+
+/*	Groups every loaded chunk into tiles, ordered by pass and then position so the merge applies edits in the same order however many workers
+	there are. Counts chunks that have not been counted yet while at it. Tiles of pass i are [passes[i], passes[i + 1]). */
+static void world_tick_tiles(int passes[TILE_PASSES + 1])
+{
+	if (!tiles)
+	{
+		tiles = mc_list_create(sizeof(struct tick_tile));
+		tile_keys = mc_list_create(sizeof(struct tile_key));
+	}
+
+	mc_list_splice(tile_keys, 0, mc_list_count(tile_keys));
+	for (int i = 0; i < mc_list_count(chunk_list); i++)
+	{
+		struct chunk* chunk = MC_LIST_CAST_GET(chunk_list, i, struct chunk);
+		if (!chunk->random_counted)
+		{
+			world_tick_count(chunk);
+		}
+		struct tile_key key = { 0, ROUND_DOWN(chunk->z, TILE_WIDTH), ROUND_DOWN(chunk->x, TILE_WIDTH), chunk->z, chunk->x, i };
+		key.pass = (key.x / TILE_WIDTH & 1) | (key.z / TILE_WIDTH & 1) << 1;
+		mc_list_add(tile_keys, mc_list_count(tile_keys), &key, sizeof key);
+	}
+	struct tile_key* keys = mc_list_array(tile_keys);
+	qsort(keys, mc_list_count(tile_keys), sizeof * keys, world_tick_compare_keys);
+
+	int count = 0;
+	for (int i = 0; i < mc_list_count(tile_keys); i++)
+	{
+		if (i == 0 || keys[i].x != keys[i - 1].x || keys[i].z != keys[i - 1].z)
+		{
+			if (count == mc_list_count(tiles))
+			{
+				struct tick_tile fresh = { 0 };
+				fresh.written = mc_list_create(sizeof(struct tick_edit));
+				fresh.deferred = mc_list_create(sizeof(struct tick_edit));
+				mc_list_add(tiles, count, &fresh, sizeof fresh);
+			}
+			struct tick_tile* tile = MC_LIST_CAST_GET(tiles, count, struct tick_tile);
+			count++;
+			tile->x = keys[i].x;
+			tile->z = keys[i].z;
+			tile->pass = keys[i].pass;
+			tile->chunk_count = 0;
+		}
+		struct tick_tile* tile = MC_LIST_CAST_GET(tiles, count - 1, struct tick_tile);
+		tile->chunks[tile->chunk_count++] = keys[i].index;
+	}
+
+	struct tick_tile* list = mc_list_array(tiles);
+	for (int pass = 0, i = 0; pass <= TILE_PASSES; pass++)
+	{
+		while (i < count && list[i].pass < pass)
+		{
+			i++;
+		}
+		passes[pass] = i;
+	}
+}
+
+/* Draws the random ticks of every chunk in a tile. "user" is the first tile of the pass. */
+static void world_tick_random_tile(int item, int worker, void* user)
+{
+	struct tick_tile* tile = (struct tick_tile*)user + item;
+	tile->drawn = 0;
+	for (int i = 0; i < tile->chunk_count; i++)
+	{
+		struct chunk* chunk = MC_LIST_CAST_GET(chunk_list, tile->chunks[i], struct chunk);
+		for (int section = 0; section < SECTION_COUNT; section++)
+		{
+			for (int j = 0; j < RANDOM_TICKS_PER_SECTION && chunk->random_tickable[section] > 0; j++)
+			{
+				uint32_t random = world_tick_xorshift(&chunk->random_state[section]);
+				int index = section * SECTION_BLOCK_COUNT + (int)(random % SECTION_BLOCK_COUNT);
+				block_random_func_t handler = block_behaviors[chunk->arr[index]].random_tick;
+				tile->drawn++;
+				if (handler)
+				{
+					/* Handlers get the bits the index did not use */
+					handler(tile, (block_coords_t) { chunk->x + CHUNK_X(index), CHUNK_Y(index), chunk->z + CHUNK_Z(index) }, random / SECTION_BLOCK_COUNT);
+				}
+			}
+		}
+	}
+}
+
+/*	Finishes a pass in tile order. Writes inside tiles are finished first, so a deferred write landing on a block another tile wrote is journaled after it.
+	Nothing here adds chunks, deferred writes only ever land in loaded ones. */
+static void world_tick_merge(struct tick_tile* list, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		struct tick_edit* edits = mc_list_array(list[i].written);
+		for (int j = 0; j < mc_list_count(list[i].written); j++)
+		{
+			struct chunk* chunk = world_chunk_get(edits[j].coords.x, edits[j].coords.z);
+			world_block_changed(chunk, edits[j].coords, edits[j].old, edits[j].old_meta, edits[j].type, edits[j].meta);
+		}
+		mc_list_splice(list[i].written, 0, mc_list_count(list[i].written));
+	}
+	/* Spreads the light the writes queued, once for the whole pass */
+	world_light_propagate();
+	for (int i = 0; i < count; i++)
+	{
+		struct tick_edit* edits = mc_list_array(list[i].deferred);
+		for (int j = 0; j < mc_list_count(list[i].deferred); j++)
+		{
+			world_block_set_meta(edits[j].coords, edits[j].type, edits[j].meta);
+		}
+		mc_list_splice(list[i].deferred, 0, mc_list_count(list[i].deferred));
+	}
+}
+
+int world_tick_random(void)
+{
+	int passes[TILE_PASSES + 1];
+	world_tick_tiles(passes);
+
+	/*	Tiles of a pass run in parallel, reading the world as the earlier passes and their own writes left it. Each tile draws from its own
+		sections' generators in a fixed order and the merge is in tile order, so the result is the same however many workers there are. */
+	int drawn = 0;
+	struct tick_tile* list = mc_list_array(tiles);
+	for (int pass = 0; pass < TILE_PASSES; pass++)
+	{
+		int count = passes[pass + 1] - passes[pass];
+		worker_for(count, world_tick_random_tile, list + passes[pass]);
+		world_tick_merge(list + passes[pass], count);
+		for (int i = passes[pass]; i < passes[pass + 1]; i++)
+		{
+			drawn += list[i].drawn;
+		}
+	}
+	return drawn;
+}
+
+#define BENCHMARK_RADIUS	8
+#define BENCHMARK_TICKS		2000
+
+struct tick_benchmark
+{
+	int workers, chunks, tickable, sections;
+	long long drawn;
+	double elapsed;
+	hash_t result;	/* Hash of every block after the run */
+};
+
+/* Runs the benchmark on "threads" workers, 0 for one per logical processor */
+static struct tick_benchmark world_tick_benchmark_run(int threads)
+{
+	struct tick_benchmark result = { 0 };
+	worker_init(threads);
+	result.workers = worker_count();
+
+	/* A freshly generated square of chunks, as the game would have loaded around the player */
+	world_chunk_init(1);
+	for (int i = -BENCHMARK_RADIUS; i < BENCHMARK_RADIUS; i++)
+	{
+		for (int j = -BENCHMARK_RADIUS; j < BENCHMARK_RADIUS; j++)
+		{
+			world_chunk_create(i * CHUNK_WX, j * CHUNK_WZ);
+		}
+	}
+	world_tick_random();
+
+	result.chunks = mc_list_count(chunk_list);
+	result.sections = result.chunks * SECTION_COUNT;
+	for (int i = 0; i < result.chunks; i++)
+	{
+		for (int section = 0; section < SECTION_COUNT; section++)
+		{
+			result.tickable += MC_LIST_CAST_GET(chunk_list, i, struct chunk)->random_tickable[section] > 0;
+		}
+	}
+
+	double start = window_time();
+	for (int i = 0; i < BENCHMARK_TICKS; i++)
+	{
+		result.drawn += world_tick_random();
+	}
+	result.elapsed = window_time() - start;
+
+	for (int i = 0; i < result.chunks; i++)
+	{
+		result.result = result.result * 31 + mc_hash(MC_LIST_CAST_GET(chunk_list, i, struct chunk)->arr, CHUNK_BLOCK_COUNT * sizeof(block_type_t));
+	}
+
+	world_chunk_destroy();
+	world_tick_destroy();
+	worker_destroy();
+	return result;
+}
+
+void world_tick_benchmark(FILE* stream)
+{
+	struct tick_benchmark single = world_tick_benchmark_run(1), parallel = world_tick_benchmark_run(0);
+	fprintf(stream, "world_tick_random: %i chunks, %i/%i sections tickable, %.2f us per tick, %.1f million random ticks per second\n",
+		single.chunks, single.tickable, single.sections, single.elapsed / BENCHMARK_TICKS * 1.0e6, single.drawn / single.elapsed / 1.0e6);
+	fprintf(stream, "world_tick_random: %i workers, %.2f us per tick, %.1fx, %s\n", parallel.workers, parallel.elapsed / BENCHMARK_TICKS * 1.0e6,
+		single.elapsed / parallel.elapsed, single.result == parallel.result ? "same result" : "RESULT DIFFERS");
+}
\ No newline at end of file
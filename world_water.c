@@ -0,0 +1,238 @@
+/*
+	world_water.c ~ RL
+	Water flow, stepped as a cellular automaton over the sections that have not settled
+*/
+
+#define WORLD_INTERNAL
+#include "world.h"
+#include "worker.h"
+
+#define WATER_FLOW_RATE	5	/* Ticks between flow steps */
+#define WATER_SOLID		-1	/* Level of anything water cannot flow into */
+#define WATER_SOURCE	WATER_STRENGTH
+#define PADDED			(SECTION_HEIGHT + 2)	/* A section and a block of its neighbors on every side */
+
+/* A block the flow step changes, applied once every section has been stepped */
+struct water_change
+{
+	block_coords_t coords;
+	block_type_t type;
+	int meta;
+};
+
+/* A chunk with sections to step, and what stepping them changed */
+struct water_job
+{
+	int x, z;
+	unsigned int active;
+	array_list_t changes;	/* struct water_change array_list */
+};
+
+typedef int8_t water_grid_t[PADDED][PADDED][PADDED];
+
+static array_list_t jobs;		/* struct water_job array_list, kept between steps so the change lists are reused */
+static water_grid_t* grids;		/* Two per worker, the level before and after a step */
+static int grid_workers;
+
+static inline void world_water_wake_block(int x, int y, int z)
+{
+	struct chunk* chunk = world_chunk_get(x, z);
+	if (chunk && y >= 0 && y < CHUNK_WY)
+	{
+		chunk->water_active |= 1U << (y / SECTION_HEIGHT);
+	}
+}
+
+void world_water_wake(block_coords_t coords)
+{
+	world_water_wake_block(coords.x, coords.y, coords.z);
+	world_water_wake_block(coords.x - 1, coords.y, coords.z);
+	world_water_wake_block(coords.x + 1, coords.y, coords.z);
+	world_water_wake_block(coords.x, coords.y - 1, coords.z);
+	world_water_wake_block(coords.x, coords.y + 1, coords.z);
+	world_water_wake_block(coords.x, coords.y, coords.z - 1);
+	world_water_wake_block(coords.x, coords.y, coords.z + 1);
+}
+
+/*	Fills levels with the water level of every block in the section at (x, z), "section" and one block around it.
+	Air is 0, flowing water counts up toward sources at WATER_SOURCE, and everything else, unloaded chunks included, is WATER_SOLID. */
+static void world_water_gather(int x, int z, int section, int8_t levels[PADDED][PADDED][PADDED])
+{
+	struct chunk* neighbors[3][3];
+	for (int i = 0; i < 3; i++)
+	{
+		for (int j = 0; j < 3; j++)
+		{
+			neighbors[i][j] = world_chunk_get(x + (j - 1) * CHUNK_WX, z + (i - 1) * CHUNK_WZ);
+		}
+	}
+
+	int base_y = section * SECTION_HEIGHT - 1;
+	for (int pz = 0; pz < PADDED; pz++)
+	{
+		for (int px = 0; px < PADDED; px++)
+		{
+			int bx = px - 1, bz = pz - 1;
+			const struct chunk* chunk = neighbors[bz < 0 ? 0 : bz < CHUNK_WZ ? 1 : 2][bx < 0 ? 0 : bx < CHUNK_WX ? 1 : 2];
+			bx = (bx + CHUNK_WX) % CHUNK_WX;
+			bz = (bz + CHUNK_WZ) % CHUNK_WZ;
+			for (int py = 0; py < PADDED; py++)
+			{
+				int y = base_y + py;
+				int8_t level = WATER_SOLID;
+				if (y >= CHUNK_WY)
+				{
+					level = 0;
+				}
+				else if (chunk && y >= 0)
+				{
+					int index = CHUNK_INDEX_OF(bx, y, bz);
+					block_type_t type = chunk->arr[index];
+					level = type == BLOCK_AIR ? 0 : type == BLOCK_WATER ? (int8_t)(WATER_SOURCE - world_chunk_meta(chunk, index)) : WATER_SOLID;
+				}
+				levels[py][pz][px] = level;
+			}
+		}
+	}
+}
+
+/* Gets what a neighbor at "level" with "below" under it gives sideways. Water only spreads sideways from sources or once it has something to rest on. */
+static inline int8_t world_water_spread(int8_t level, int8_t below)
+{
+	return level == WATER_SOURCE || (level > 0 && (below == WATER_SOLID || below == WATER_SOURCE)) ? level - 1 : 0;
+}
+
+/*	Steps one section. Each open block becomes the highest of full flowing water if there is water above it, or one less than its
+	strongest sideways neighbor. Sources and solids never change. Reads only "cur," so every block steps from the same state. */
+static void world_water_step(const int8_t cur[PADDED][PADDED][PADDED], int8_t next[PADDED][PADDED][PADDED])
+{
+	for (int y = 1; y <= SECTION_HEIGHT; y++)
+	{
+		for (int z = 1; z <= CHUNK_WZ; z++)
+		{
+			for (int x = 1; x <= CHUNK_WX; x++)
+			{
+				int8_t level = cur[y][z][x];
+				int8_t result = cur[y + 1][z][x] > 0 ? WATER_SOURCE - 1 : 0;
+				result = max(result, world_water_spread(cur[y][z][x - 1], cur[y - 1][z][x - 1]));
+				result = max(result, world_water_spread(cur[y][z][x + 1], cur[y - 1][z][x + 1]));
+				result = max(result, world_water_spread(cur[y][z - 1][x], cur[y - 1][z - 1][x]));
+				result = max(result, world_water_spread(cur[y][z + 1][x], cur[y - 1][z + 1][x]));
+				next[y][z][x] = level == WATER_SOLID || level == WATER_SOURCE ? level : result;
+			}
+		}
+	}
+}
+
+/* Steps the section and queues whatever it changed to changes. Returns whether anything did. */
+static bool world_water_section(int x, int z, int section, int8_t cur[PADDED][PADDED][PADDED], int8_t next[PADDED][PADDED][PADDED], array_list_t changes)
+{
+	world_water_gather(x, z, section, cur);
+	world_water_step(cur, next);
+
+	bool changed = false;
+	for (int py = 1; py <= SECTION_HEIGHT; py++)
+	{
+		for (int pz = 1; pz <= CHUNK_WZ; pz++)
+		{
+			for (int px = 1; px <= CHUNK_WX; px++)
+			{
+				if (next[py][pz][px] == cur[py][pz][px])
+				{
+					continue;
+				}
+				struct water_change change = { { x + px - 1, section * SECTION_HEIGHT + py - 1, z + pz - 1 } };
+				change.type = next[py][pz][px] > 0 ? BLOCK_WATER : BLOCK_AIR;
+				change.meta = next[py][pz][px] > 0 ? WATER_SOURCE - next[py][pz][px] : 0;
+				mc_list_add(changes, mc_list_count(changes), &change, sizeof change);
+				changed = true;
+			}
+		}
+	}
+	return changed;
+}
+
+/* Steps the active sections of a job's chunk. Only reads the world, so jobs need nothing from each other. */
+static void world_water_job(int item, int worker, void* user)
+{
+	struct water_job* job = (struct water_job*)user + item;
+	water_grid_t* cur = &grids[worker * 2], * next = &grids[worker * 2 + 1];
+	unsigned int active = job->active;
+	for (int section = 0; active != 0; section++, active >>= 1)
+	{
+		if (active & 1)
+		{
+			world_water_section(job->x, job->z, section, *cur, *next, job->changes);
+		}
+	}
+}
+
+void world_water_run(int now)
+{
+	if (now % WATER_FLOW_RATE != 0)
+	{
+		return;
+	}
+	if (!jobs)
+	{
+		jobs = mc_list_create(sizeof(struct water_job));
+	}
+	if (grid_workers != worker_count())
+	{
+		free(grids);
+		grid_workers = worker_count();
+		grids = mc_malloc(grid_workers * 2 * sizeof * grids);
+	}
+
+	/*	Every active section steps from the world as it was before the step, and changes land afterwards. Sections go back to sleep here,
+		and setting the blocks a step changed wakes them and their neighbors up again, so only water that is still moving costs anything.
+		Stepping only reads, so chunks step in parallel, and their changes land in chunk_list order however many workers there are. */
+	int count = 0;
+	for (int i = 0; i < mc_list_count(chunk_list); i++)
+	{
+		struct chunk* chunk = MC_LIST_CAST_GET(chunk_list, i, struct chunk);
+		if (!chunk->water_active)
+		{
+			continue;
+		}
+		if (count == mc_list_count(jobs))
+		{
+			struct water_job fresh = { 0 };
+			fresh.changes = mc_list_create(sizeof(struct water_change));
+			mc_list_add(jobs, count, &fresh, sizeof fresh);
+		}
+		struct water_job* job = MC_LIST_CAST_GET(jobs, count, struct water_job);
+		job->x = chunk->x;
+		job->z = chunk->z;
+		job->active = chunk->water_active;
+		chunk->water_active = 0;
+		count++;
+	}
+	worker_for(count, world_water_job, mc_list_array(jobs));
+
+	for (int i = 0; i < count; i++)
+	{
+		struct water_job* job = MC_LIST_CAST_GET(jobs, i, struct water_job);
+		struct water_change* list = mc_list_array(job->changes);
+		for (int j = 0; j < mc_list_count(job->changes); j++)
+		{
+			world_block_set_meta(list[j].coords, list[j].type, list[j].meta);
+		}
+		mc_list_splice(job->changes, 0, mc_list_count(job->changes));
+	}
+}
+
+void world_water_destroy(void)
+{
+	if (jobs)
+	{
+		for (int i = 0; i < mc_list_count(jobs); i++)
+		{
+			mc_list_destroy(&MC_LIST_CAST_GET(jobs, i, struct water_job)->changes);
+		}
+		mc_list_destroy(&jobs);
+	}
+	free(grids);
+	grids = NULL;
+	grid_workers = 0;
+}
\ No newline at end of file